@@ -0,0 +1,119 @@
+#include "unit_test.hpp"
+#include "async_input.hpp"
+#include "fasta_reader.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+class test_async_input_t : public unit_test
+{
+    /* the whole file read through an async_reader's buffers */
+    std::string read_all(const char * path, async_backend backend, size_t buffer_bytes, unsigned int depth,
+        off_t start = 0)
+    {
+        int fd = open(path, O_RDONLY);
+        lseek(fd, start, SEEK_SET);
+        std::string contents;
+        {
+            async_reader reader(fd, backend, buffer_bytes, depth);
+            const char * data;
+            size_t bytes;
+            while (reader.next(&data, &bytes)) contents.append(data, bytes);
+        }
+        close(fd);
+        return contents;
+    }
+
+    void operator() ()
+    {
+        section("asynchronous reads");
+        const char * path = "/tmp/bloom-async-input-test.fa";
+        std::mt19937 rng(48);
+        std::string contents;
+        for (size_t record = 0;record < 2000;record ++)
+        {
+            contents += ">read_" + std::to_string(record) + "\n";
+            for (size_t line = 0;line < 20;line ++)
+            {
+                for (size_t i = 0;i < 60;i ++) contents += "ACGT"[rng() & 3];
+                contents += '\n';
+            }
+        }
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+
+        const async_backend backends[] = { async_io_uring, async_posix_aio };
+        const char * names[] = { "io_uring", "posix aio" };
+        for (size_t b = 0;b < 2;b ++)
+        {
+            check(read_all(path, backends[b], ASYNC_READ_BYTES, ASYNC_READ_DEPTH) == contents,
+                (std::string(names[b]) + ": whole file in order").c_str());
+            check(read_all(path, backends[b], 4099, 3) == contents,
+                (std::string(names[b]) + ": small buffers, short ring").c_str());
+            check(read_all(path, backends[b], 1000, 1, 12345) == contents.substr(12345),
+                (std::string(names[b]) + ": from the current offset with one buffer").c_str());
+
+            int fd = open(path, O_RDONLY);
+            std::string copied;
+            {
+                async_reader reader(fd, backends[b], 4096, 4);
+                std::vector<char> out(1 << 16);
+                size_t got, size = 1;
+                while ((got = reader.read(&out[0], size)) > 0)
+                {
+                    copied.append(&out[0], got);
+                    size = size * 3 % out.size() + 1;
+                }
+            }
+            close(fd);
+            check(copied == contents, (std::string(names[b]) + ": read() of odd sizes").c_str());
+        }
+        {
+            async_input in(path);
+            std::cout << "\tasync_input backend: " << names[in.backend()] << std::endl;
+            std::ifstream plain(path);
+            fasta_reader async_reader(&in), reader(&plain);
+            bool same = true;
+            size_t records = 0;
+            while (reader.next())
+            {
+                same &= async_reader.next() && std::string(async_reader.get_header()) == reader.get_header() &&
+                    std::string(async_reader.get_sequence()) == reader.get_sequence();
+                records ++;
+            }
+            check(same && !async_reader.next() && records == 2000, "fasta_reader over async_input");
+        }
+        bool threw = false;
+        try { async_input in("/dev/null"); }
+        catch (std::runtime_error &) { threw = true; }
+        check(threw, "not a regular file throws");
+
+        while (contents.size() < (64 << 20)) contents += contents;
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+        std::cout << "parse " << contents.size() << " bytes of FASTA:" << std::endl;
+        size_t sizes[3] = { 0, 0, 0 };
+        {
+            scoped_timer t("\tifstream", contents.size());
+            std::ifstream in(path);
+            fasta_reader reader(&in);
+            while (reader.next()) sizes[0] ++;
+        }
+        for (size_t b = 0;b < 2;b ++)
+        {
+            const char * labels[] = { "\tio_uring", "\tposix aio" };
+            scoped_timer t(labels[b], contents.size());
+            async_input in(path, backends[b]);
+            fasta_reader reader(&in);
+            while (reader.next()) sizes[b + 1] ++;
+        }
+        std::cout << std::endl;
+        check(sizes[0] == sizes[1] && sizes[0] == sizes[2], "same records every way");
+        remove(path);
+    }
+} test_async_input;
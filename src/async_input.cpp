@@ -0,0 +1,396 @@
+#include "async_input.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <streambuf>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <aio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace
+{
+    /* a buffer of the ring and the read into it */
+    struct slot
+    {
+        std::vector<char> buffer;
+        uint64_t offset;
+        size_t requested;
+        /* bytes read, or minus the errno, once done */
+        ssize_t result;
+        bool pending;
+        bool done;
+        struct iovec vector;
+        struct aiocb control;
+    };
+
+    /* queues reads and waits for them */
+    class read_queue
+    {
+    public:
+        virtual ~read_queue() {}
+        virtual void submit(int fd, slot & s) = 0;
+        /* returns once s is done */
+        virtual void wait(slot & s) = 0;
+    };
+
+    std::runtime_error system_error(const std::string & what, int error)
+    {
+        return std::runtime_error(what + ": " + strerror(error));
+    }
+
+    /* io_uring through the system calls: a submission ring we fill and a completion ring we empty, both shared
+       with the kernel through mmap */
+    class uring_queue : public read_queue
+    {
+    private:
+        int ring;
+        void * sq_ring;
+        void * cq_ring;
+        size_t sq_ring_bytes;
+        size_t cq_ring_bytes;
+        struct io_uring_sqe * sqes;
+        size_t sqes_bytes;
+        unsigned * sq_tail;
+        unsigned * sq_mask;
+        unsigned * sq_array;
+        unsigned * cq_head;
+        unsigned * cq_tail;
+        unsigned * cq_mask;
+        struct io_uring_cqe * cqes;
+
+        int enter(unsigned submit, unsigned complete, unsigned flags)
+        {
+            return syscall(__NR_io_uring_enter, ring, submit, complete, flags, (void *)0, 0);
+        }
+
+        void release()
+        {
+            if (sqes) munmap(sqes, sqes_bytes);
+            if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_bytes);
+            if (sq_ring) munmap(sq_ring, sq_ring_bytes);
+            close(ring);
+        }
+
+        void * map_ring(size_t bytes, off_t offset)
+        {
+            void * mapped = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, offset);
+            if (mapped == MAP_FAILED)
+            {
+                int error = errno;
+                release();
+                throw system_error("Could not map the io_uring rings", error);
+            }
+            return mapped;
+        }
+    public:
+        uring_queue(unsigned int entries) : sq_ring(0), cq_ring(0), sqes(0)
+        {
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            ring = syscall(__NR_io_uring_setup, entries, &params);
+            if (ring < 0) throw system_error("Could not set up io_uring", errno);
+
+            sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            // newer kernels share one mapping between both rings
+            if (params.features & IORING_FEAT_SINGLE_MMAP) sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+            sq_ring = map_ring(sq_ring_bytes, IORING_OFF_SQ_RING);
+            cq_ring = params.features & IORING_FEAT_SINGLE_MMAP ? sq_ring : map_ring(cq_ring_bytes, IORING_OFF_CQ_RING);
+            sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+            sqes = (struct io_uring_sqe *)map_ring(sqes_bytes, IORING_OFF_SQES);
+
+            char * sq = (char *)sq_ring, * cq = (char *)cq_ring;
+            sq_tail = (unsigned *)(sq + params.sq_off.tail);
+            sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+            sq_array = (unsigned *)(sq + params.sq_off.array);
+            cq_head = (unsigned *)(cq + params.cq_off.head);
+            cq_tail = (unsigned *)(cq + params.cq_off.tail);
+            cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+            cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+        }
+
+        virtual ~uring_queue() { release(); }
+
+        virtual void submit(int fd, slot & s)
+        {
+            // this is the only thread submitting, so nothing else moves the tail
+            unsigned tail = *sq_tail, index = tail & *sq_mask;
+            struct io_uring_sqe & sqe = sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            // READV rather than READ works back to the first kernels with io_uring
+            s.vector.iov_base = &s.buffer[0];
+            s.vector.iov_len = s.requested;
+            sqe.opcode = IORING_OP_READV;
+            sqe.fd = fd;
+            sqe.addr = (uint64_t)(uintptr_t)&s.vector;
+            sqe.len = 1;
+            sqe.off = s.offset;
+            sqe.user_data = (uint64_t)(uintptr_t)&s;
+            sq_array[index] = index;
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+            while (enter(1, 0, 0) < 0)
+                if (errno != EINTR && errno != EAGAIN) throw system_error("io_uring submission failed", errno);
+        }
+
+        virtual void wait(slot & s)
+        {
+            while (true)
+            {
+                // reap whatever has completed, in whatever order
+                unsigned head = *cq_head;
+                while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+                {
+                    const struct io_uring_cqe & cqe = cqes[head & *cq_mask];
+                    slot * completed = (slot *)(uintptr_t)cqe.user_data;
+                    completed->result = cqe.res;
+                    completed->done = true;
+                    head ++;
+                }
+                __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+                if (s.done) return;
+                if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                    throw system_error("io_uring wait failed", errno);
+            }
+        }
+    };
+
+    class aio_queue : public read_queue
+    {
+    public:
+        virtual void submit(int fd, slot & s)
+        {
+            memset(&s.control, 0, sizeof(s.control));
+            s.control.aio_fildes = fd;
+            s.control.aio_buf = &s.buffer[0];
+            s.control.aio_nbytes = s.requested;
+            s.control.aio_offset = s.offset;
+            if (aio_read(&s.control) != 0) throw system_error("aio_read failed", errno);
+        }
+
+        virtual void wait(slot & s)
+        {
+            const struct aiocb * list[1] = { &s.control };
+            int error;
+            while ((error = aio_error(&s.control)) == EINPROGRESS) aio_suspend(list, 1, 0);
+            ssize_t result = aio_return(&s.control);
+            s.result = error ? -error : result;
+            s.done = true;
+        }
+    };
+}
+
+struct async_reader::privates
+{
+    int fd;
+    uint64_t size;
+    uint64_t next_offset;
+    size_t buffer_bytes;
+    std::vector<slot> slots;
+    std::unique_ptr<read_queue> queue;
+    async_backend backend;
+    /* the slot the caller has, and whether next() has been called yet */
+    unsigned int current;
+    bool started;
+    /* what read() hasn't copied out of the current buffer */
+    const char * available;
+    size_t left;
+
+    /* queues a read of the next part of the file into s, if there's any left */
+    void queue_read(slot & s)
+    {
+        s.pending = next_offset < size;
+        if (!s.pending) return;
+        s.offset = next_offset;
+        s.requested = std::min<uint64_t>(buffer_bytes, size - next_offset);
+        s.done = false;
+        next_offset += s.requested;
+        queue->submit(fd, s);
+    }
+
+    /* waits for every read in flight - the kernel may still be writing into the buffers */
+    void wait_all()
+    {
+        for (size_t i = 0;i < slots.size();i ++)
+        {
+            if (!slots[i].pending) continue;
+            try { queue->wait(slots[i]); }
+            catch (std::runtime_error &) {}
+            slots[i].pending = false;
+        }
+    }
+};
+
+async_reader::async_reader(int fd, async_backend backend, size_t buffer_bytes, unsigned int depth)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+        throw std::runtime_error("Asynchronous reads need a regular file");
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    std::unique_ptr<privates> p(new privates());
+    p->fd = fd;
+    p->size = info.st_size;
+    p->next_offset = position > 0 ? position : 0;
+    p->buffer_bytes = std::max<size_t>(1, buffer_bytes);
+    p->current = 0;
+    p->started = false;
+    p->available = 0;
+    p->left = 0;
+    // the slots are in place before any read is queued, since the queue holds pointers to them
+    p->slots.resize(std::max(1u, depth));
+    for (size_t i = 0;i < p->slots.size();i ++)
+    {
+        p->slots[i].buffer.resize(p->buffer_bytes);
+        p->slots[i].pending = false;
+    }
+    p->backend = backend;
+    if (backend == async_io_uring)
+    {
+        try { p->queue.reset(new uring_queue(p->slots.size())); }
+        catch (std::runtime_error &) { p->backend = async_posix_aio; }
+    }
+    if (!p->queue) p->queue.reset(new aio_queue());
+    m = p.release();
+    try
+    {
+        for (size_t i = 0;i < m->slots.size();i ++) m->queue_read(m->slots[i]);
+    }
+    catch (...)
+    {
+        m->wait_all();
+        delete m;
+        throw;
+    }
+}
+
+async_reader::~async_reader()
+{
+    m->wait_all();
+    delete m;
+}
+
+bool async_reader::next(const char * * data, size_t * bytes)
+{
+    m->left = 0;
+    if (m->started)
+    {
+        // the caller is done with the current buffer, so it can go to the back of the queue
+        m->queue_read(m->slots[m->current]);
+        m->current = (m->current + 1) % m->slots.size();
+    }
+    m->started = true;
+    slot & s = m->slots[m->current];
+    if (!s.pending) return false;
+    m->queue->wait(s);
+    s.pending = false;
+    if (s.result < 0) throw system_error("Read failed", -s.result);
+    // a short read just means asking again for the rest
+    size_t got = s.result;
+    while (got < s.requested)
+    {
+        ssize_t more = pread(m->fd, &s.buffer[got], s.requested - got, s.offset + got);
+        if (more < 0 && errno == EINTR) continue;
+        if (more < 0) throw system_error("Read failed", errno);
+        if (more == 0) break;
+        got += more;
+    }
+    if (!got) return false;
+    *data = &s.buffer[0];
+    *bytes = got;
+    return true;
+}
+
+size_t async_reader::read(void * out, size_t bytes)
+{
+    size_t done = 0;
+    while (done < bytes)
+    {
+        if (!m->left)
+        {
+            const char * data;
+            size_t got;
+            if (!next(&data, &got)) break;
+            m->available = data;
+            m->left = got;
+        }
+        size_t copied = std::min(m->left, bytes - done);
+        memcpy((char *)out + done, m->available, copied);
+        m->available += copied;
+        m->left -= copied;
+        done += copied;
+    }
+    return done;
+}
+
+async_backend async_reader::backend() const
+{
+    return m->backend;
+}
+
+/* hands the reader's buffers to the istream without copying */
+class async_buffer : public std::streambuf
+{
+public:
+    async_reader reader;
+
+    async_buffer(int fd, async_backend backend) : reader(fd, backend) {}
+protected:
+    virtual int_type underflow()
+    {
+        const char * data;
+        size_t bytes;
+        if (!reader.next(&data, &bytes)) return traits_type::eof();
+        char * start = const_cast<char *>(data);
+        setg(start, start, start + bytes);
+        return traits_type::to_int_type(*start);
+    }
+};
+
+struct async_input::privates
+{
+    int fd;
+    async_buffer * buffer;
+};
+
+async_input::async_input(const std::string & path, async_backend backend) : std::istream(0)
+{
+    m = new privates();
+    m->fd = open(path.c_str(), O_RDONLY);
+    if (m->fd < 0)
+    {
+        delete m;
+        throw std::runtime_error("Could not open " + path);
+    }
+    try { m->buffer = new async_buffer(m->fd, backend); }
+    catch (...)
+    {
+        close(m->fd);
+        delete m;
+        throw;
+    }
+    rdbuf(m->buffer);
+    // so that read errors are thrown rather than ending the input
+    exceptions(std::ios::badbit);
+}
+
+async_input::~async_input()
+{
+    exceptions(std::ios::goodbit);
+    rdbuf(0);
+    delete m->buffer;
+    close(m->fd);
+    delete m;
+}
+
+async_backend async_input::backend() const
+{
+    return m->buffer->reader.backend();
+}
@@ -0,0 +1,74 @@
+/*
+    Reading a file with several large reads in flight
+
+    A getline() loop asks for the next bytes only once it has parsed the last ones, so the device sits idle
+    while the kmers are hashed.  async_reader keeps a ring of depth buffers of ASYNC_READ_BYTES each: every
+    buffer not being parsed has a read queued for the next part of the file, and a buffer is queued again as
+    soon as the caller moves on from it, so the reads run ahead of the parsing by up to depth - 1 buffers.
+
+    The reads go through io_uring (with the raw system calls, so liburing isn't needed) when the kernel allows
+    it, and POSIX AIO otherwise - containers often block io_uring.  Either way only regular files can be
+    read, since the reads are at offsets; anything else is for compressed_input's plain read() path.
+
+    async_input is an istream over an async_reader for fasta_reader and fastq_reader:
+
+        async_input in("genome.fa");
+        fasta_reader reader(&in);
+
+    compressed_input reads regular files through an async_reader too, so its decompression is fed the same way.
+*/
+#ifndef __ASYNC_INPUT_HPP
+#define __ASYNC_INPUT_HPP
+#include <istream>
+#include <string>
+#include <stddef.h>
+
+/* the size of each read, and how many buffers are in the ring */
+const size_t ASYNC_READ_BYTES = 1 << 20;
+const unsigned int ASYNC_READ_DEPTH = 8;
+
+enum async_backend { async_io_uring, async_posix_aio };
+
+class async_reader
+{
+private:
+    /* pImpl pattern allows private members to be defined in cpp file */
+    struct privates;
+    privates * m;
+public:
+    /* starts reading fd, which must be a regular file open for reading and stays the caller's to close.
+       io_uring is tried first unless backend is async_posix_aio.  Throws std::runtime_error if neither
+       can be set up */
+    async_reader(int fd, async_backend backend = async_io_uring, size_t buffer_bytes = ASYNC_READ_BYTES,
+        unsigned int depth = ASYNC_READ_DEPTH);
+    async_reader(const async_reader &) = delete;
+    async_reader & operator=(const async_reader &) = delete;
+
+    /* waits for any reads still in flight */
+    virtual ~async_reader();
+
+    /* waits for the next buffer of the file, returning false at the end.  data stays valid until the next
+       call, when its buffer is queued for another read.  Throws std::runtime_error if a read failed */
+    bool next(const char * * data, size_t * bytes);
+
+    /* copies up to bytes into out, fewer only at the end of the file */
+    size_t read(void * out, size_t bytes);
+
+    async_backend backend() const;
+};
+
+class async_input : public std::istream
+{
+private:
+    struct privates;
+    privates * m;
+public:
+    /* opens path, which must be a regular file.  Throws std::runtime_error if it can't be read */
+    async_input(const std::string & path, async_backend backend = async_io_uring);
+
+    virtual ~async_input();
+
+    async_backend backend() const;
+};
+
+#endif
@@ -0,0 +1,385 @@
+/*
+    Benchmark suite (make bench)
+
+    Sweeps the desired false positive probability p, the number of items n, the input source, the block type,
+    the hash function and the filter implementation.  For each combination it records
+        - the empirical false positive rate with a 95% Wilson confidence interval, against
+          expected_false_positive_probability(n)
+        - ns/op and cycles/op (time stamp counter cycles) for filling and testing
+        - bits/key (m/n)
+        - per op hardware counts (instructions, LLC misses, dTLB misses, branch misses etc) for filling and for
+          the negative queries, where perf_event_open is available (-1 otherwise) - see perf_counters.hpp
+    and writes a line to the terminal plus one record per combination to CSV and/or JSON.
+
+    Input sources:
+        lcg    - minstd_rand0 as used by test_speed_t (only 31 bits of entropy, which flatters std::hash)
+        mt64   - full 64 bit values from mt19937_64
+        kmers  - distinct 31-mers from data/test_long.fa (n is capped at the number available)
+    Negative queries are mt19937_64 values (or random 31-mers for the kmers source) that are not in the set.
+
+    Each filter is driven three ways (the api column):
+        virtual - set()/test() through a bloomfilter<kmer_t> reference the compiler can't see through
+        static  - add()/contains() on the concrete type, so the probe loop is inlined (see bloomfilter_crtp)
+        batch   - set_batch()/test_batch()
+
+    Usage: bloom-bench [--quick] [--csv file] [--json file]
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <random>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <x86intrin.h>
+#include "terminal.hpp"
+#include "perf_counters.hpp"
+#include "bloomfilter.hpp"
+#include "bloomfilter_basic.hpp"
+#include "bloomfilter_vectorbool.hpp"
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include "fasta_reader.hpp"
+
+/* a set of items to insert and a disjoint set of items to query for false positives */
+struct bench_input
+{
+    std::string name;
+    std::vector<kmer_t> members;
+    std::vector<kmer_t> negatives;
+};
+
+/* one row of output */
+struct bench_record
+{
+    std::string input, filter, hash, api;
+    double p;
+    size_t n, m;
+    int h;
+    double bits_per_key;
+    double fill_ns, fill_cycles, test_ns, test_cycles, query_ns;
+    double fpp, fpp_low, fpp_high, expected_fpp;
+    size_t false_negatives;
+    double fill_events[perf_counters::event_count], query_events[perf_counters::event_count];
+};
+
+/* wall clock, time stamp counter and hardware counters around a block of operations */
+class op_timer
+{
+    perf_counters & counters;
+    std::chrono::high_resolution_clock::time_point started;
+    unsigned long long started_cycles;
+public:
+    op_timer(perf_counters & counters) : counters(counters)
+    {
+        counters.start();
+        started = std::chrono::high_resolution_clock::now();
+        started_cycles = __rdtsc();
+    }
+
+    /* returns ns/op, sets cycles to cycles/op and events to the per op counts (-1 if not available) */
+    double per_op(size_t ops, double * cycles, double * events = 0) const
+    {
+        unsigned long long stopped_cycles = __rdtsc();
+        std::chrono::duration<double, std::nano> ns = std::chrono::high_resolution_clock::now() - started;
+        counters.stop();
+        *cycles = (stopped_cycles - started_cycles) / (double)ops;
+        if (events)
+        {
+            for (int e = 0;e < perf_counters::event_count;e ++)
+                events[e] = counters.available(e) ? counters.value(e) / ops : -1;
+        }
+        return ns.count() / ops;
+    }
+};
+
+/* the virtual api - kept out of line so the compiler can't work out the dynamic type */
+__attribute__ ((noinline, noclone))
+static void fill_virtual(bloomfilter<kmer_t> & bf, const std::vector<kmer_t> & kmers, size_t n)
+{
+    for (size_t i = 0;i < n;i ++) bf.set(kmers[i]);
+}
+
+__attribute__ ((noinline, noclone))
+static void test_virtual(const bloomfilter<kmer_t> & bf, const std::vector<kmer_t> & kmers, size_t n, bool * results)
+{
+    for (size_t i = 0;i < n;i ++) results[i] = bf.test(kmers[i]);
+}
+
+/* the static api */
+template<typename T>
+static void fill_static(T & bf, const std::vector<kmer_t> & kmers, size_t n)
+{
+    for (size_t i = 0;i < n;i ++) bf.add(kmers[i]);
+}
+
+template<typename T>
+static void test_static(const T & bf, const std::vector<kmer_t> & kmers, size_t n, bool * results)
+{
+    for (size_t i = 0;i < n;i ++) results[i] = bf.contains(kmers[i]);
+}
+
+enum bench_api { api_virtual, api_static, api_batch };
+
+/* 95% Wilson score interval for successes out of trials */
+static void wilson_interval(size_t successes, size_t trials, double * low, double * high)
+{
+    const double z = 1.96;
+    double phat = successes / (double)trials;
+    double denominator = 1 + z*z/trials;
+    double centre = (phat + z*z/(2*trials)) / denominator;
+    double half = z * sqrt(phat*(1-phat)/trials + z*z/(4.0*trials*trials)) / denominator;
+    *low = std::max(0.0, centre - half);
+    *high = std::min(1.0, centre + half);
+}
+
+class benchmark
+{
+public:
+    std::vector<bench_record> records;
+    perf_counters counters;
+
+    /* the number of items required for each query set - enough to resolve p = 0.001 */
+    size_t query_count = 1000000;
+
+    /* times one filter type against one input */
+    template<typename T>
+    void run(const bench_input & input, double p, const char * filter, const char * hash, bench_api api)
+    {
+        size_t n = input.members.size();
+        bench_record r;
+        r.input = input.name;
+        r.filter = filter;
+        r.hash = hash;
+        const char * api_names[] = { "virtual", "static", "batch" };
+        r.api = api_names[api];
+        r.p = p;
+        r.n = n;
+        r.m = bloomfilter<kmer_t>::determine_m(p, n);
+        r.h = bloomfilter<kmer_t>::determine_h(r.m, n);
+        r.bits_per_key = r.m / (double)n;
+
+        T bf(r.m, r.h);
+        std::unique_ptr<bool[]> results(new bool[std::max(n, input.negatives.size())]);
+
+        {
+            op_timer t(counters);
+            if (api == api_batch) bf.set_batch(&input.members[0], n);
+            else if (api == api_static) fill_static(bf, input.members, n);
+            else fill_virtual(bf, input.members, n);
+            r.fill_ns = t.per_op(n, &r.fill_cycles, r.fill_events);
+        }
+
+        {
+            op_timer t(counters);
+            if (api == api_batch) bf.test_batch(&input.members[0], n, results.get());
+            else if (api == api_static) test_static(bf, input.members, n, results.get());
+            else test_virtual(bf, input.members, n, results.get());
+            r.test_ns = t.per_op(n, &r.test_cycles);
+            r.false_negatives = std::count(results.get(), results.get() + n, false);
+        }
+
+        size_t queries = input.negatives.size();
+        {
+            op_timer t(counters);
+            double cycles;
+            if (api == api_batch) bf.test_batch(&input.negatives[0], queries, results.get());
+            else if (api == api_static) test_static(bf, input.negatives, queries, results.get());
+            else test_virtual(bf, input.negatives, queries, results.get());
+            r.query_ns = t.per_op(queries, &cycles, r.query_events);
+        }
+        size_t false_positives = std::count(results.get(), results.get() + queries, true);
+        r.fpp = false_positives / (double)queries;
+        wilson_interval(false_positives, queries, &r.fpp_low, &r.fpp_high);
+        r.expected_fpp = bf.expected_false_positive_probability(n);
+
+        print(r);
+        records.push_back(r);
+    }
+
+    /* all the filter implementations for a given hash function */
+    template<typename Hash>
+    void run_filters(const bench_input & input, double p, const char * hash)
+    {
+        run< bloomfilter_basic<kmer_t,uint64_t,Hash> >(input, p, "basic64", hash, api_virtual);
+        run< bloomfilter_basic<kmer_t,uint64_t,Hash> >(input, p, "basic64", hash, api_static);
+        run< bloomfilter_basic<kmer_t,uint64_t,Hash> >(input, p, "basic64", hash, api_batch);
+        run< bloomfilter_basic<kmer_t,uint32_t,Hash> >(input, p, "basic32", hash, api_virtual);
+        run< bloomfilter_basic<kmer_t,uint8_t,Hash> >(input, p, "basic8", hash, api_virtual);
+        run< bloomfilter_vectorbool<kmer_t,Hash> >(input, p, "vectorbool", hash, api_virtual);
+        run< bloomfilter_vectorbool<kmer_t,Hash> >(input, p, "vectorbool", hash, api_static);
+    }
+
+    void run_hashes(const bench_input & input, double p)
+    {
+        run_filters< std::hash<kmer_t> >(input, p, "std::hash");
+        run_filters< kmer_hash >(input, p, "spooky");
+        run_filters< kmer_fmix_hash<> >(input, p, "fmix");
+    }
+
+    void print(const bench_record & r)
+    {
+        bool within = r.expected_fpp >= r.fpp_low && r.expected_fpp <= r.fpp_high;
+        // formatted apart from std::cout so std::fixed doesn't carry over to the next record
+        std::ostringstream line;
+        line << r.input << " n=" << r.n << " p=" << r.p << "\t" << r.filter << "\t" << r.hash << "\t" << r.api
+            << std::fixed << "\tfill " << r.fill_ns << "ns " << r.fill_cycles << "cyc"
+            << "\ttest " << r.test_ns << "ns " << r.test_cycles << "cyc"
+            << "\t" << (within ? terminal::reset : terminal::red)
+            << "p(false +ve) " << r.fpp << " [" << r.fpp_low << "," << r.fpp_high << "] vs E " << r.expected_fpp
+            << terminal::reset;
+        if (r.false_negatives) line << terminal::red << " false negatives " << r.false_negatives << terminal::reset;
+        std::cout << line.str() << std::endl;
+    }
+
+    void write_csv(std::ostream & out) const
+    {
+        out << "input,filter,hash,api,p,n,m,h,bits_per_key,fill_ns,fill_cycles,test_ns,test_cycles,query_ns,"
+               "fpp,fpp_low,fpp_high,expected_fpp,false_negatives";
+        for (int e = 0;e < perf_counters::event_count;e ++) out << ",fill_hw_" << perf_counters::name(e);
+        for (int e = 0;e < perf_counters::event_count;e ++) out << ",query_hw_" << perf_counters::name(e);
+        out << "\n";
+        for (auto i = records.begin();i != records.end();i ++)
+        {
+            out << i->input << "," << i->filter << "," << i->hash << "," << i->api << "," << i->p << "," << i->n << ","
+                << i->m << "," << i->h << "," << i->bits_per_key << "," << i->fill_ns << "," << i->fill_cycles << ","
+                << i->test_ns << "," << i->test_cycles << "," << i->query_ns << "," << i->fpp << "," << i->fpp_low << ","
+                << i->fpp_high << "," << i->expected_fpp << "," << i->false_negatives;
+            for (int e = 0;e < perf_counters::event_count;e ++) out << "," << i->fill_events[e];
+            for (int e = 0;e < perf_counters::event_count;e ++) out << "," << i->query_events[e];
+            out << "\n";
+        }
+    }
+
+    void write_json(std::ostream & out) const
+    {
+        out << "[\n";
+        for (auto i = records.begin();i != records.end();i ++)
+        {
+            out << "  {\"input\":\"" << i->input << "\",\"filter\":\"" << i->filter << "\",\"hash\":\"" << i->hash
+                << "\",\"api\":\"" << i->api << "\",\"p\":" << i->p << ",\"n\":" << i->n << ",\"m\":" << i->m
+                << ",\"h\":" << i->h << ",\"bits_per_key\":" << i->bits_per_key
+                << ",\"fill_ns\":" << i->fill_ns << ",\"fill_cycles\":" << i->fill_cycles
+                << ",\"test_ns\":" << i->test_ns << ",\"test_cycles\":" << i->test_cycles << ",\"query_ns\":" << i->query_ns
+                << ",\"fpp\":" << i->fpp << ",\"fpp_low\":" << i->fpp_low << ",\"fpp_high\":" << i->fpp_high
+                << ",\"expected_fpp\":" << i->expected_fpp << ",\"false_negatives\":" << i->false_negatives;
+            for (int e = 0;e < perf_counters::event_count;e ++) 
+                out << ",\"fill_hw_" << perf_counters::name(e) << "\":" << i->fill_events[e];
+            for (int e = 0;e < perf_counters::event_count;e ++) 
+                out << ",\"query_hw_" << perf_counters::name(e) << "\":" << i->query_events[e];
+            out << "}" << (i + 1 == records.end() ? "\n" : ",\n");
+        }
+        out << "]\n";
+    }
+};
+
+/* draws from rng until we have n distinct members, then query_count negatives not in that set */
+template<typename rng_t>
+static bench_input random_input(const char * name, rng_t & rng, size_t n, size_t query_count)
+{
+    bench_input input;
+    input.name = name;
+    std::unordered_set<kmer_t> seen;
+    while (input.members.size() < n)
+    {
+        kmer_t k = rng();
+        if (seen.insert(k).second) input.members.push_back(k);
+    }
+    std::mt19937_64 queryrng(98765);
+    while (input.negatives.size() < query_count)
+    {
+        kmer_t k = queryrng();
+        if (!seen.count(k)) input.negatives.push_back(k);
+    }
+    return input;
+}
+
+/* distinct kmers of the given length from a fasta file, and random kmers of the same length that aren't in it */
+static bench_input kmer_input(const char * filename, kmer_size_t length, size_t n, size_t query_count)
+{
+    bench_input input;
+    input.name = "kmers";
+    std::ifstream f(filename);
+    if (!f) throw std::runtime_error(std::string("Could not open ") + filename);
+    fasta_reader reader(&f);
+    kmer_ops ops(length);
+    std::unordered_set<kmer_t> seen;
+    while (input.members.size() < n && reader.next())
+    {
+        const char * i = reader.get_sequence();
+        kmer_t kmer;
+        if (!ops.read_first(&kmer, &i)) continue;
+        do {
+            if (seen.insert(kmer).second) input.members.push_back(kmer);
+        } while (input.members.size() < n && ops.read_next(&kmer, &i));
+    }
+    std::mt19937_64 queryrng(98765);
+    const kmer_t mask = (((kmer_t)1) << (2*length)) - 1;
+    while (input.negatives.size() < query_count)
+    {
+        kmer_t k = queryrng() & mask;
+        if (!seen.count(k)) input.negatives.push_back(k);
+    }
+    return input;
+}
+
+int main(int argc, const char* args[])
+{
+    std::vector<size_t> ns = { 100000, 1000000 };
+    std::vector<double> ps = { 0.1, 0.01, 0.001 };
+    const char * csv = 0;
+    const char * json = 0;
+    for (int i = 1;i < argc;i ++)
+    {
+        if (!strcmp(args[i], "--quick")) ns = { 100000 };
+        else if (!strcmp(args[i], "--csv") && i + 1 < argc) csv = args[++i];
+        else if (!strcmp(args[i], "--json") && i + 1 < argc) json = args[++i];
+        else
+        {
+            std::cerr << "Usage: " << args[0] << " [--quick] [--csv file] [--json file]" << std::endl;
+            return 1;
+        }
+    }
+
+    benchmark b;
+    try {
+        for (auto n = ns.begin();n != ns.end();n ++)
+        {
+            std::minstd_rand0 lcg(243345);
+            std::mt19937_64 mt(243345);
+            bench_input inputs[] = {
+                random_input("lcg", lcg, *n, b.query_count),
+                random_input("mt64", mt, *n, b.query_count),
+                kmer_input("data/test_long.fa", 31, *n, b.query_count)
+            };
+            for (auto input = std::begin(inputs);input != std::end(inputs);input ++)
+            {
+                // the kmers input doesn't grow with n so only run it once
+                if (input->name == "kmers" && n != ns.begin() && input->members.size() < *n) continue;
+                for (auto p = ps.begin();p != ps.end();p ++)
+                    b.run_hashes(*input, *p);
+            }
+        }
+    } catch (std::exception & e)
+    {
+        std::cerr << terminal::red << e.what() << terminal::reset << std::endl;
+        return 1;
+    }
+
+    if (csv)
+    {
+        std::ofstream out(csv);
+        b.write_csv(out);
+    }
+    if (json)
+    {
+        std::ofstream out(json);
+        b.write_json(out);
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include "unit_test.hpp"
+#include "bit_sliced_index.hpp"
+#include "bloomfilter_basic.hpp"
+#include "kmer_hash.hpp"
+#include "scoped_timer.hpp"
+#include "kmer_scan.hpp"
+#include <random>
+#include <iostream>
+#include <memory>
+#include <algorithm>
+
+class test_bit_sliced_index_t : public unit_test
+{
+    typedef bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > filter_t;
+    typedef bit_sliced_index<kmer_t,kmer_fmix_hash<> > index_t;
+
+    void operator() ()
+    {
+        section("bit-sliced index");
+        const int samples = 300, per_sample = 2000, m = 1 << 16, h = 3;
+        std::mt19937_64 rng(11);
+        index_t index(m, h, samples);
+        std::vector<std::unique_ptr<filter_t> > filters;
+        std::vector<std::vector<kmer_t> > kmers(samples);
+        for (int s = 0;s < samples;s ++)
+        {
+            filters.push_back(std::unique_ptr<filter_t>(new filter_t(m, h)));
+            for (int i = 0;i < per_sample;i ++)
+            {
+                kmers[s].push_back(rng());
+                filters[s]->add(kmers[s].back());
+            }
+            // half the samples go in kmer by kmer and half from the finished filter
+            if (s & 1) index.add_filter(s, *filters[s]);
+            else for (int i = 0;i < per_sample;i ++) index.add(s, kmers[s][i]);
+        }
+        check(index.result_words() == 8, "rows are padded to 256 bits");
+
+        bool agrees = true, found_own = true;
+        for (int s = 0;s < samples;s += 7)
+        {
+            for (int i = 0;i < per_sample;i += 50)
+            {
+                std::vector<size_t> found = index.samples_containing(kmers[s][i]);
+                found_own &= std::find(found.begin(), found.end(), (size_t)s) != found.end();
+                std::vector<size_t> expected;
+                for (int t = 0;t < samples;t ++) if (filters[t]->test(kmers[s][i])) expected.push_back(t);
+                agrees &= found == expected;
+            }
+        }
+        check(found_own, "kmers are found in their own sample");
+        check(agrees, "index answers match testing every sample's filter");
+
+        kmer_ops ops(21);
+        index_t sequences(m, h, 3);
+        const char * seq = "ACGTTGCAAGGCTTACCGATGCAGTCCATGGA";
+        filter_t one(m, h);
+        insert_kmers(one, ops, seq);
+        sequences.add_filter(1, one);
+        std::vector<size_t> hits(3);
+        size_t total = sequences.count_hits(ops, seq, &hits[0]);
+        check(total == 12 && hits[1] == 12 && hits[0] == 0 && hits[2] == 0, "count_hits counts per sample");
+
+        std::vector<uint64_t> result(index.result_words());
+        std::vector<kmer_t> queries(20000);
+        for (size_t i = 0;i < queries.size();i ++) queries[i] = kmers[rng() % samples][rng() % per_sample];
+        size_t found = 0;
+        std::cout << "query " << samples << " samples:" << std::endl;
+        {
+            scoped_timer t("\tbit-sliced index", queries.size());
+            for (size_t i = 0;i < queries.size();i ++)
+            {
+                index.query(queries[i], &result[0]);
+                found += popcount_bytes(&result[0], result.size() * 8);
+            }
+        }
+        size_t found_filters = 0;
+        {
+            scoped_timer t("\tper-sample filters", queries.size());
+            for (size_t i = 0;i < queries.size();i ++)
+                for (int s = 0;s < samples;s ++) found_filters += filters[s]->contains(queries[i]);
+        }
+        std::cout << std::endl;
+        check(found == found_filters, "index and filters find the same number of samples");
+    }
+
+} test_bit_sliced_index;
@@ -0,0 +1,164 @@
+/*
+    Bit-sliced signature index - many samples' bloom filters stored transposed (as in BIGSI and COBS)
+
+    Every sample has a bloom filter with the same m, h and hash function.  Rather than storing each filter's m
+    bits contiguously, row i holds bit i of every sample's filter, one bit per sample.  The samples containing
+    a kmer are then the AND of the h rows its hashes pick - h contiguous reads instead of a test() on every
+    sample's filter, each of which is h scattered reads.
+
+    Rows are padded to a multiple of 256 bits so the AND can be done with AVX2 (when the cpu supports it)
+    without a scalar tail.
+
+    index_t and Hash have the same meaning as for the filters, and bit positions are chosen exactly as
+    bloomfilter_basic chooses them, so a sample can be added from a filter that was already built (add_filter)
+*/
+#ifndef __BIT_SLICED_INDEX_HPP
+#define __BIT_SLICED_INDEX_HPP
+#include "bloomfilter.hpp"
+#include "filter_storage.hpp"
+#include "kmer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <stdexcept>
+#include <immintrin.h>
+
+inline void and_rows_scalar(const uint64_t * const * rows, int count, size_t words, uint64_t * out)
+{
+    for (size_t w = 0;w < words;w ++)
+    {
+        uint64_t value = rows[0][w];
+        for (int r = 1;r < count;r ++) value &= rows[r][w];
+        out[w] = value;
+    }
+}
+
+/* words must be a multiple of 4 */
+__attribute__ ((target ("avx2")))
+inline void and_rows_avx2(const uint64_t * const * rows, int count, size_t words, uint64_t * out)
+{
+    for (size_t w = 0;w < words;w += 4)
+    {
+        __m256i value = _mm256_loadu_si256((const __m256i *)(rows[0] + w));
+        for (int r = 1;r < count;r ++) value = _mm256_and_si256(value, _mm256_loadu_si256((const __m256i *)(rows[r] + w)));
+        _mm256_storeu_si256((__m256i *)(out + w), value);
+    }
+}
+
+typedef void (*and_rows_fn)(const uint64_t * const *, int, size_t, uint64_t *);
+
+/* sets out to the AND of count rows of words 64 bit words each (words a multiple of 4) */
+inline void and_rows(const uint64_t * const * rows, int count, size_t words, uint64_t * out)
+{
+    static const and_rows_fn kernel = __builtin_cpu_supports("avx2") ? and_rows_avx2 : and_rows_scalar;
+    kernel(rows, count, words, out);
+}
+
+template<typename index_t, typename Hash = std::hash<index_t> >
+class bit_sliced_index
+{
+private:
+    size_t m;
+    int h;
+    size_t samples;
+    /* 64 bit words per row, rounded up to a multiple of 4 */
+    size_t row_words;
+    filter_storage storage;
+    uint64_t * bits;
+
+    /* the word offsets of the h rows for kmer, chosen as bloomfilter_basic chooses bits */
+    void row_offsets(const index_t & kmer, size_t * offsets) const
+    {
+        static Hash hashfunction;
+        index_t hashvalue = kmer;
+        for (int i = 0;i < h;i ++)
+        {
+            hashvalue = hashfunction(hashvalue);
+            offsets[i] = (size_t)(hashvalue % m) * row_words;
+        }
+    }
+public:
+    /* room for samples samples' filters of m bits and h hashes */
+    bit_sliced_index(size_t m, int h, size_t samples, const storage_options & options = storage_options())
+        : m(m), h(h), samples(samples), row_words((samples + 255) / 256 * 4),
+        storage(m * row_words * sizeof(uint64_t), options)
+    {
+        if (h <= 0 || h > 64) throw std::runtime_error("bit_sliced_index needs 1 to 64 hash functions");
+        bits = (uint64_t *)storage.data();
+    }
+
+    /* adds kmer to the given sample's filter (sample < sample_count()) */
+    void add(size_t sample, const index_t & kmer)
+    {
+        size_t offsets[64];
+        row_offsets(kmer, offsets);
+        for (int i = 0;i < h;i ++) bits[offsets[i] + sample / 64] |= 1ULL << (sample & 63);
+    }
+
+    /* copies a filter built with the same m, h and Hash in as the given sample.  Throws std::runtime_error if
+       m or h don't match */
+    void add_filter(size_t sample, const bloomfilter<index_t> & filter)
+    {
+        if (filter.getm() != m || filter.geth() != h) throw std::runtime_error("Filter has a different m or h to the index");
+        size_t bytes = (m + 7) / 8;
+        std::vector<uint8_t> chunk(std::min(FILTER_CODEC_CHUNK_BYTES, bytes));
+        for (size_t first = 0;first < bytes;first += chunk.size())
+        {
+            size_t todo = std::min(chunk.size(), bytes - first);
+            filter.read_bits(first, todo, &chunk[0]);
+            for (size_t i = 0;i < todo;i ++)
+            {
+                for (uint8_t b = chunk[i];b;b &= b - 1)
+                    bits[((first + i) * 8 + __builtin_ctz(b)) * row_words + sample / 64] |= 1ULL << (sample & 63);
+            }
+        }
+    }
+
+    /* sets result (result_words() words) to the set of samples whose filters contain kmer - bit s%64 of
+       word s/64 for sample s */
+    void query(const index_t & kmer, uint64_t * result) const
+    {
+        size_t offsets[64];
+        const uint64_t * rows[64];
+        row_offsets(kmer, offsets);
+        for (int i = 0;i < h;i ++) rows[i] = bits + offsets[i];
+        and_rows(rows, h, row_words, result);
+    }
+
+    /* the samples whose filters contain kmer */
+    std::vector<size_t> samples_containing(const index_t & kmer) const
+    {
+        std::vector<uint64_t> result(row_words);
+        query(kmer, &result[0]);
+        std::vector<size_t> found;
+        for (size_t w = 0;w < row_words;w ++)
+            for (uint64_t word = result[w];word;word &= word - 1) found.push_back(w * 64 + __builtin_ctzll(word));
+        return found;
+    }
+
+    /* adds to hits[s] the number of kmers of the null-terminated sequence that sample s contains, returning the
+       number of kmers.  hits must have sample_count() entries */
+    size_t count_hits(const kmer_ops & ops, const char * sequence, size_t * hits) const
+    {
+        std::vector<uint64_t> result(row_words);
+        kmer_t kmer;
+        if (!ops.read_first(&kmer, &sequence)) return 0;
+        size_t total = 0;
+        do {
+            query(kmer, &result[0]);
+            for (size_t w = 0;w < row_words;w ++)
+                for (uint64_t word = result[w];word;word &= word - 1) hits[w * 64 + __builtin_ctzll(word)] ++;
+            total ++;
+        } while (ops.read_next(&kmer, &sequence));
+        return total;
+    }
+
+    /* the number of 64 bit words query() writes */
+    size_t result_words() const { return row_words; }
+
+    size_t sample_count() const { return samples; }
+    size_t getm() const { return m; }
+    int geth() const { return h; }
+};
+
+#endif
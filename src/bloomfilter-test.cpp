@@ -3,20 +3,25 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <random>
 #include <unordered_set>
 #include <algorithm>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <thread>
 #include "unit_test.hpp"
 #include "terminal.hpp"
 #include "scoped_timer.hpp"
+#include "latency_histogram.hpp"
 #include "bloomfilter.hpp"
 #include "bloomfilter_basic.hpp"
 #include "bloomfilter_vectorbool.hpp"
 #include "bloomfilter_perfectcheat.hpp"
-#ifdef USESSE
 #include "bloomfilter_sse.hpp"
-#endif
 #include "kmer.hpp"
+#include "kmer_hash.hpp"
 
 // quick test of basic functionality
 class test_quick_t : public unit_test 
@@ -34,9 +39,268 @@ class test_quick_t : public unit_test
         bf.set(65);
         check(bf.test(64), "TestBloomFilter: Test 1");
         check(bf.test(65), "TestBloomFilter: Test 2");
+
+        section("quick batch test");
+        bloomfilter_basic<uint64_t,kmer_t,kmer_fmix_hash<> > bfb(1000,5);
+        kmer_t kmers[20];
+        for (int i = 0;i < 20;i ++) kmers[i] = i * 3;
+        bfb.set_batch(kmers, 20);
+        bool results[20];
+        bfb.test_batch(kmers, 20, results);
+        check(std::count(results, results + 20, true) == 20, "set_batch/test_batch: all kmers found");
+        bool all_match = true;
+        for (int i = 0;i < 20;i ++) all_match &= bfb.test(kmers[i]);
+        check(all_match, "set_batch/test: all kmers found");
     }  
 } test_quick;
 
+// the sse filter against the bit layout bloomfilter_basic has
+class test_sse_t : public unit_test 
+{
+    public:
+    void check_layout(size_t m, const char * info)
+    {
+        bloomfilter_sse<kmer_t,kmer_fmix_hash<> > sse(m, 4);
+        bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > basic(m, 4);
+        std::mt19937_64 rng(m);
+        std::vector<kmer_t> kmers(m / 10);
+        for (size_t i = 0;i < kmers.size();i ++)
+        {
+            kmers[i] = rng();
+            sse.add(kmers[i]);
+            basic.add(kmers[i]);
+        }
+        bool found = true;
+        for (size_t i = 0;i < kmers.size();i ++) found &= sse.contains(kmers[i]);
+        int positives = 0;
+        for (int i = 0;i < 10000;i ++) positives += sse.contains(rng());
+        std::vector<uint8_t> a((m + 7) / 8), b((m + 7) / 8);
+        sse.read_bits(0, a.size(), &a[0]);
+        basic.read_bits(0, b.size(), &b[0]);
+        check(found && positives < 10000 * 2 * sse.expected_false_positive_probability(kmers.size()) + 20, info);
+        check(a == b && sse.count_set_bits() == basic.count_set_bits(), info);
+        
+        // and so either can be merged into the other
+        bloomfilter_sse<kmer_t,kmer_fmix_hash<> > merged(m, 4);
+        merged.merge(basic);
+        found = true;
+        for (size_t i = 0;i < kmers.size();i ++) found &= merged.contains(kmers[i]);
+        check(found, info);
+        sse.clear();
+        check(sse.count_set_bits() == 0 && !sse.contains(kmers[0]), info);
+    }
+    
+    void operator()()
+    {
+        section("sse filter");
+        check_layout(1000, "sse bits match bloomfilter_basic, odd m");
+        check_layout(1 << 16, "sse bits match bloomfilter_basic, power of two m");
+    }
+} test_sse;
+
+// fill ratio, cardinality estimate and live false positive rate
+class test_statistics_t : public unit_test 
+{
+    public:
+    template<typename T>
+    void check_statistics(const char * info)
+    {
+        const int n = 20000;
+        int m = bloomfilter<kmer_t>::determine_m(0.01, n);
+        int h = bloomfilter<kmer_t>::determine_h(m, n);
+        T bf(m, h);
+        check(bf.statistics().set_bits == 0, info);
+        std::mt19937_64 rng(1234);
+        for (int i = 0;i < n;i ++) bf.set(rng());
+        bloomfilter_statistics s = bf.statistics();
+        check(std::abs(s.estimated_cardinality - n) < n * 0.03, info);
+        check(std::abs(s.false_positive_probability - bf.expected_false_positive_probability(n)) < 0.002, info);
+        check(s.fill_ratio > 0.4 && s.fill_ratio < 0.6, info);
+        check(bf.statistics_async().get().set_bits == s.set_bits, info);
+    }
+
+    void operator()()
+    {
+        section("filter statistics");
+        check_statistics< bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > >("64 bit blocks statistics");
+        check_statistics< bloomfilter_basic<kmer_t,uint8_t,kmer_fmix_hash<> > >("8 bit blocks statistics");
+        check_statistics< bloomfilter_vectorbool<kmer_t,kmer_fmix_hash<> > >("vector<bool> statistics");
+        check_statistics< bloomfilter_perfectcheat<kmer_t> >("perfect cheat statistics");
+        check_statistics< bloomfilter_sse<kmer_t,kmer_fmix_hash<> > >("sse statistics");
+        
+        std::vector<uint8_t> bytes(1000);
+        std::mt19937 rng(99);
+        for (size_t i = 0;i < bytes.size();i ++) bytes[i] = rng();
+        check(popcount_bytes(&bytes[1], 997) == popcount_bytes_scalar(&bytes[1], 997), "vectorised popcount matches scalar");
+        // 123 words, so the tail after the groups of four is counted too
+        std::vector<uint64_t> words(123);
+        memcpy(&words[0], &bytes[0], words.size() * 8);
+        size_t expected = popcount_bytes(&words[0], words.size() * 8);
+        check(popcount_words_relaxed(&words[0], words.size()) == expected &&
+            popcount_words_relaxed_scalar(&words[0], words.size()) == expected &&
+            popcount_words_relaxed(&bytes[0], words.size() * 8) == expected, "relaxed word popcount matches popcount_bytes");
+    }  
+} test_statistics;
+
+class test_concurrent_t : public unit_test 
+{
+    public:
+    void operator()()
+    {
+        section("concurrent inserts");
+        typedef bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > filter_t;
+        const int n = 200000, threads = 4;
+        filter_t shared(1 << 21, 4), serial(1 << 21, 4);
+        std::vector<kmer_t> kmers(n);
+        std::mt19937_64 rng(5);
+        for (int i = 0;i < n;i ++) serial.add(kmers[i] = rng());
+        std::vector<std::thread> workers;
+        for (int t = 0;t < threads;t ++)
+        {
+            workers.push_back(std::thread([&shared, &kmers, t]()
+            {
+                for (int i = t;i < n;i += threads) shared.add_concurrent(kmers[i]);
+            }));
+        }
+        // counted while the threads are still inserting
+        std::future<bloomfilter_statistics> during = shared.statistics_async();
+        for (auto w = workers.begin();w != workers.end();w ++) w->join();
+        check(shared.count_set_bits() == serial.count_set_bits(), "no bits are lost between threads");
+        check(during.get().set_bits <= serial.count_set_bits() && shared.statistics_async().get().set_bits
+            == serial.count_set_bits(), "statistics_async alongside add_concurrent");
+    }
+} test_concurrent;
+
+class test_large_m_t : public unit_test 
+{
+    public:
+    void operator()()
+    {
+        section("filters of more than 2^32 bits");
+        typedef bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > filter_t;
+        // 1GB, mmapped, so only the pages that are written are faulted in
+        const size_t m = (1ULL << 33) + 64;
+        filter_t bf(m, 3);
+        std::mt19937_64 rng(33);
+        std::vector<kmer_t> kmers(1000);
+        for (size_t i = 0;i < kmers.size();i ++) bf.add(kmers[i] = rng());
+        bool found = true;
+        for (size_t i = 0;i < kmers.size();i ++) found &= bf.contains(kmers[i]);
+        check(bf.getm() == m && found, "every kmer is found");
+        
+        // about three quarters of the bits land past the 2^31 bits an int m allowed
+        std::vector<uint8_t> chunk(1 << 20);
+        size_t high = 0;
+        for (size_t first = 1 << 28;first < (m + 7) / 8;first += chunk.size())
+        {
+            size_t todo = std::min(chunk.size(), (m + 7) / 8 - first);
+            bf.read_bits(first, todo, &chunk[0]);
+            high += popcount_bytes(&chunk[0], todo);
+        }
+        check(high > kmers.size() * 3 / 2, "bits past 2^31 are used");
+    }
+} test_large_m;
+
+class test_fold_t : public unit_test 
+{
+    public:
+    template<typename T>
+    void check_fold(const char * info)
+    {
+        const int n = 5000;
+        const size_t m = bloomfilter<kmer_t>::determine_m_power_of_two(0.001, n);
+        const int h = 5;
+        T big(m, h), small(m / 4, h);
+        std::mt19937_64 rng(42);
+        std::vector<kmer_t> kmers(n);
+        for (int i = 0;i < n;i ++)
+        {
+            kmers[i] = rng();
+            big.set(kmers[i]);
+            small.set(kmers[i]);
+        }
+        big.fold(4);
+        check(big.getm() == m / 4, info);
+        
+        // folding gives exactly the filter we'd have got by inserting into m/4 bits
+        std::vector<uint8_t> folded(m / 32), direct(m / 32);
+        big.read_bits(0, folded.size(), &folded[0]);
+        small.read_bits(0, direct.size(), &direct[0]);
+        check(folded == direct, info);
+        check(big.count_set_bits() == small.count_set_bits(), info);
+        
+        bool found = true;
+        for (int i = 0;i < n;i ++) found &= big.test(kmers[i]);
+        check(found, info);
+        
+        int positives = 0;
+        const int trials = 100000;
+        for (int i = 0;i < trials;i ++) positives += big.test(rng());
+        check(std::abs(positives / (double)trials - big.expected_false_positive_probability(n)) < 0.01, info);
+    }
+
+    void operator()()
+    {
+        section("folding");
+        check_fold< bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > >("fold 64 bit blocks");
+        check_fold< bloomfilter_basic<kmer_t,uint8_t,kmer_fmix_hash<>,3> >("fold misaligned 8 bit blocks");
+        check_fold< bloomfilter_vectorbool<kmer_t,kmer_fmix_hash<> > >("fold vector<bool>");
+        check_fold< bloomfilter_sse<kmer_t,kmer_fmix_hash<> > >("fold sse");
+        
+        bloomfilter_basic<kmer_t,uint64_t> odd(1000, 3), pow2(1024, 3);
+        bool thrown = false;
+        try { odd.fold(2); } catch (std::runtime_error &) { thrown = true; }
+        check(thrown, "fold rejects m that isn't a power of two");
+        thrown = false;
+        try { pow2.fold(3); } catch (std::runtime_error &) { thrown = true; }
+        check(thrown, "fold rejects a factor that isn't a power of two");
+        thrown = false;
+        try { pow2.fold(32); } catch (std::runtime_error &) { thrown = true; }
+        check(thrown, "fold rejects folding below 64 bits");
+    }  
+} test_fold;
+
+// timing of the different ways of clearing a large filter that only has a few items in it
+class test_clear_speed_t : public unit_test 
+{
+public:
+    template<typename T>
+    void time_clear(const char * info, const storage_options & options)
+    {
+        const size_t m = 512 << 20;
+        const int repeat = 20;
+        T bf(m, 5, options);
+        std::cout << info << ": ";
+        {
+            scoped_timer t("\tclearing", repeat);
+            for (int i = 0;i < repeat;i ++)
+            {
+                for (kmer_t k = 0;k < 1000;k ++) bf.set(k);
+                bf.clear();
+            }
+        }
+        size_t set_bits = bf.count_set_bits();
+        std::cout << "\tset bits after clear " << set_bits << std::endl;
+        // info is padded to line up the timings
+        std::string label = std::string("no bits set after clear with ") + info;
+        label.erase(label.find_last_not_of(' ') + 1);
+        check(set_bits == 0, label.c_str());
+    }
+
+    void operator()()
+    {
+        section("clearing a 64MB filter 20 times");
+        typedef bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > filter_t;
+        storage_options options;
+        time_clear<filter_t>("streaming stores, 1 thread ", options);
+        options.clear_threads = 4;
+        time_clear<filter_t>("streaming stores, 4 threads", options);
+        options.clear_threads = 1;
+        options.track_dirty = true;
+        time_clear<filter_t>("dirty regions only         ", options);
+    }
+} test_clear_speed;
+
 // in-depth test
 class test_speed_t : public unit_test 
 {
@@ -54,6 +318,16 @@ public:
     // the number of hash functions
     int h;
 
+    // the number of kmers per test_batch call when sampling batch latency
+    static const int latency_batch = 16;
+
+    // write the tail latencies
+    void print_latency(const char * description, const latency_histogram & latencies)
+    {
+        std::cout << description << " p50 " << latencies.percentile(0.5) << "ns p99 " << latencies.percentile(0.99) 
+            << "ns p99.9 " << latencies.percentile(0.999) << "ns";
+    }
+
     // intensive test and timing
     template<typename T>
     void test_bloomfilter(const char * info)
@@ -91,6 +365,19 @@ public:
             if (false_negative) 
                 std::cout << terminal::red << "\nFalse negative rate: " << (false_negative / (double)n_count) << terminal::reset << std::endl;
         }
+
+        // sample the latency of each individual test
+        {
+            latency_histogram latencies;
+            size_t found = 0;
+            for (auto i = data.begin();i != data.end();i ++)
+            {
+                scoped_latency l(latencies);
+                if (bf.test(*i)) found ++;
+            }
+            print_latency("\tlatency", latencies);
+            if (found != data.size()) std::cout << terminal::red << " (false negatives)" << terminal::reset;
+        }
             
         // Test for false positives by additional random numbers ...
         int false_positive = 0;
@@ -113,6 +400,51 @@ public:
         
     }
 
+    // timing of the batch interface
+    template<typename T>
+    void test_bloomfilter_batch(const char * info)
+    {
+        std::cout << info << ": ";
+        T bf(m,h);
+        
+        std::minstd_rand0 rng (243345);
+        std::unordered_set<kmer_t> unique;
+        for (int i = 0;i < n_count;i ++)
+            unique.insert((kmer_t) rng());
+        std::vector<kmer_t> data(unique.begin(), unique.end());
+        std::unique_ptr<bool[]> results(new bool[data.size()]);
+        
+        {
+            scoped_timer t("\tfilling", n_count);
+            for (int i = 0;i < repeat;i ++)
+                bf.set_batch(&data[0], data.size());
+        }
+        
+        {
+            scoped_timer t("\ttesting", n_count);
+            int false_negative = 0;
+            for (int i = 0;i < repeat;i ++)
+            {
+                bf.test_batch(&data[0], data.size(), results.get());
+                false_negative += std::count(results.get(), results.get() + data.size(), false);
+            }
+            if (false_negative) 
+                std::cout << terminal::red << "\nFalse negative rate: " << (false_negative / (double)n_count) << terminal::reset << std::endl;
+        }
+
+        // sample the latency of each test_batch call
+        {
+            latency_histogram latencies;
+            for (size_t start = 0;start + latency_batch <= data.size();start += latency_batch)
+            {
+                scoped_latency l(latencies);
+                bf.test_batch(&data[start], latency_batch, results.get() + start);
+            }
+            print_latency("\tbatch of 16 latency", latencies);
+        }
+        std::cout << std::endl;
+    }
+
     void operator() ()
     {        
         double p = 0.01;
@@ -123,8 +455,7 @@ public:
             std::cout << "Determined m = " << m << ", h = " << h << " for desired p(false +ve) " << p << std::endl;
 
         #ifdef USESSE
-            bloomfilter_sse<kmer_t> bfsse_cpphash(m,h);
-            test_bloomfilter(&bfsse_cpphash, "sse C++ hash");
+            test_bloomfilter< bloomfilter_sse<kmer_t> >                               ("sse, std::hash                    ");
         #endif   
         
         #ifdef TIME_KMER_HASH
@@ -166,6 +497,11 @@ public:
             
            test_bloomfilter< bloomfilter_basic<kmer_t,uint8_t,std::hash<kmer_t> > >  ("8 bit blocks                      ");
 
+           test_bloomfilter< bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<>,0> >("64 bit blocks, fmix hash          ");
+           test_bloomfilter< bloomfilter_vectorbool<kmer_t,kmer_fmix_hash<> > >     ("vector<bool>, fmix hash           ");
+           test_bloomfilter_batch< bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<>,0> >("64 bit blocks, fmix hash, batch   ");
+           test_bloomfilter_batch< bloomfilter_basic<kmer_t,uint64_t,std::hash<kmer_t>,0> >("64 bit blocks, std::hash, batch   ");
+
             p*=10;
         }
     }
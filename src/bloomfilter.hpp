@@ -15,6 +15,41 @@
 #define __BLOOMFILTER_HPP
 #include <functional>
 #include <cmath>
+#include <stddef.h>
+#include <string.h>
+#include <future>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "filter_codec.hpp"
+
+/* A snapshot of how full a filter is - see bloomfilter::statistics() */
+struct bloomfilter_statistics
+{
+    /* the number of bits set */
+    size_t set_bits;
+    
+    /* set_bits / m */
+    double fill_ratio;
+    
+    /* Swamidass-Baldi estimate of the number of distinct items inserted */
+    double estimated_cardinality;
+    
+    /* the false positive probability given the current fill ratio, fill_ratio^h */
+    double false_positive_probability;
+};
+
+/* Applies a hash function to a whole array of values in place.  The filters' batch methods go through 
+   this so that hash functions with a vectorised kernel can specialise it (see kmer_hash.hpp) */
+template<typename index_t, typename Hash>
+struct batch_hash
+{
+    static void apply(const Hash & hashfunction, index_t * values, size_t count)
+    {
+        for (size_t i = 0;i < count;i ++)
+            values[i] = hashfunction(values[i]);
+    }
+};
 
 template<typename index_t>
 class bloomfilter
@@ -29,6 +64,135 @@ public:
     /* Return true if we think kmer is in the set (may return false positives) */
     virtual bool test(const index_t & kmer) const = 0;
     
+    /* Non-virtual equivalents of set and test.  Every implementation hides these with inline versions
+       (see bloomfilter_crtp below) so code templated on the concrete filter type, e.g. kmer_scan.hpp, gets 
+       the whole probe loop inlined, while code holding a bloomfilter<index_t> still works via the vtable */
+    void add(const index_t & kmer) { set(kmer); }
+    bool contains(const index_t & kmer) const { return test(kmer); }
+    
+    /* Add count kmers to the set - implementations may override this to hash several kmers at once */
+    virtual void set_batch(const index_t * kmers, size_t count)
+    {
+        for (size_t i = 0;i < count;i ++) set(kmers[i]);
+    }
+    
+    /* Sets results[i] to test(kmers[i]) for each of the count kmers */
+    virtual void test_batch(const index_t * kmers, size_t count, bool * results) const
+    {
+        for (size_t i = 0;i < count;i ++) results[i] = test(kmers[i]);
+    }
+    
+    /* Return the number of bits that are set in the filter */
+    virtual size_t count_set_bits() const = 0;
+    
+    /* Counts the set bits and derives the fill ratio, the estimated number of distinct items inserted 
+        n* = -(m/h) ln(1 - X/m)    where X is the number of set bits
+       and the live false positive probability (X/m)^h.  Compare the latter with the p passed to determine_m 
+       to find out if the filter has been over-filled */
+    bloomfilter_statistics statistics() const
+    {
+        return statistics_for(count_set_bits());
+    }
+    
+    /* statistics() on another thread.  Other threads may go on inserting meanwhile only with add_concurrent() 
+       (see bloomfilter_basic), since the count then reads the bits with the same relaxed atomic loads - any other 
+       writes during the count are a data race.  The result reflects some point during the count rather than one 
+       instant */
+    std::future<bloomfilter_statistics> statistics_async() const
+    {
+        return std::async(std::launch::async, [this]() { return statistics_for(count_set_bits_concurrent()); });
+    }
+    
+    /* count_set_bits() that is safe while other threads call add_concurrent().  Filters that have 
+       add_concurrent() override it to read the bits with relaxed atomic loads */
+    virtual size_t count_set_bits_concurrent() const { return count_set_bits(); }
+    
+    /* Swamidass-Baldi estimator: given X set bits out of m using h hash functions, the number of distinct 
+       items inserted is about -(m/h) ln(1 - X/m).  Infinite if every bit is set */
+    static double estimate_cardinality(double set_bits, double m, double h)
+    {
+        return -(m / h) * log(1 - set_bits / m);
+    }
+    
+    /* Copies bytes of the bit array, starting at byte first, to chunk.  Bit i of the filter is bit i%8 of 
+       byte i/8 whatever the implementation's block type.  Bytes beyond the end of the m bits read as zero */
+    virtual void read_bits(size_t first, size_t bytes, uint8_t * chunk) const = 0;
+    
+    /* ORs bytes of chunk into the bit array starting at byte first (the inverse of read_bits) */
+    virtual void or_bits(size_t first, size_t bytes, const uint8_t * chunk) = 0;
+    
+    /* ORs other into this filter a chunk at a time, so this becomes the union of the two.  m and h must match
+       (and the hash function should), throws std::runtime_error otherwise */
+    void merge(const bloomfilter & other)
+    {
+        if (other.m != m || other.h != h) throw std::runtime_error("Can't merge filters with a different m or h");
+        size_t bytes = (m + 7) / 8;
+        std::vector<uint8_t> chunk(std::min(FILTER_CODEC_CHUNK_BYTES, bytes));
+        for (size_t first = 0;first < bytes;first += chunk.size())
+        {
+            size_t todo = std::min(chunk.size(), bytes - first);
+            other.read_bits(first, todo, &chunk[0]);
+            or_bits(first, todo, &chunk[0]);
+        }
+    }
+    
+    /* Writes the filter to out, compressing each 64KB chunk of the bit array (see filter_codec.hpp) */
+    void serialize(std::ostream & out) const
+    {
+        filter_codec_header header;
+        header.m = m;
+        header.h = h;
+        header.chunk_bytes = FILTER_CODEC_CHUNK_BYTES;
+        header.chunk_count = filter_codec_chunk_count(m, FILTER_CODEC_CHUNK_BYTES);
+        write_codec_header(out, header);
+        
+        size_t bytes = (m + 7) / 8;
+        std::vector<uint8_t> chunk(FILTER_CODEC_CHUNK_BYTES);
+        std::vector<uint8_t> payload;
+        for (size_t first = 0;first < bytes;first += FILTER_CODEC_CHUNK_BYTES)
+        {
+            size_t todo = std::min(FILTER_CODEC_CHUNK_BYTES, bytes - first);
+            read_bits(first, todo, &chunk[0]);
+            chunk_codec codec = encode_chunk(&chunk[0], todo, payload);
+            write_chunk(out, codec, payload);
+        }
+    }
+    
+    /* Reads a filter written by serialize() and ORs it into this one, a chunk at a time, so the result is the 
+       union of the two.  m and h must match.  Throws std::runtime_error if the stream is invalid */
+    void merge_serialized(std::istream & in)
+    {
+        read_serialized(in, [this](size_t first, size_t bytes, const uint8_t * chunk) { or_bits(first, bytes, chunk); });
+    }
+    
+    /* Shrinks the filter to m/factor bits without re-inserting anything.  Bit i moves to bit i % (m/factor) - 
+       because m is a power of two that is where the insert would have put it had the filter been created with 
+       m/factor bits, so the result is exactly that filter and tests find everything that was added.  The false 
+       positive probability rises accordingly, see expected_false_positive_probability().  m and factor must be 
+       powers of two and m/factor at least 64.  Throws std::runtime_error otherwise.  The memory isn't given 
+       back, but serialize() only writes the m/factor bits */
+    void fold(unsigned int factor)
+    {
+        if (!is_power_of_two(m) || !is_power_of_two(factor) || m / factor < 64)
+            throw std::runtime_error("fold needs m and factor to be powers of two and m/factor to be at least 64");
+        if (factor == 1) return;
+        fold_bits(m / factor);
+        m /= factor;
+    }
+    
+    /* Replaces the contents of this filter with a filter written by serialize().  The whole stream is decoded
+       before the filter is touched, so if it throws the contents are unchanged */
+    void deserialize(std::istream & in)
+    {
+        std::vector<uint8_t> bits((m + 7) / 8);
+        read_serialized(in, [&bits](size_t first, size_t bytes, const uint8_t * chunk)
+        {
+            memcpy(&bits[first], chunk, bytes);
+        });
+        clear();
+        if (!bits.empty()) or_bits(0, bits.size(), &bits[0]);
+    }
+    
     /* Destructor */
     virtual ~bloomfilter() {};   
     
@@ -53,17 +217,85 @@ public:
         return std::ceil(m / n * log(2));
     }
     
-    int getm() { return m; }
-    int geth() { return h; }
+    /* determine_m rounded up to a power of two, so the filter can later be fold()ed */
+    static size_t determine_m_power_of_two(double p, double n)
+    {
+        size_t m = 64;
+        while (m < determine_m(p, n)) m *= 2;
+        return m;
+    }
+    
+    static bool is_power_of_two(size_t value)
+    {
+        return value && !(value & (value - 1));
+    }
+    
+    size_t getm() const { return m; }
+    int geth() const { return h; }
 protected:
     /* Constructor - m is the filter array size in bits, h is the number of hash functions */
-    bloomfilter(int m, int h = 0) : m(m), h(h) {};
+    bloomfilter(size_t m, int h = 0) : m(m), h(h) {};
+    
+    /* the fill ratio, estimated cardinality and live false positive probability for the given set bits */
+    bloomfilter_statistics statistics_for(size_t set_bits) const
+    {
+        bloomfilter_statistics s;
+        s.set_bits = set_bits;
+        s.fill_ratio = s.set_bits / (double)m;
+        s.estimated_cardinality = estimate_cardinality(s.set_bits, m, h);
+        s.false_positive_probability = pow(s.fill_ratio, h);
+        return s;
+    }
+    
+    /* ORs bit i into bit i % folded_m for every i >= folded_m and clears the bits from folded_m up, for fold() */
+    virtual void fold_bits(size_t folded_m) = 0;
+    
+    /* reads a filter written by serialize(), checking m and h, and calls chunk_read(first, bytes, chunk) with each
+       decoded chunk of the bit array.  Throws std::runtime_error if the stream is invalid */
+    template<typename chunk_read_t>
+    void read_serialized(std::istream & in, chunk_read_t chunk_read) const
+    {
+        filter_codec_header header = read_codec_header(in);
+        if (header.m != (uint64_t)m || header.h != (uint32_t)h) 
+            throw std::runtime_error("Serialized filter has a different m or h");
+        
+        size_t bytes = (m + 7) / 8;
+        std::vector<uint8_t> chunk(header.chunk_bytes);
+        std::vector<uint8_t> payload;
+        for (size_t first = 0;first < bytes;first += header.chunk_bytes)
+        {
+            size_t todo = std::min((size_t)header.chunk_bytes, bytes - first);
+            chunk_codec codec = read_chunk(in, payload);
+            std::fill(chunk.begin(), chunk.begin() + todo, 0);
+            decode_chunk_or(codec, payload.empty() ? 0 : &payload[0], payload.size(), &chunk[0], todo);
+            chunk_read(first, todo, (const uint8_t *)&chunk[0]);
+        }
+    }
     
     /* the number of bits */
-    int m;
+    size_t m;
     
     /* the number of hash functions */
     int h;
 };
 
+/* Static interface: implementations derive from bloomfilter_crtp<themselves, index_t> and provide non-virtual 
+   inline add() and contains(), and this implements the virtual set() and test() by forwarding to them */
+template<typename derived_t, typename index_t>
+class bloomfilter_crtp : public bloomfilter<index_t>
+{
+public:
+    void set(const index_t & kmer) final
+    {
+        static_cast<derived_t *>(this)->add(kmer);
+    }
+    
+    bool test(const index_t & kmer) const final
+    {
+        return static_cast<const derived_t *>(this)->contains(kmer);
+    }
+protected:
+    bloomfilter_crtp(size_t m, int h) : bloomfilter<index_t>(m,h) {};
+};
+
 #endif
\ No newline at end of file
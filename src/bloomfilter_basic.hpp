@@ -10,47 +10,57 @@
     byte_misalignment allows the data structure to be (mis)aligned e.g. 3 means the address of the block array
     will end in a 3h or Bh 
 
+    The bit array comes from filter_storage, by default 64 byte aligned (before any mis-alignment) and already
+    zeroed.  Pass storage_options to use huge pages, prefault the pages in parallel or share an arena, and to
+    make clear() parallel or only zero the regions that have been written to
+
     See BloomFilter.hpp for explanation of the methods
 */
 #ifndef __bloomfilter_basic_HPP
 #define __bloomfilter_basic_HPP
 #include "bloomfilter.hpp"
+#include "popcount.hpp"
+#include "filter_storage.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
 
 template<typename index_t, typename block_t, typename Hash = std::hash<index_t>, unsigned int byte_misalignment = 0>
-class bloomfilter_basic : public bloomfilter<index_t>
+class bloomfilter_basic : public bloomfilter_crtp<bloomfilter_basic<index_t,block_t,Hash,byte_misalignment>, index_t>
 {
 protected:
-    block_t * bitarray;   
-    uint8_t * storage;
+    static const unsigned int max_byte_alignment = 8;
+
+    /* round up so that if we for example have m=9 and sizeof(block_t)=8 then we get 2 elements in the array
+       (9+1*8-1)/(1*8) = 16/8 = 2 */
+    static size_t blocks_for(size_t m)
+    {
+        return (m+sizeof(block_t)*8-1)/(sizeof(block_t)*8);
+    }
+
     size_t blockcount;
+    /* blockcount blocks plus room to (mis)align */
+    filter_storage storage;
+    block_t * bitarray;   
 public:     
 
-    bloomfilter_basic(int m, int h) : bloomfilter<index_t>(m,h)
+    bloomfilter_basic(size_t m, int h, const storage_options & options = storage_options()) 
+        : bloomfilter_crtp<bloomfilter_basic, index_t>(m,h),
+        blockcount(blocks_for(m)),
+        storage(blockcount * sizeof(block_t) + max_byte_alignment, options)
     {
-        const unsigned int max_byte_alignment = 8;
-        if (byte_misalignment > max_byte_alignment) throw std::runtime_error("max_byte_alignment exceeded");
+        static_assert(byte_misalignment <= max_byte_alignment, "max_byte_alignment exceeded");
         
-        // round up so that if we for example have m=9 and sizeof(block_t)=8 then we get 2 elements in the array
-        // (9+1*8-1)/(1*8) = 16/8 = 2
-        // also add max_byte_alignment * 2 so that we can 1/ align to max_byte_alignment and then 2/ mis-align
-        blockcount = (m+sizeof(block_t)*8-1+max_byte_alignment*2)/(sizeof(block_t)*8);
-        storage = (uint8_t*)malloc(blockcount * sizeof(block_t));
-        
-        // first offset to get to max_byte_alignment always as a starting point
-        size_t offset = max_byte_alignment - ((size_t)storage) & (max_byte_alignment-1);
-        
-        // then apply our (mis)alignment
-        offset += byte_misalignment;
-        
-        bitarray = (block_t*)(storage+offset);
-        clear();
+        // storage is aligned to options.alignment (64 bytes by default) so this gives exactly the (mis)alignment asked for
+        bitarray = (block_t*)(storage.data() + byte_misalignment);
     };
 
-    virtual void set(const index_t & kmer)
+    inline void add(const index_t & kmer)
     {
         const size_t BitsPerElement = sizeof(block_t) * 8;
         static Hash hashfunction;
         index_t hashvalue = kmer;
+        const bool track_dirty = storage.tracks_dirty();
         for (int hcount = this->h; hcount > 0; hcount--)
         {
             hashvalue = hashfunction(hashvalue);
@@ -59,10 +69,31 @@ public:
             size_t offset = bitindex / BitsPerElement;
             block_t mask = ( ((block_t)1) << (bitindex & (BitsPerElement-1)));
             bitarray[offset] |= mask;
+            if (track_dirty) storage.set_dirty(byte_misalignment + offset * sizeof(block_t));
         }
     }
 
-    virtual bool test(const index_t & kmer) const
+    /* add() that is safe to call from several threads at once on the same filter.  Bits already set are left
+       alone, so once the filter fills up most probes are plain reads rather than locked read-modify-writes */
+    inline void add_concurrent(const index_t & kmer)
+    {
+        const size_t BitsPerElement = sizeof(block_t) * 8;
+        static Hash hashfunction;
+        index_t hashvalue = kmer;
+        const bool track_dirty = storage.tracks_dirty();
+        for (int hcount = this->h; hcount > 0; hcount--)
+        {
+            hashvalue = hashfunction(hashvalue);
+            size_t bitindex = hashvalue % this->m;
+            size_t offset = bitindex / BitsPerElement;
+            block_t mask = ( ((block_t)1) << (bitindex & (BitsPerElement-1)));
+            if (__atomic_load_n(&bitarray[offset], __ATOMIC_RELAXED) & mask) continue;
+            __atomic_fetch_or(&bitarray[offset], mask, __ATOMIC_RELAXED);
+            if (track_dirty) storage.set_dirty(byte_misalignment + offset * sizeof(block_t));
+        }
+    }
+
+    inline bool contains(const index_t & kmer) const
     {
         const size_t BitsPerElement = sizeof(block_t) * 8;
         static Hash hashfunction;
@@ -79,14 +110,94 @@ public:
         return true;
     }
     
+    /* hashes batch_size kmers at a time so that batch_hash can vectorise across them */
+    static const size_t batch_size = 16;
+
+    virtual void set_batch(const index_t * kmers, size_t count)
+    {
+        const size_t BitsPerElement = sizeof(block_t) * 8;
+        static Hash hashfunction;
+        index_t hashvalues[batch_size];
+        const bool track_dirty = storage.tracks_dirty();
+        for (size_t start = 0;start < count;start += batch_size)
+        {
+            size_t todo = std::min(batch_size, count - start);
+            std::copy(kmers + start, kmers + start + todo, hashvalues);
+            for (int hcount = this->h; hcount > 0; hcount--)
+            {
+                batch_hash<index_t,Hash>::apply(hashfunction, hashvalues, todo);
+                for (size_t i = 0;i < todo;i ++)
+                {
+                    size_t bitindex = hashvalues[i] % this->m;
+                    size_t offset = bitindex / BitsPerElement;
+                    bitarray[offset] |= ( ((block_t)1) << (bitindex & (BitsPerElement-1)));
+                    if (track_dirty) storage.set_dirty(byte_misalignment + offset * sizeof(block_t));
+                }
+            }
+        }
+    }
+
+    virtual void test_batch(const index_t * kmers, size_t count, bool * results) const
+    {
+        const size_t BitsPerElement = sizeof(block_t) * 8;
+        static Hash hashfunction;
+        index_t hashvalues[batch_size];
+        for (size_t start = 0;start < count;start += batch_size)
+        {
+            size_t todo = std::min(batch_size, count - start);
+            std::copy(kmers + start, kmers + start + todo, hashvalues);
+            std::fill(results + start, results + start + todo, true);
+            for (int hcount = this->h; hcount > 0; hcount--)
+            {
+                batch_hash<index_t,Hash>::apply(hashfunction, hashvalues, todo);
+                for (size_t i = 0;i < todo;i ++)
+                {
+                    size_t bitindex = hashvalues[i] % this->m;
+                    block_t mask = ( ((block_t)1) << (bitindex & (BitsPerElement-1)));
+                    results[start+i] &= (bitarray[bitindex / BitsPerElement] & mask) != 0;
+                }
+            }
+        }
+    }
+    
+    /* zeroes the storage - see storage_options clear_threads and track_dirty for faster ways */
     void clear()
     {
-        memset(bitarray, 0, blockcount*sizeof(block_t));
+        storage.clear();
+    }
+    
+    virtual void read_bits(size_t first, size_t bytes, uint8_t * chunk) const
+    {
+        // blocks are stored little endian so the bytes are already in the right order
+        memcpy(chunk, (const uint8_t*)bitarray + first, bytes);
+    }
+    
+    virtual void or_bits(size_t first, size_t bytes, const uint8_t * chunk)
+    {
+        uint8_t * target = (uint8_t*)bitarray + first;
+        for (size_t i = 0;i < bytes;i ++) target[i] |= chunk[i];
+        storage.mark_dirty(byte_misalignment + first, bytes);
+    }
+    
+    virtual size_t count_set_bits() const
+    {
+        // bits beyond m are never set so we can count the whole array
+        return popcount_bytes(bitarray, blockcount*sizeof(block_t));
     }
 
-    virtual ~bloomfilter_basic()
+    /* a relaxed atomic load of each block, the same accesses add_concurrent() makes */
+    virtual size_t count_set_bits_concurrent() const
+    {
+        return popcount_words_relaxed(bitarray, blockcount);
+    }
+protected:
+    virtual void fold_bits(size_t folded_m)
     {
-        free(storage);
+        // m is a power of two of at least 64 bits so both sizes are whole blocks
+        size_t folded_blocks = blocks_for(folded_m);
+        filter_storage::fold_memory((uint8_t*)bitarray, blockcount*sizeof(block_t), folded_blocks*sizeof(block_t));
+        storage.mark_dirty(byte_misalignment, folded_blocks*sizeof(block_t));
+        blockcount = folded_blocks;
     }
 };
 
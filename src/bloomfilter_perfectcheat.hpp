@@ -7,24 +7,25 @@
 #define __BLOOMFILTER_PERFECTCHEAT_HPP
 #include "bloomfilter.hpp"
 #include <unordered_set>
+#include <stdexcept>
 
 template<typename index_t, typename Hash = std::hash<index_t> >
-class bloomfilter_perfectcheat : public bloomfilter<index_t>
+class bloomfilter_perfectcheat : public bloomfilter_crtp<bloomfilter_perfectcheat<index_t,Hash>, index_t>
 {
 protected:
     std::unordered_set<index_t> storage;
 public:     
 
-    bloomfilter_perfectcheat(int m, int h) : bloomfilter<index_t>(m,h)
+    bloomfilter_perfectcheat(size_t m, int h) : bloomfilter_crtp<bloomfilter_perfectcheat, index_t>(m,h)
     {
     };
 
-    void set(const index_t & kmer)
+    inline void add(const index_t & kmer)
     {
         storage.insert(kmer);
     }
 
-    bool test(const index_t & kmer) const
+    inline bool contains(const index_t & kmer) const
     {
         return storage.count(kmer) > 0;
     }
@@ -34,6 +35,29 @@ public:
         storage.clear();
     }
 
+    /* there is no bit array to serialize */
+    void read_bits(size_t first, size_t bytes, uint8_t * chunk) const
+    {
+        throw std::runtime_error("bloomfilter_perfectcheat has no bit array");
+    }
+    
+    void or_bits(size_t first, size_t bytes, const uint8_t * chunk)
+    {
+        throw std::runtime_error("bloomfilter_perfectcheat has no bit array");
+    }
+
+    /* nothing to fold - only m changes, which lowers count_set_bits() as for a real filter */
+    void fold_bits(size_t folded_m)
+    {
+    }
+
+    /* there is no bit array, so report the number of bits a real filter would be expected to have set
+       m(1 - exp(-hn/m)) - which makes statistics().estimated_cardinality come out as the exact count */
+    size_t count_set_bits() const
+    {
+        return (size_t)std::round(this->m * (1 - exp(-this->h * (double)storage.size() / this->m)));
+    }
+
 };
 
 #endif
\ No newline at end of file
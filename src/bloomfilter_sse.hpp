@@ -1,97 +1,122 @@
 /*
     An experiment coding the bloom filter using SSE instructions (128 bit blocks)
-    
+
+    Bit i of a block is bit i%8 of its byte i/8, the same little endian layout as bloomfilter_basic, so
+    read_bits() is a plain copy and the filters can be merged with and serialized to each other.  The storage
+    comes from filter_storage as for bloomfilter_basic - see there for storage_options.
+
     See BloomFilter.hpp for explanation of the arguments/methods
 */
 #ifndef __BLOOMFILTER_SSE_HPP
 #define __BLOOMFILTER_SSE_HPP
 #include "bloomfilter.hpp"
-#include <xmmintrin.h>
-#include <stdlib.h>
-#include <iostream>
+#include "popcount.hpp"
+#include "filter_storage.hpp"
+#include <emmintrin.h>
+#include <cstring>
 
 template<typename index_t, typename Hash = std::hash<index_t> >
-class bloomfilter_sse : public bloomfilter<index_t>
+class bloomfilter_sse : public bloomfilter_crtp<bloomfilter_sse<index_t,Hash>, index_t>
 {
 protected:
-    typedef __m128 block_t;
+    typedef __m128i block_t;
+    static const size_t BitsPerElement = sizeof(block_t) * 8;
+
+    /* round up so that if we for example have m=9 then we get 1 block (9+128-1)/128 = 1 */
+    static size_t blocks_for(size_t m)
+    {
+        return (m + BitsPerElement - 1) / BitsPerElement;
+    }
+
+    size_t blockcount;
+    filter_storage storage;
     /* m bits of storage */
     block_t * bitarray;
-    size_t blockcount;
-    uint8_t * storage;
-    __m128 * masks;
-public:     
+    /* the precalculated bit masks: masks[i] has only bit i of the block set */
+    block_t masks[BitsPerElement];
+public:
 
-    bloomfilter_sse(int m, int h) : bloomfilter<index_t>(m,h)
+    bloomfilter_sse(size_t m, int h, const storage_options & options = storage_options())
+        : bloomfilter_crtp<bloomfilter_sse, index_t>(m,h),
+        blockcount(blocks_for(m)),
+        storage(blockcount * sizeof(block_t), options)
     {
-        const size_t BitsPerElement = sizeof(block_t) * 8;
-
-        // round up so that if we for example have m=9 and sizeof(block_t)=8 then we get 2 elements in the array
-        // (9+1*8-1)/8 = 16/8 = 2
-        size_t bits = (m+sizeof(block_t)*8-1);
-        blockcount = bits / 128;
-        
-        // we also at the same time allocate the space for the precalculated bit masks
-        size_t bytes = 128 * sizeof(block_t) + blockcount * sizeof(block_t);
-        storage = (uint8_t*)malloc(bytes);
-        
-        // advance the pointer in order to get 16 byte alignment (couldn't find aligned malloc etc on this mac)
-        masks = (__m128*)(storage + (((size_t)storage) & 15)); 
-        bitarray = masks + 128;
+        // filter_storage is at least 16 byte aligned and zeroed
+        bitarray = (block_t*)storage.data();
 
         // precalculate the bit masks
-        __m128 __attribute__ ((aligned (16))) one = _mm_set_epi64x(1, 0);
-        for (int i = 0;i < 128;i ++)
+        for (size_t i = 0;i < BitsPerElement;i ++)
         {
-            masks[i] = one;
-            one = _mm_slli_si128(one, 1);
+            uint8_t bytes[sizeof(block_t)] = { 0 };
+            bytes[i / 8] = 1 << (i % 8);
+            masks[i] = _mm_loadu_si128((const block_t*)bytes);
         }
     };
 
-    void set(const index_t & kmer)
+    inline void add(const index_t & kmer)
     {
-        const size_t BitsPerElement = sizeof(block_t) * 8;
-        const Hash hashfunction = Hash();
-        kmer_t hashvalue = kmer;
+        static Hash hashfunction;
+        index_t hashvalue = kmer;
+        const bool track_dirty = storage.tracks_dirty();
         for (int hcount = this->h; hcount > 0; hcount--)
         {
             hashvalue = hashfunction(hashvalue);
+            size_t bitindex = hashvalue % this->m;
             // we expect the compiler to automatically turn this into a shift because it's a const power of two
-            size_t offset = (hashvalue % this->m) / BitsPerElement;
-            size_t maskindex = hashvalue & (BitsPerElement-1);
-            bitarray[offset] = _mm_or_ps(bitarray[offset], masks[maskindex]);
+            size_t offset = bitindex / BitsPerElement;
+            bitarray[offset] = _mm_or_si128(bitarray[offset], masks[bitindex & (BitsPerElement-1)]);
+            if (track_dirty) storage.set_dirty(offset * sizeof(block_t));
         }
     }
 
-    bool test(const index_t & kmer) const
+    inline bool contains(const index_t & kmer) const
     {
-        __m128 __attribute__ ((aligned (16))) zero = _mm_setzero_si128();
-        const size_t BitsPerElement = sizeof(block_t) * 8;
-        const Hash hashfunction = Hash();
-        kmer_t hashvalue = kmer;
+        const block_t zero = _mm_setzero_si128();
+        static Hash hashfunction;
+        index_t hashvalue = kmer;
         for (int hcount = this->h; hcount > 0; hcount--)
         {
             hashvalue = hashfunction(hashvalue);
-            // we expect the compiler to automatically turn this into a shift because it's a const power of two
-            size_t offset = (hashvalue % this->m) / BitsPerElement;
-            if (_mm_movemask_epi8(
-                _mm_cmpeq_epi32(
-                _mm_and_ps(bitarray[offset],masks[hashvalue & (BitsPerElement-1)]),zero)) != 0xFFFF) return false;
+            size_t bitindex = hashvalue % this->m;
+            size_t offset = bitindex / BitsPerElement;
+            // every byte of block & mask zero means the bit isn't set
+            block_t bit = _mm_and_si128(bitarray[offset], masks[bitindex & (BitsPerElement-1)]);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(bit, zero)) == 0xFFFF) return false;
         }
         return true;
     }
 
+    /* zeroes the storage - see storage_options clear_threads and track_dirty for faster ways */
     void clear()
     {
-        memset(bitarray, 0, this->blockcount * sizeof(block_t));
+        storage.clear();
     }
 
-    virtual ~bloomfilter_sse()
+    void read_bits(size_t first, size_t bytes, uint8_t * chunk) const
+    {
+        memcpy(chunk, (const uint8_t*)bitarray + first, bytes);
+    }
+
+    void or_bits(size_t first, size_t bytes, const uint8_t * chunk)
+    {
+        uint8_t * target = (uint8_t*)bitarray + first;
+        for (size_t i = 0;i < bytes;i ++) target[i] |= chunk[i];
+        storage.mark_dirty(first, bytes);
+    }
+
+    size_t count_set_bits() const
+    {
+        // bits beyond m are never set so we can count the whole array
+        return popcount_bytes(bitarray, blockcount * sizeof(block_t));
+    }
+protected:
+    void fold_bits(size_t folded_m)
     {
-        std::cout << "freeing ... ";
-        free(storage);
-        std::cout << "... done" << std::endl;
+        // folded_m is a power of two of at least 64 bits, so whole bytes but maybe half a block
+        filter_storage::fold_memory((uint8_t*)bitarray, blockcount * sizeof(block_t), folded_m / 8);
+        storage.mark_dirty(0, folded_m / 8);
+        blockcount = blocks_for(folded_m);
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -9,20 +9,21 @@
 #define __BLOOMFILTER_BITSET_HPP
 #include "bloomfilter.hpp"
 #include <vector>
+#include <algorithm>
 
 template<typename index_t, typename Hash = std::hash<index_t> >
-class bloomfilter_vectorbool : public bloomfilter<index_t>
+class bloomfilter_vectorbool : public bloomfilter_crtp<bloomfilter_vectorbool<index_t,Hash>, index_t>
 {
 protected:
     /* m bits of storage */
     std::vector<bool> bitarray;
 public:     
 
-    bloomfilter_vectorbool(int m, int h) : bloomfilter<index_t>(m,h), bitarray(m,false)
+    bloomfilter_vectorbool(size_t m, int h) : bloomfilter_crtp<bloomfilter_vectorbool, index_t>(m,h), bitarray(m,false)
     {
     };
 
-    void set(const index_t & kmer)
+    inline void add(const index_t & kmer)
     {
         Hash hashfunction = Hash();
         index_t hashvalue = kmer;
@@ -34,7 +35,7 @@ public:
         }
     }
 
-    bool test(const index_t & kmer) const
+    inline bool contains(const index_t & kmer) const
     {
         Hash hashfunction = Hash();
         index_t hashvalue = kmer;
@@ -48,7 +49,40 @@ public:
     
     void clear()
     {
-        bitarray.assign(this->m,false);
+        // fill rather than assign, which would reallocate
+        std::fill(bitarray.begin(), bitarray.end(), false);
+    }
+
+    void read_bits(size_t first, size_t bytes, uint8_t * chunk) const
+    {
+        for (size_t i = 0;i < bytes;i ++)
+        {
+            uint8_t byte = 0;
+            for (size_t bit = 0, index = (first + i) * 8;bit < 8 && index < bitarray.size();bit ++, index ++)
+                if (bitarray[index]) byte |= 1 << bit;
+            chunk[i] = byte;
+        }
+    }
+    
+    void or_bits(size_t first, size_t bytes, const uint8_t * chunk)
+    {
+        for (size_t i = 0;i < bytes;i ++)
+        {
+            for (size_t bit = 0, index = (first + i) * 8;bit < 8 && index < bitarray.size();bit ++, index ++)
+                if ((chunk[i] >> bit) & 1) bitarray[index] = true;
+        }
+    }
+
+    size_t count_set_bits() const
+    {
+        return std::count(bitarray.begin(), bitarray.end(), true);
+    }
+protected:
+    void fold_bits(size_t folded_m)
+    {
+        for (size_t i = folded_m;i < bitarray.size();i ++)
+            if (bitarray[i]) bitarray[i % folded_m] = true;
+        bitarray.resize(folded_m);
     }
 
 };
@@ -0,0 +1,45 @@
+#include "unit_test.hpp"
+#include "bounded_queue.hpp"
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+class test_bounded_queue_t : public unit_test
+{
+    void operator() ()
+    {
+        section("bounded queue");
+        bounded_queue<int> queue(3);
+        const int count = 10000;
+        std::thread producer([&queue]()
+        {
+            for (int i = 0;i < count;i ++) queue.push(i);
+            queue.close();
+        });
+        // two consumers, each item must arrive exactly once and in order per consumer
+        std::vector<int> seen(count, 0);
+        bool ordered[2] = { true, true };
+        std::vector<std::thread> consumers;
+        for (int c = 0;c < 2;c ++)
+        {
+            consumers.push_back(std::thread([&queue, &seen, &ordered, c]()
+            {
+                int item, last = -1;
+                while (queue.pop(item))
+                {
+                    seen[item] ++;
+                    ordered[c] &= item > last;
+                    last = item;
+                }
+            }));
+        }
+        producer.join();
+        for (auto t = consumers.begin();t != consumers.end();t ++) t->join();
+        check(std::count(seen.begin(), seen.end(), 1) == count, "every item is popped exactly once");
+        check(ordered[0] && ordered[1], "items come out in the order they went in");
+
+        int item;
+        check(!queue.pop(item), "pop on a closed, empty queue returns false");
+        check(!queue.push(1), "push on a closed queue returns false");
+    }
+} test_bounded_queue;
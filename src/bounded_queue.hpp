@@ -0,0 +1,61 @@
+/*
+    A fixed capacity queue for passing work between the stages of a multi-threaded pipeline
+
+    push() blocks while the queue is full, so a fast producer can't get more than capacity items ahead of its
+    consumers and memory stays bounded however big the input.  The producer calls close() when it's done;
+    pop() then drains what's left and returns false once the queue is empty.
+*/
+#ifndef __BOUNDED_QUEUE_HPP
+#define __BOUNDED_QUEUE_HPP
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stddef.h>
+
+template<typename T>
+class bounded_queue
+{
+private:
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex lock;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+public:
+    bounded_queue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    /* adds item, waiting for space.  Returns false (and drops item) if the queue has been closed */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        not_full.wait(guard, [this]() { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /* takes the oldest item into item, waiting for one.  Returns false once the queue is closed and empty */
+    bool pop(T & item)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        not_empty.wait(guard, [this]() { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    /* no more items will be pushed - wakes everyone waiting */
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+};
+
+#endif
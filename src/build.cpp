@@ -0,0 +1,321 @@
+/*
+    bloom-build: builds a kmer filter file from FASTA input for bloom-classify
+
+        bloom-build [options] -o filter input.fa [input.fa ...]
+
+    The filter is sized from a target false positive rate (--fpp), a memory budget in bytes (--memory, which
+    takes K, M and G suffixes), or both - in which case the budget caps the size and a warning is printed if
+    that means missing the target.  Either way the number of distinct kmers n is needed, to pick m and/or h
+    with bloomfilter::determine_m and determine_h.  Give it with --expected if known, otherwise a first pass
+    over the input counts it with a HyperLogLog sketch - which is what stops a guessed n from either running
+    out of memory or quietly blowing up the false positive rate.  h is capped at BUILD_MAX_H, as past that
+    each extra probe costs more than the false positives it saves, so a budget beyond the m whose best h is
+    BUILD_MAX_H (about 29 bits a kmer) is trimmed to it, with a warning.
+
+    Input can be FASTA, FASTQ or UCSC .2bit.  The kmers covering an N (or any other base but ACGT - soft-masked
+    lowercase bases count) or a .2bit N block are skipped, and for FASTQ so are those covering a base below
+    --min-quality (phred, default 0), so sequencing errors don't fill the filter.
+
+    Both passes run as a pipeline: one thread parses the FASTA into batches and --threads workers hash the
+    kmers, into a sketch each for the count and into the shared filter with add_concurrent() for the build.
+    An uncompressed FASTA file of more than a couple of chunks is mapped instead and split into byte ranges
+    that the workers parse themselves (see fasta_chunks.hpp), so one chromosome-sized record scales too.
+    k can be up to 128; both passes are compiled for each k (see kmer_dispatch.hpp).
+*/
+#include "filter_file.hpp"
+#include "kmer_dispatch.hpp"
+#include "sequence_batches.hpp"
+#include "fasta_chunks.hpp"
+#include "twobit.hpp"
+#include "hyperloglog.hpp"
+#include "kmer_scan.hpp"
+#include "terminal.hpp"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+/* the most hash functions a filter gets - each one more costs a probe on every insert and query */
+const int BUILD_MAX_H = 20;
+
+static void usage(const char * program)
+{
+    std::cerr << "Usage: " << program << " [-k length] [--fpp p] [--memory bytes[K|M|G]] [--expected n] [--threads n]"
+        << " [--min-quality q] -o filter input.fa [input.fa ...]" << std::endl;
+}
+
+/* parses e.g. 512M into bytes, 0 if it isn't a size */
+static uint64_t parse_bytes(const char * text)
+{
+    char * end;
+    double value = strtod(text, &end);
+    uint64_t multiplier = 1;
+    if (*end == 'K' || *end == 'k') multiplier = 1ULL << 10;
+    else if (*end == 'M' || *end == 'm') multiplier = 1ULL << 20;
+    else if (*end == 'G' || *end == 'g') multiplier = 1ULL << 30;
+    else if (*end) return 0;
+    return value > 0 ? (uint64_t)(value * multiplier) : 0;
+}
+
+/* parses the inputs on one thread and calls work(worker, batch) for each batch on threads workers.  Rethrows
+   the first exception from the reader or work once every thread has stopped */
+template<typename work_t>
+static void for_each_batch(const std::vector<std::string> & inputs, unsigned int threads, work_t work)
+{
+    bounded_queue<sequence_batch> queue(2 * threads);
+    std::exception_ptr error, worker_error;
+    std::mutex worker_error_lock;
+    std::thread reader([&]()
+    {
+        try { read_sequence_batches(inputs, queue); }
+        catch (...) { error = std::current_exception(); }
+    });
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0;t < threads;t ++)
+    {
+        workers.push_back(std::thread([&, t]()
+        {
+            try
+            {
+                sequence_batch batch;
+                while (queue.pop(batch)) work(t, batch);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(worker_error_lock);
+                if (!worker_error) worker_error = std::current_exception();
+                // the reader's pushes fail from now on, and the other workers drain what's queued
+                queue.close();
+            }
+        }));
+    }
+    reader.join();
+    for (auto w = workers.begin();w != workers.end();w ++) w->join();
+    if (error) std::rethrow_exception(error);
+    if (worker_error) std::rethrow_exception(worker_error);
+}
+
+/* whether input is an uncompressed FASTA file big enough to be worth splitting between the workers */
+static bool chunkable_fasta(const std::string & input)
+{
+    struct stat info;
+    if (input == "-" || stat(input.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) return false;
+    if ((uint64_t)info.st_size < 2 * FASTA_CHUNK_BYTES) return false;
+    std::ifstream in(input.c_str(), std::ios::binary);
+    return in.get() == '>';
+}
+
+/* calls work(worker, sequence, length, quality) for every sequence of the inputs on threads workers, with a
+   null quality for FASTA.  The big FASTA files are parsed a chunk per worker and .2bit files a record per
+   worker, both giving the sequence in segments overlapping by k - 1 bases (a .2bit record's runs between Ns
+   separately), and the rest go through for_each_batch().  FASTA comes as it is, Ns and lowercase included,
+   for work to mask (see mask_read()) */
+template<typename work_t>
+static void for_each_sequence(const std::vector<std::string> & inputs, unsigned int threads, int k, work_t work)
+{
+    std::vector<std::string> batched;
+    for (auto input = inputs.begin();input != inputs.end();input ++)
+    {
+        if (*input != "-" && is_twobit_file(*input))
+        {
+            twobit_reader reader(*input);
+            std::vector<std::string> segments(threads);
+            parse_twobit_records(reader, threads, [&](unsigned int worker, const twobit_sequence & sequence)
+            {
+                std::string & segment = segments[worker];
+                for_each_twobit_run(sequence, [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t first = begin;first + k - 1 < end;first += FASTA_SEGMENT_BASES)
+                    {
+                        segment.clear();
+                        append_twobit_bases(sequence, first, std::min(end, first + FASTA_SEGMENT_BASES + k - 1), segment);
+                        work(worker, segment.c_str(), segment.size(), (const char *)0);
+                    }
+                });
+            });
+            continue;
+        }
+        if (!chunkable_fasta(*input))
+        {
+            batched.push_back(*input);
+            continue;
+        }
+        mapped_file file(*input);
+        parse_fasta_chunks(file, k - 1, threads, [&work](unsigned int worker, const char * sequence)
+        {
+            work(worker, sequence, strlen(sequence), (const char *)0);
+        });
+    }
+    if (batched.empty()) return;
+    for_each_batch(batched, threads, [&work](unsigned int worker, const sequence_batch & batch)
+    {
+        for (size_t i = 0;i < batch.sequences.size();i ++)
+            work(worker, batch.sequences[i].c_str(), batch.sequences[i].size(),
+                batch.qualities.empty() ? (const char *)0 : batch.qualities[i].c_str());
+    });
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* both passes for one kmer type - dispatch_kmer_length() calls it with the ops for k */
+struct build_run
+{
+    typedef void result_type;
+    int k;
+    double fpp;
+    uint64_t memory;
+    double expected;
+    unsigned int threads;
+    int min_quality;
+    const char * output;
+    std::vector<std::string> inputs;
+
+    /* fills mask with the bases of a read that kmers mustn't cover - those that aren't ACGT and, for FASTQ
+       (a non-null quality), those below min_quality */
+    const uint64_t * mask_read(const char * read, const char * quality, size_t length, std::vector<uint64_t> & mask) const
+    {
+        mask.resize(quality_mask_words(length));
+        if (quality) quality_mask(read, quality, length, 33 + min_quality, mask.data());
+        else base_mask(read, length, mask.data());
+        return mask.data();
+    }
+
+    template<typename ops_t>
+    void operator()(const ops_t & ops)
+    {
+        typedef typename kmer_filter_type<typename ops_t::kmer_type>::type filter_t;
+        typedef hyperloglog<typename ops_t::kmer_type, typename kmer_filter_type<typename ops_t::kmer_type>::hash> counter_t;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        double n = expected;
+        if (n <= 0)
+        {
+            if (std::find(inputs.begin(), inputs.end(), "-") != inputs.end())
+                throw std::runtime_error("Counting the kmers needs two passes, so can't read stdin - give --expected");
+            std::vector<counter_t> counters(threads);
+            std::vector<std::vector<uint64_t> > masks(threads);
+            for_each_sequence(inputs, threads, k, [&](unsigned int worker, const char * read, size_t length,
+                const char * quality)
+            {
+                insert_kmers_batch_masked(counters[worker], ops, read, length, mask_read(read, quality, length, masks[worker]));
+            });
+            for (unsigned int t = 1;t < threads;t ++) counters[0].merge(counters[t]);
+            n = std::max(1.0, counters[0].estimate());
+            std::cerr << "counted ~" << (uint64_t)n << " distinct kmers in " << seconds_since(start) << "s" << std::endl;
+        }
+
+        // without a target, the most bits n kmers can use: the m whose best h is BUILD_MAX_H
+        double m = fpp > 0 ? (double)filter_t::determine_m(fpp, n) : BUILD_MAX_H * n / log(2);
+        if (memory)
+        {
+            // the filter's storage is whole 64 bit blocks plus 8 bytes
+            double budget = memory > 8 ? (memory - 8) / 8 * 64.0 : 0;
+            if (budget < 64) throw std::runtime_error("Memory budget too small");
+            if (fpp > 0 && budget < m)
+                std::cerr << terminal::red << "warning: the memory budget only allows " << (uint64_t)(budget / 8)
+                    << " bytes of the " << (uint64_t)(m / 8) << " needed for a false positive rate of " << fpp
+                    << terminal::reset << std::endl;
+            if (fpp <= 0 && budget > m)
+                std::cerr << terminal::red << "warning: the memory budget of " << memory << " bytes is more than the "
+                    << (uint64_t)(m / 8) << " that " << (uint64_t)n << " kmers can use with h = " << BUILD_MAX_H
+                    << ", so only those are allocated" << terminal::reset << std::endl;
+            m = std::min(m, budget);
+        }
+        m = std::max(64.0, m);
+        int best_h = std::max(1, (int)filter_t::determine_h(m, n));
+        int h = std::min(BUILD_MAX_H, best_h);
+        if (fpp > 0 && best_h > h)
+            std::cerr << terminal::red << "warning: h is capped at " << BUILD_MAX_H << " rather than the " << best_h
+                << " a false positive rate of " << fpp << " needs" << terminal::reset << std::endl;
+
+        storage_options options;
+        options.prefault_threads = threads;
+        filter_t filter((size_t)m, h, options);
+        std::cerr << "m = " << (uint64_t)m << " bits (" << (uint64_t)m / 8 << " bytes), h = " << h
+            << ", expected false positive rate " << filter.expected_false_positive_probability(n) << std::endl;
+
+        std::chrono::steady_clock::time_point build_start = std::chrono::steady_clock::now();
+        std::vector<size_t> kmers(threads);
+        std::vector<std::vector<uint64_t> > masks(threads);
+        for_each_sequence(inputs, threads, k, [&](unsigned int worker, const char * read, size_t length,
+            const char * quality)
+        {
+            kmers[worker] += insert_kmers_concurrent_masked(filter, ops, read, length,
+                mask_read(read, quality, length, masks[worker]));
+        });
+        size_t total = 0;
+        for (unsigned int t = 0;t < threads;t ++) total += kmers[t];
+        double build_seconds = seconds_since(build_start);
+
+        write_filter_file(output, filter, k);
+        bloomfilter_statistics s = filter.statistics();
+        std::cerr << "inserted " << total << " kmers in " << build_seconds << "s (" << total / build_seconds
+            << " kmers/s, " << threads << " threads), fill ratio " << s.fill_ratio << ", estimated false positive rate "
+            << s.false_positive_probability << ", total " << seconds_since(start) << "s" << std::endl;
+    }
+};
+
+int main(int argc, const char* args[])
+{
+    int k = 31;
+    int min_quality = 0;
+    double fpp = 0;
+    uint64_t memory = 0;
+    double expected = 0;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    const char * output = 0;
+    std::vector<std::string> inputs;
+    for (int i = 1;i < argc;i ++)
+    {
+        if (!strcmp(args[i], "-k") && i + 1 < argc) k = atoi(args[++i]);
+        else if (!strcmp(args[i], "--fpp") && i + 1 < argc) fpp = atof(args[++i]);
+        else if (!strcmp(args[i], "--memory") && i + 1 < argc) memory = parse_bytes(args[++i]);
+        else if (!strcmp(args[i], "--expected") && i + 1 < argc) expected = atof(args[++i]);
+        else if (!strcmp(args[i], "--min-quality") && i + 1 < argc) min_quality = std::max(0, std::min(93, atoi(args[++i])));
+        else if (!strcmp(args[i], "--threads") && i + 1 < argc) threads = std::max(1, atoi(args[++i]));
+        else if (!strcmp(args[i], "-o") && i + 1 < argc) output = args[++i];
+        else if (args[i][0] == '-' && args[i][1] != 0)
+        {
+            usage(args[0]);
+            return 1;
+        }
+        else inputs.push_back(args[i]);
+    }
+    if (!output || inputs.empty() || (fpp <= 0 && !memory) || fpp >= 1 || k < 1 || k > (int)KMER_DISPATCH_MAX_LENGTH)
+    {
+        usage(args[0]);
+        return 1;
+    }
+
+    try {
+        build_run run;
+        run.k = k;
+        run.fpp = fpp;
+        run.memory = memory;
+        run.expected = expected;
+        run.threads = threads;
+        run.min_quality = min_quality;
+        run.output = output;
+        run.inputs = inputs;
+        dispatch_kmer_length(k, run);
+    } catch (std::exception & e)
+    {
+        std::cerr << terminal::red << e.what() << terminal::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+    bloom-classify: screens FASTA reads against a kmer filter written by bloom-build
+
+        bloom-classify [options] filter [reads.fa ...]
+
+    Reads come from the given FASTA or FASTQ files, or stdin if there are none (or for "-").  By default each
+    read gets a line
+        header <tab> kmers <tab> hits <tab> hit fraction
+    With --keep the reads whose hit fraction is at least --min-fraction are written out instead (as FASTA or
+    FASTQ, like the input), and with --discard the others are.  The kmers covering an N (or any other base but
+    ACGT, in either case) are skipped, as are those of FASTQ reads covering a base below --min-quality (phred,
+    default 0), and count towards neither kmers nor hits.  Throughput (reads/s and kmers/s) goes to stderr at the end.
+
+    The filter is mapped rather than read in, so start up is immediate and only the pages queries touch are
+    loaded.  The work is a pipeline: one thread parses batches of reads into a bounded queue, --threads workers
+    count the kmer hits, and the main thread writes the results out in input order.  The pipeline is compiled
+    for each k (see kmer_dispatch.hpp) and the one for the filter's k is picked at start up.
+*/
+#include "filter_file.hpp"
+#include "kmer_dispatch.hpp"
+#include "sequence_batches.hpp"
+#include "kmer_scan.hpp"
+#include "bounded_queue.hpp"
+#include "terminal.hpp"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include <stdlib.h>
+
+/* a batch of reads and how many of each one's kmers hit */
+struct classified_batch
+{
+    sequence_batch reads;
+    std::vector<size_t> kmers;
+    std::vector<size_t> hits;
+};
+
+enum output_mode { output_fractions, output_keep, output_discard };
+
+static void usage(const char * program)
+{
+    std::cerr << "Usage: " << program << " [--threads n] [--queue batches] [--min-fraction f] [--min-quality q]"
+        << " [--keep | --discard] filter [reads.fa ...]" << std::endl;
+}
+
+static void write_batch(const classified_batch & batch, output_mode mode, double min_fraction)
+{
+    for (size_t i = 0;i < batch.reads.sequences.size();i ++)
+    {
+        double fraction = batch.kmers[i] ? batch.hits[i] / (double)batch.kmers[i] : 0;
+        if (mode == output_fractions)
+        {
+            std::cout << batch.reads.headers[i] << '\t' << batch.kmers[i] << '\t' << batch.hits[i] << '\t' << fraction << '\n';
+        }
+        else if ((fraction >= min_fraction) == (mode == output_keep))
+        {
+            if (batch.reads.qualities.empty())
+                std::cout << '>' << batch.reads.headers[i] << '\n' << batch.reads.sequences[i] << '\n';
+            else
+                std::cout << '@' << batch.reads.headers[i] << '\n' << batch.reads.sequences[i] << "\n+\n"
+                    << batch.reads.qualities[i] << '\n';
+        }
+    }
+}
+
+/* the pipeline for one kmer type - dispatch_kmer_length() calls it with the ops for the filter's k */
+struct classify_run
+{
+    typedef void result_type;
+    const char * filter_path;
+    std::vector<std::string> inputs;
+    unsigned int threads;
+    size_t queue_batches;
+    output_mode mode;
+    double min_fraction;
+    int min_quality;
+
+    template<typename ops_t>
+    void operator()(const ops_t & ops)
+    {
+        typedef typename kmer_filter_type<typename ops_t::kmer_type>::type filter_t;
+        filter_file_header header;
+        std::unique_ptr<filter_t> filter = map_filter_file<filter_t>(filter_path, header);
+        const filter_t & f = *filter;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bounded_queue<sequence_batch> work(queue_batches);
+        bounded_queue<classified_batch> done(queue_batches);
+        std::exception_ptr reader_error;
+        std::thread reader([&]()
+        {
+            try { read_sequence_batches(inputs, work); }
+            catch (...) { reader_error = std::current_exception(); }
+        });
+
+        // the first worker to fail closes the work queue, so the reader stops and the others finish up
+        std::exception_ptr worker_error;
+        std::mutex worker_error_lock;
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0;t < threads;t ++)
+        {
+            workers.push_back(std::thread([&]()
+            {
+                try
+                {
+                    classified_batch batch;
+                    std::vector<uint64_t> mask;
+                    while (work.pop(batch.reads))
+                    {
+                        size_t count = batch.reads.sequences.size();
+                        batch.kmers.resize(count);
+                        batch.hits.resize(count);
+                        for (size_t i = 0;i < count;i ++)
+                        {
+                            const std::string & read = batch.reads.sequences[i];
+                            mask.resize(quality_mask_words(read.size()));
+                            if (batch.reads.qualities.empty()) base_mask(read.c_str(), read.size(), mask.data());
+                            else quality_mask(read.c_str(), batch.reads.qualities[i].c_str(), read.size(), 33 + min_quality, mask.data());
+                            batch.hits[i] = count_kmer_hits_masked(f, ops, read.c_str(), read.size(), mask.data(), &batch.kmers[i]);
+                        }
+                        done.push(std::move(batch));
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> guard(worker_error_lock);
+                    if (!worker_error) worker_error = std::current_exception();
+                    work.close();
+                }
+            }));
+        }
+        std::thread closer([&]()
+        {
+            for (auto w = workers.begin();w != workers.end();w ++) w->join();
+            done.close();
+        });
+
+        // batches can finish out of order, so hold on to them until it's their turn
+        std::map<size_t, classified_batch> pending;
+        size_t next = 0, reads = 0, kmers = 0;
+        classified_batch batch;
+        while (done.pop(batch))
+        {
+            size_t number = batch.reads.number;
+            pending[number] = std::move(batch);
+            for (auto ready = pending.find(next);ready != pending.end();ready = pending.find(next))
+            {
+                write_batch(ready->second, mode, min_fraction);
+                reads += ready->second.reads.sequences.size();
+                for (size_t i = 0;i < ready->second.kmers.size();i ++) kmers += ready->second.kmers[i];
+                pending.erase(ready);
+                next ++;
+            }
+        }
+        reader.join();
+        closer.join();
+        std::cout.flush();
+        if (reader_error) std::rethrow_exception(reader_error);
+        if (worker_error) std::rethrow_exception(worker_error);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << reads << " reads, " << kmers << " kmers in " << seconds << "s: "
+            << reads / seconds << " reads/s, " << kmers / seconds << " kmers/s (" << threads << " threads)" << std::endl;
+    }
+};
+
+int main(int argc, const char* args[])
+{
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t queue_batches = 0;
+    double min_fraction = 0.5;
+    int min_quality = 0;
+    output_mode mode = output_fractions;
+    const char * filter_path = 0;
+    std::vector<std::string> inputs;
+    for (int i = 1;i < argc;i ++)
+    {
+        if (!strcmp(args[i], "--threads") && i + 1 < argc) threads = std::max(1, atoi(args[++i]));
+        else if (!strcmp(args[i], "--queue") && i + 1 < argc) queue_batches = std::max(1, atoi(args[++i]));
+        else if (!strcmp(args[i], "--min-fraction") && i + 1 < argc) min_fraction = atof(args[++i]);
+        else if (!strcmp(args[i], "--min-quality") && i + 1 < argc) min_quality = std::max(0, std::min(93, atoi(args[++i])));
+        else if (!strcmp(args[i], "--keep")) mode = output_keep;
+        else if (!strcmp(args[i], "--discard")) mode = output_discard;
+        else if (args[i][0] == '-' && args[i][1] != 0)
+        {
+            usage(args[0]);
+            return 1;
+        }
+        else if (!filter_path) filter_path = args[i];
+        else inputs.push_back(args[i]);
+    }
+    if (!filter_path)
+    {
+        usage(args[0]);
+        return 1;
+    }
+    if (inputs.empty()) inputs.push_back("-");
+    // enough batches queued to keep every worker busy, but no more
+    if (!queue_batches) queue_batches = 2 * threads;
+
+    try {
+        classify_run run;
+        run.filter_path = filter_path;
+        run.inputs = inputs;
+        run.threads = threads;
+        run.queue_batches = queue_batches;
+        run.mode = mode;
+        run.min_fraction = min_fraction;
+        run.min_quality = min_quality;
+        // the filter's k picks the kmer ops, so the scan loop is compiled for it
+        dispatch_kmer_length(read_filter_file_header(filter_path).k, run);
+    } catch (std::exception & e)
+    {
+        std::cerr << terminal::red << e.what() << terminal::reset << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include "unit_test.hpp"
+#include "compressed_input.hpp"
+#include "fasta_reader.hpp"
+#include "scoped_timer.hpp"
+#include <zlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+
+class test_compressed_input_t : public unit_test
+{
+    static void put_u16(std::string & out, unsigned int value)
+    {
+        out += (char)(value & 0xff);
+        out += (char)(value >> 8);
+    }
+
+    static void put_u32(std::string & out, uint32_t value)
+    {
+        put_u16(out, value & 0xffff);
+        put_u16(out, value >> 16);
+    }
+
+    /* BGZF as bgzip writes it: blocks of up to 64KB of input, then the empty end of file block */
+    static std::string bgzf(const std::string & data, size_t block_input = 65280)
+    {
+        std::string out;
+        for (size_t first = 0;first <= data.size();first += block_input)
+        {
+            size_t todo = std::min(block_input, data.size() - first);
+            std::vector<uint8_t> deflated(compressBound(todo) + 16);
+            z_stream z;
+            memset(&z, 0, sizeof(z));
+            deflateInit2(&z, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            z.next_in = (Bytef *)data.data() + first;
+            z.avail_in = todo;
+            z.next_out = &deflated[0];
+            z.avail_out = deflated.size();
+            deflate(&z, Z_FINISH);
+            size_t bytes = deflated.size() - z.avail_out;
+            deflateEnd(&z);
+            out += std::string("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+            put_u16(out, bytes + 25);
+            out.append((const char *)&deflated[0], bytes);
+            put_u32(out, crc32(crc32(0, Z_NULL, 0), (const Bytef *)data.data() + first, todo));
+            put_u32(out, todo);
+            if (todo == 0) break;
+        }
+        return out;
+    }
+
+    static std::string gzip(const std::string & data)
+    {
+        std::vector<uint8_t> deflated(compressBound(data.size()) + 32);
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        deflateInit2(&z, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        z.next_in = (Bytef *)data.data();
+        z.avail_in = data.size();
+        z.next_out = &deflated[0];
+        z.avail_out = deflated.size();
+        deflate(&z, Z_FINISH);
+        size_t bytes = deflated.size() - z.avail_out;
+        deflateEnd(&z);
+        return std::string((const char *)&deflated[0], bytes);
+    }
+
+    static void write_file(const char * path, const std::string & data)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+    }
+
+    static std::string read_all(const char * path, input_format * format, unsigned int threads = 0)
+    {
+        compressed_input in(path, threads);
+        *format = in.format();
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    static bool throws(const char * path)
+    {
+        try { input_format format; read_all(path, &format); } catch (std::runtime_error &) { return true; }
+        return false;
+    }
+
+    void operator() ()
+    {
+        section("compressed input");
+        const char * path = "/tmp/bloom-compressed-input-test";
+        std::mt19937 rng(31);
+        std::ostringstream fasta;
+        for (int r = 0;r < 3000;r ++)
+        {
+            fasta << ">read" << r << "\n";
+            for (int line = 0;line < 3;line ++)
+            {
+                for (int i = 0;i < 60;i ++) fasta << "ACGT"[rng() & 3];
+                fasta << "\n";
+            }
+        }
+        std::string text = fasta.str();
+        input_format format;
+
+        write_file(path, text);
+        check(read_all(path, &format) == text && format == input_plain, "plain input passes through");
+        write_file(path, gzip(text));
+        check(read_all(path, &format) == text && format == input_gzip, "gzip input inflates");
+        write_file(path, gzip(text.substr(0, 1000)) + gzip(text.substr(1000)));
+        check(read_all(path, &format) == text, "concatenated gzip members inflate");
+        write_file(path, bgzf(text, 4000));
+        check(read_all(path, &format, 3) == text && format == input_bgzf, "BGZF input inflates in parallel");
+        write_file(path, bgzf(""));
+        check(read_all(path, &format).empty() && format == input_bgzf, "empty BGZF input");
+
+        {
+            write_file(path, bgzf(text, 4000));
+            compressed_input in(path);
+            fasta_reader reader(&in);
+            int reads = 0;
+            while (reader.next()) reads ++;
+            check(reads == 3000 && !strcmp(reader.get_header(), "read2999"), "fasta_reader reads BGZF");
+        }
+        {
+            // stopping early mustn't hang
+            compressed_input in(path, 2);
+            in.get();
+        }
+
+        std::string corrupt = bgzf(text, 4000);
+        corrupt[corrupt.size() / 2] ^= 0x55;
+        write_file(path, corrupt);
+        check(throws(path), "corrupt BGZF throws");
+        std::string truncated = gzip(text);
+        write_file(path, truncated.substr(0, truncated.size() / 2));
+        check(throws(path), "truncated gzip throws");
+        remove(path);
+        check(throws(path), "missing file throws");
+
+        std::string big;
+        for (int copy = 0;copy < 16;copy ++) big += text;
+        write_file(path, bgzf(big));
+        std::cout << "inflate " << big.size() << " bytes of BGZF:" << std::endl;
+        bool same = true;
+        {
+            scoped_timer t("\t1 thread", big.size());
+            same &= read_all(path, &format, 1) == big;
+        }
+        {
+            scoped_timer t("\t4 threads", big.size());
+            same &= read_all(path, &format, 4) == big;
+        }
+        std::cout << std::endl;
+        check(same, "BGZF inflates the same with any number of threads");
+        remove(path);
+    }
+} test_compressed_input;
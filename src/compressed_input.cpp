@@ -0,0 +1,386 @@
+#include "compressed_input.hpp"
+#include "bounded_queue.hpp"
+#include "async_input.hpp"
+#include <zlib.h>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <future>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <streambuf>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* how much the consumer is handed at a time, and how many BGZF blocks (up to 64KB each) a worker inflates */
+const size_t COMPRESSED_INPUT_CHUNK = 1 << 20;
+const size_t BGZF_BLOCKS_PER_JOB = 16;
+
+/* a gzip member header with the BGZF extra field: 12 fixed bytes then the 6 byte "BC" subfield */
+const size_t BGZF_HEADER_BYTES = 18;
+
+namespace
+{
+    /* a chunk of the output, filled in by whichever thread gets to it */
+    struct chunk
+    {
+        /* whole BGZF blocks, for a worker to inflate into data */
+        std::vector<uint8_t> compressed;
+        std::vector<char> data;
+        std::promise<void> done;
+        std::future<void> ready;
+
+        chunk() : ready(done.get_future()) {}
+    };
+    typedef std::shared_ptr<chunk> chunk_ptr;
+
+    /* the file descriptor, with the bytes peeked at to detect the format put back in front.  A regular file
+       is read with several reads in flight (see async_input.hpp), anything else with read() */
+    class source
+    {
+    private:
+        int fd;
+        std::unique_ptr<async_reader> ahead;
+        std::vector<uint8_t> peeked;
+        size_t peek_position;
+    public:
+        source(int fd) : fd(fd), peek_position(0)
+        {
+            struct stat info;
+            if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) return;
+            try { ahead.reset(new async_reader(fd)); }
+            catch (std::runtime_error &) {}
+        }
+
+        /* reads up to bytes, fewer only at the end of the file */
+        size_t read(uint8_t * out, size_t bytes)
+        {
+            size_t done = std::min(bytes, peeked.size() - peek_position);
+            memcpy(out, peeked.data() + peek_position, done);
+            peek_position += done;
+            if (ahead) return done + ahead->read(out + done, bytes - done);
+            while (done < bytes)
+            {
+                ssize_t got = ::read(fd, out + done, bytes - done);
+                if (got < 0 && errno == EINTR) continue;
+                if (got < 0) throw std::runtime_error(std::string("Read failed: ") + strerror(errno));
+                if (got == 0) break;
+                done += got;
+            }
+            return done;
+        }
+
+        /* the first bytes of the file, which the next read() returns again */
+        const std::vector<uint8_t> & peek(size_t bytes)
+        {
+            std::vector<uint8_t> first(bytes);
+            first.resize(read(&first[0], bytes));
+            peeked.swap(first);
+            peek_position = 0;
+            return peeked;
+        }
+    };
+
+    bool is_gzip(const std::vector<uint8_t> & header)
+    {
+        return header.size() >= 2 && header[0] == 0x1f && header[1] == 0x8b;
+    }
+
+    /* a gzip header with FEXTRA whose first subfield is BC of length 2 */
+    bool is_bgzf(const uint8_t * header, size_t bytes)
+    {
+        return bytes >= BGZF_HEADER_BYTES && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4)
+            && header[10] == 6 && header[11] == 0 && header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+    }
+
+    uint32_t get_u32(const uint8_t * data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    /* inflates the whole BGZF blocks in c.compressed into c.data, checking each block's length and CRC */
+    void inflate_blocks(chunk & c)
+    {
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        if (inflateInit2(&z, -15) != Z_OK) throw std::runtime_error("Could not initialise zlib");
+        try
+        {
+            const uint8_t * block = c.compressed.data(), * end = block + c.compressed.size();
+            while (block < end)
+            {
+                size_t block_bytes = (block[16] | (block[17] << 8)) + 1;
+                const uint8_t * trailer = block + block_bytes - 8;
+                uint32_t crc = get_u32(trailer), size = get_u32(trailer + 4);
+                size_t first = c.data.size();
+                c.data.resize(first + size);
+                // zlib wants somewhere to write even for the empty block that ends a file
+                char empty;
+                inflateReset(&z);
+                z.next_in = (Bytef *)(block + BGZF_HEADER_BYTES);
+                z.avail_in = trailer - z.next_in;
+                z.next_out = (Bytef *)(size ? &c.data[first] : &empty);
+                z.avail_out = size;
+                if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.avail_out)
+                    throw std::runtime_error("Corrupt BGZF block");
+                if (crc32(crc32(0, Z_NULL, 0), (const Bytef *)(c.data.data() + first), size) != crc)
+                    throw std::runtime_error("BGZF block fails its CRC check");
+                block += block_bytes;
+            }
+        }
+        catch (...)
+        {
+            inflateEnd(&z);
+            throw;
+        }
+        inflateEnd(&z);
+    }
+}
+
+/* the streambuf behind the istream, fed from the ordered queue of chunks */
+class compressed_buffer : public std::streambuf
+{
+public:
+    bounded_queue<chunk_ptr> ordered;
+    bounded_queue<chunk_ptr> work;
+    chunk_ptr current;
+
+    compressed_buffer(size_t capacity) : ordered(capacity), work(capacity) {}
+protected:
+    virtual int_type underflow()
+    {
+        while (true)
+        {
+            current.reset();
+            chunk_ptr next;
+            if (!ordered.pop(next)) return traits_type::eof();
+            // rethrows whatever went wrong producing it
+            next->ready.get();
+            if (next->data.empty()) continue;
+            current = next;
+            setg(&current->data[0], &current->data[0], &current->data[0] + current->data.size());
+            return traits_type::to_int_type(current->data[0]);
+        }
+    }
+};
+
+struct compressed_input::privates
+{
+    int fd;
+    input_format format;
+    source * input;
+    compressed_buffer * buffer;
+    std::vector<std::thread> threads;
+
+    /* pushes a finished chunk, returning false if the stream is being closed */
+    bool push_done(chunk_ptr c)
+    {
+        c->done.set_value();
+        return buffer->ordered.push(c);
+    }
+
+    /* stops the stream with the current exception */
+    void push_error()
+    {
+        chunk_ptr c(new chunk());
+        c->done.set_exception(std::current_exception());
+        buffer->ordered.push(c);
+    }
+
+    void read_plain()
+    {
+        try
+        {
+            while (true)
+            {
+                chunk_ptr c(new chunk());
+                c->data.resize(COMPRESSED_INPUT_CHUNK);
+                c->data.resize(input->read((uint8_t *)&c->data[0], c->data.size()));
+                if (c->data.empty() || !push_done(c)) break;
+            }
+        }
+        catch (...) { push_error(); }
+        buffer->ordered.close();
+    }
+
+    void read_gzip()
+    {
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        // 32 for gzip header detection
+        if (inflateInit2(&z, 15 + 32) != Z_OK)
+        {
+            try { throw std::runtime_error("Could not initialise zlib"); }
+            catch (...) { push_error(); }
+            buffer->ordered.close();
+            return;
+        }
+        try
+        {
+            std::vector<uint8_t> in(COMPRESSED_INPUT_CHUNK);
+            bool end_of_input = false, in_member = true;
+            chunk_ptr c(new chunk());
+            c->data.resize(COMPRESSED_INPUT_CHUNK);
+            z.next_out = (Bytef *)&c->data[0];
+            z.avail_out = c->data.size();
+            while (true)
+            {
+                if (!z.avail_in && !end_of_input)
+                {
+                    z.next_in = &in[0];
+                    z.avail_in = input->read(&in[0], in.size());
+                    end_of_input = z.avail_in == 0;
+                }
+                if (end_of_input && !z.avail_in)
+                {
+                    if (in_member) throw std::runtime_error("Truncated gzip input");
+                    break;
+                }
+                if (!in_member)
+                {
+                    // concatenated members are valid gzip
+                    inflateReset(&z);
+                    in_member = true;
+                }
+                int status = inflate(&z, Z_NO_FLUSH);
+                if (status == Z_STREAM_END) in_member = false;
+                else if (status != Z_OK && status != Z_BUF_ERROR) throw std::runtime_error("Corrupt gzip input");
+                if (!z.avail_out)
+                {
+                    if (!push_done(c)) break;
+                    c.reset(new chunk());
+                    c->data.resize(COMPRESSED_INPUT_CHUNK);
+                    z.next_out = (Bytef *)&c->data[0];
+                    z.avail_out = c->data.size();
+                }
+            }
+            c->data.resize(c->data.size() - z.avail_out);
+            push_done(c);
+        }
+        catch (...) { push_error(); }
+        inflateEnd(&z);
+        buffer->ordered.close();
+    }
+
+    /* splits the file into runs of whole blocks for the workers */
+    void split_bgzf()
+    {
+        try
+        {
+            bool more = true;
+            while (more)
+            {
+                chunk_ptr c(new chunk());
+                for (size_t b = 0;b < BGZF_BLOCKS_PER_JOB;b ++)
+                {
+                    uint8_t header[BGZF_HEADER_BYTES];
+                    size_t got = input->read(header, sizeof(header));
+                    if (got == 0)
+                    {
+                        more = false;
+                        break;
+                    }
+                    if (!is_bgzf(header, got)) throw std::runtime_error("Corrupt or truncated BGZF input");
+                    size_t block_bytes = (header[16] | (header[17] << 8)) + 1;
+                    if (block_bytes < BGZF_HEADER_BYTES + 8) throw std::runtime_error("Corrupt BGZF block size");
+                    size_t first = c->compressed.size();
+                    c->compressed.resize(first + block_bytes);
+                    memcpy(&c->compressed[first], header, sizeof(header));
+                    size_t rest = block_bytes - sizeof(header);
+                    if (input->read(&c->compressed[first + sizeof(header)], rest) != rest)
+                        throw std::runtime_error("Truncated BGZF input");
+                }
+                if (c->compressed.empty()) break;
+                if (!buffer->ordered.push(c) || !buffer->work.push(c)) break;
+            }
+        }
+        catch (...) { push_error(); }
+        buffer->ordered.close();
+        buffer->work.close();
+    }
+
+    void inflate_bgzf()
+    {
+        chunk_ptr c;
+        while (buffer->work.pop(c))
+        {
+            try
+            {
+                inflate_blocks(*c);
+                c->done.set_value();
+            }
+            catch (...) { c->done.set_exception(std::current_exception()); }
+            c.reset();
+        }
+    }
+};
+
+compressed_input::compressed_input(const std::string & path, unsigned int threads) : std::istream(0)
+{
+    m = new privates();
+    m->fd = path == "-" ? 0 : open(path.c_str(), O_RDONLY);
+    if (m->fd < 0)
+    {
+        delete m;
+        throw std::runtime_error("Could not open " + path);
+    }
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    m->input = new source(m->fd);
+    // enough chunks in flight to keep every worker busy
+    m->buffer = new compressed_buffer(2 * threads + 2);
+    rdbuf(m->buffer);
+    exceptions(std::ios::badbit);
+
+    std::vector<uint8_t> header;
+    try { header = m->input->peek(BGZF_HEADER_BYTES); }
+    catch (...)
+    {
+        exceptions(std::ios::goodbit);
+        rdbuf(0);
+        delete m->buffer;
+        delete m->input;
+        if (m->fd > 0) close(m->fd);
+        delete m;
+        throw;
+    }
+    if (is_bgzf(header.data(), header.size()))
+    {
+        m->format = input_bgzf;
+        m->threads.push_back(std::thread(&privates::split_bgzf, m));
+        for (unsigned int t = 0;t < threads;t ++) m->threads.push_back(std::thread(&privates::inflate_bgzf, m));
+    }
+    else if (is_gzip(header))
+    {
+        m->format = input_gzip;
+        m->threads.push_back(std::thread(&privates::read_gzip, m));
+    }
+    else
+    {
+        m->format = input_plain;
+        m->threads.push_back(std::thread(&privates::read_plain, m));
+    }
+}
+
+compressed_input::~compressed_input()
+{
+    // stops the background threads if the reader gave up early
+    m->buffer->ordered.close();
+    m->buffer->work.close();
+    for (auto t = m->threads.begin();t != m->threads.end();t ++) t->join();
+    exceptions(std::ios::goodbit);
+    rdbuf(0);
+    delete m->buffer;
+    delete m->input;
+    if (m->fd > 0) close(m->fd);
+    delete m;
+}
+
+input_format compressed_input::format() const
+{
+    return m->format;
+}
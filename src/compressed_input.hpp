@@ -0,0 +1,47 @@
+/*
+    An istream over a file that may be gzip or BGZF compressed, decompressing on background threads
+
+    The format is detected from the first bytes:
+        BGZF (block gzip, as written by bgzip and samtools) - a series of independent gzip members of at most
+            64KB each, with the compressed size of each in a header field.  One thread splits the file into
+            runs of blocks and threads workers inflate them in parallel; the stream hands them to the reader
+            in order.  This is what takes decompression off the critical path.
+        gzip - one deflate stream (or several concatenated members) can only be inflated in order, so one
+            background thread does it, which still overlaps it with the parsing
+        anything else - passed through as it is, read on a background thread
+    In every case the consumer gets whole buffers of about a megabyte from a bounded queue, so memory stays
+    bounded however far ahead the decompression gets.  Regular files are read with an async_reader, which
+    keeps several reads in flight ahead of the background thread (see async_input.hpp).
+
+    Errors on the background threads (a corrupt block, a truncated file) are rethrown as std::runtime_error from
+    the read that reaches them - the stream has badbit exceptions turned on so they aren't swallowed.
+
+        compressed_input in("reads.fa.gz");
+        fasta_reader reader(&in);
+
+    Only zlib is needed.
+*/
+#ifndef __COMPRESSED_INPUT_HPP
+#define __COMPRESSED_INPUT_HPP
+#include <istream>
+#include <string>
+
+enum input_format { input_plain, input_gzip, input_bgzf };
+
+class compressed_input : public std::istream
+{
+private:
+    /* pImpl pattern allows private members to be defined in cpp file */
+    struct privates;
+    privates * m;
+public:
+    /* opens path, or stdin for "-".  threads is the number of BGZF inflating threads, 0 for one per core.
+       Throws std::runtime_error if the file can't be opened */
+    compressed_input(const std::string & path, unsigned int threads = 0);
+
+    virtual ~compressed_input();
+
+    input_format format() const;
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "unit_test.hpp"
+#include "fasta_chunks.hpp"
+#include "fasta_reader.hpp"
+#include "kmer.hpp"
+#include "kmer_scan.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+class test_fasta_chunks_t : public unit_test
+{
+    /* every kmer of the sequences with no base but ACGT (in either case), sorted */
+    std::vector<kmer_t> expected_kmers(const kmer_ops & ops, const std::vector<std::string> & sequences)
+    {
+        const size_t k = ops.getlength();
+        std::vector<kmer_t> kmers;
+        for (size_t i = 0;i < sequences.size();i ++)
+            for (size_t j = 0;j + k <= sequences[i].size();j ++)
+            {
+                std::string bases = sequences[i].substr(j, k);
+                if (bases.find_first_not_of("ACGTacgt") != std::string::npos) continue;
+                const char * p = bases.c_str();
+                kmer_t kmer;
+                ops.read_first(&kmer, &p);
+                kmers.push_back(kmer);
+            }
+        std::sort(kmers.begin(), kmers.end());
+        return kmers;
+    }
+
+    /* every kmer of the file parsed in chunks, sorted */
+    std::vector<kmer_t> chunked_kmers(const kmer_ops & ops, const mapped_file & file, unsigned int threads,
+        size_t chunk_bytes)
+    {
+        std::vector<std::vector<kmer_t> > found(threads);
+        std::vector<std::vector<uint64_t> > masks(threads);
+        parse_fasta_chunks(file, ops.getlength() - 1, threads, [&](unsigned int worker, const char * sequence)
+        {
+            size_t length = strlen(sequence);
+            masks[worker].resize(quality_mask_words(length));
+            base_mask(sequence, length, masks[worker].data());
+            for_each_unmasked_kmer(ops, sequence, length, masks[worker].data(),
+                [&](const kmer_t & kmer) { found[worker].push_back(kmer); });
+        }, chunk_bytes);
+        std::vector<kmer_t> kmers;
+        for (unsigned int t = 0;t < threads;t ++) kmers.insert(kmers.end(), found[t].begin(), found[t].end());
+        std::sort(kmers.begin(), kmers.end());
+        return kmers;
+    }
+
+    /* writes the sequences as FASTA with lines of width bases (0 for one line each) */
+    void write_fasta(const char * path, const std::vector<std::string> & sequences, size_t width, const char * newline)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (size_t i = 0;i < sequences.size();i ++)
+        {
+            out << ">sequence_" << i << " a header > with a gt in it" << newline;
+            size_t line = width ? width : sequences[i].size();
+            for (size_t j = 0;j < sequences[i].size();j += line) out << sequences[i].substr(j, line) << newline;
+        }
+    }
+
+    void operator() ()
+    {
+        section("chunked fasta parsing");
+        const char * path = "/tmp/bloom-fasta-chunks-test.fa";
+        std::mt19937 rng(47);
+        std::vector<std::string> sequences;
+        const size_t lengths[] = { 500, 3, 11, 1200, 0, 77, 2000 };
+        for (size_t i = 0;i < sizeof(lengths) / sizeof(lengths[0]);i ++)
+        {
+            std::string sequence(lengths[i], 'A');
+            for (size_t j = 0;j < sequence.size();j ++) sequence[j] = "ACGT"[rng() & 3];
+            sequences.push_back(sequence);
+        }
+        kmer_ops ops(11);
+        std::vector<kmer_t> expected = expected_kmers(ops, sequences);
+
+        const size_t widths[] = { 60, 1, 0 };
+        const char * newlines[] = { "\n", "\r\n" };
+        const size_t chunk_sizes[] = { 1, 7, 37, 64, 1000, FASTA_CHUNK_BYTES };
+        bool same = true;
+        for (size_t w = 0;w < 3;w ++)
+            for (size_t n = 0;n < 2;n ++)
+            {
+                write_fasta(path, sequences, widths[w], newlines[n]);
+                mapped_file file(path);
+                for (size_t c = 0;c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);c ++)
+                    for (unsigned int threads = 1;threads <= 3;threads += 2)
+                        same &= chunked_kmers(ops, file, threads, chunk_sizes[c]) == expected;
+            }
+        check(same, "every kmer found once whatever the chunk size, line width and line breaks");
+
+        // a record long enough to be passed on in several segments
+        std::vector<std::string> chromosome(1, std::string(FASTA_SEGMENT_BASES * 5 / 2, 'A'));
+        for (size_t j = 0;j < chromosome[0].size();j ++) chromosome[0][j] = "ACGT"[rng() & 3];
+        write_fasta(path, chromosome, 60, "\n");
+        {
+            mapped_file file(path);
+            std::vector<kmer_t> whole = expected_kmers(ops, chromosome);
+            check(chunked_kmers(ops, file, 2, FASTA_CHUNK_BYTES) == whole, "long record split into segments");
+            check(chunked_kmers(ops, file, 2, 100003) == whole, "long record split into chunks");
+        }
+
+        // N runs and soft-masked runs of every length up to a little over k, so chunk edges fall inside them,
+        // at their ends and in the kmers either side
+        std::vector<std::string> masked(3);
+        for (size_t i = 0;i < masked.size();i ++)
+            while (masked[i].size() < 3000)
+            {
+                size_t run = rng() % 14;
+                int kind = rng() % 3;
+                for (size_t j = 0;j < run;j ++)
+                    masked[i] += kind == 0 ? 'N' : kind == 1 ? "acgt"[rng() & 3] : "ACGT"[rng() & 3];
+                masked[i] += "ACGT"[rng() & 3];
+            }
+        std::vector<kmer_t> masked_expected = expected_kmers(ops, masked);
+        same = !masked_expected.empty();
+        for (size_t w = 0;w < 2;w ++)
+        {
+            write_fasta(path, masked, widths[w], "\n");
+            mapped_file file(path);
+            for (size_t c = 0;c < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);c ++)
+                same &= chunked_kmers(ops, file, 2, chunk_sizes[c]) == masked_expected;
+        }
+        check(same, "Ns across chunk edges drop the kmers covering them and lowercase bases count");
+
+        std::ofstream(path, std::ios::trunc) << ">a\nACGTACGTACGTACGTACGT\n";
+        bool threw = false;
+        try
+        {
+            mapped_file file(path);
+            parse_fasta_chunks(file, 10, 2, [](unsigned int, const char *) { throw std::runtime_error("work failed"); }, 8);
+        }
+        catch (std::runtime_error &) { threw = true; }
+        check(threw, "an exception from work is rethrown");
+
+        // the same bases as a chromosome read by fasta_reader and in chunks
+        chromosome[0].resize(1 << 25);
+        for (size_t j = 0;j < chromosome[0].size();j ++) chromosome[0][j] = "ACGT"[rng() & 3];
+        write_fasta(path, chromosome, 60, "\n");
+        const kmer_ops ops31(31);
+        size_t read_kmers = 0, chunk_kmers = 0;
+        std::cout << "kmers of a " << chromosome[0].size() << " base record:" << std::endl;
+        {
+            scoped_timer t("\tfasta_reader", chromosome[0].size());
+            std::ifstream in(path);
+            fasta_reader reader(&in);
+            while (reader.next())
+            {
+                const char * p = reader.get_sequence();
+                kmer_t kmer;
+                if (!ops31.read_first(&kmer, &p)) continue;
+                do read_kmers ++;
+                while (ops31.read_next(&kmer, &p));
+            }
+        }
+        {
+            scoped_timer t("\tmapped chunks", chromosome[0].size());
+            mapped_file file(path);
+            std::vector<size_t> counts(std::max(1u, std::thread::hardware_concurrency()));
+            parse_fasta_chunks(file, 30, counts.size(), [&](unsigned int worker, const char * sequence)
+            {
+                kmer_t kmer;
+                if (!ops31.read_first(&kmer, &sequence)) return;
+                do counts[worker] ++;
+                while (ops31.read_next(&kmer, &sequence));
+            });
+            for (size_t t = 0;t < counts.size();t ++) chunk_kmers += counts[t];
+        }
+        std::cout << std::endl;
+        check(read_kmers == chunk_kmers && chunk_kmers == chromosome[0].size() - 30, "same kmer count both ways");
+        remove(path);
+    }
+} test_fasta_chunks;
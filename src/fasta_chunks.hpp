@@ -0,0 +1,160 @@
+/*
+    Parsing one big FASTA file on several threads
+
+    A whole chromosome is one record, so handing out records (see sequence_batches.hpp) leaves one thread doing
+    all the work.  Instead the mapped file is cut into byte ranges and each thread takes the next range:
+
+        - the range's start is resynchronised: a start inside a header line moves to the line after it, and a
+          start inside sequence stays where it is, since every base belongs to the range its byte falls in
+        - the bases of the range are gathered with the line breaks taken out, and the header of any record
+          starting in the range ends the sequence so far
+        - the sequence at the end of the range carries on for overlap more bases past it, so with overlap k - 1
+          every kmer starting in the range is complete and every kmer of the file is seen exactly once
+
+    The bases reach the caller as null-terminated segments of up to FASTA_SEGMENT_BASES (plus the overlap),
+    consecutive segments of a sequence sharing overlap bases, so a range's working memory stays small whatever
+    its size.  Anything other than the line breaks is passed on as it is - Ns, soft-masked lowercase and all -
+    so callers take the kmers with base_mask() and for_each_unmasked_kmer() (see quality_mask.hpp and
+    kmer_scan.hpp), as for fasta_reader.  Each kmer is masked on its own bases alone, so an N run across a
+    range boundary drops the same kmers as it would read in one piece.
+*/
+#ifndef __FASTA_CHUNKS_HPP
+#define __FASTA_CHUNKS_HPP
+#include "mapped_file.hpp"
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+
+/* the byte range a thread takes at a time, and the most bases it gathers before passing them on */
+const size_t FASTA_CHUNK_BYTES = 16 << 20;
+const size_t FASTA_SEGMENT_BASES = 1 << 20;
+
+/* how far back fasta_chunk_start() looks for the start of a header - longer headers aren't supported */
+const size_t FASTA_MAX_HEADER_BYTES = 64 << 10;
+
+/* the end of the line containing position - the newline, or limit if there isn't one before it */
+inline size_t fasta_line_end(const char * data, size_t limit, size_t position)
+{
+    const char * end = (const char *)memchr(data + position, '\n', limit - position);
+    return end ? end - data : limit;
+}
+
+/* the end of the bases of a line ending at line_end, without the carriage return of a CRLF line break */
+inline size_t fasta_bases_end(const char * data, size_t position, size_t line_end)
+{
+    return line_end > position && data[line_end - 1] == '\r' ? line_end - 1 : line_end;
+}
+
+/* where the range starting at offset starts reading bases: offset itself unless it's in a header line.
+   Sequence lines never have a >, so a > before the previous newline means a header; looking back a bounded
+   distance keeps this cheap however long the sequence lines are */
+inline size_t fasta_chunk_start(const char * data, size_t size, size_t offset)
+{
+    if (offset >= size) return size;
+    const size_t lowest = offset - std::min(offset, FASTA_MAX_HEADER_BYTES);
+    for (size_t p = offset + 1;p -- > lowest;)
+    {
+        if (data[p] == '>') return std::min(size, fasta_line_end(data, size, offset) + 1);
+        if (data[p] == '\n' && p < offset) break;
+    }
+    return offset;
+}
+
+/* calls segment(sequence) with the bases of data[begin, end) plus overlap bases past end (see above).
+   bases is working space */
+template<typename segment_t>
+void for_each_fasta_segment(const char * data, size_t size, size_t begin, size_t end, size_t overlap,
+    std::string & bases, segment_t segment)
+{
+    bases.clear();
+    size_t position = fasta_chunk_start(data, size, begin);
+    while (position < end)
+    {
+        if ((position == 0 || data[position - 1] == '\n') && data[position] == '>')
+        {
+            if (!bases.empty()) segment(bases.c_str());
+            bases.clear();
+            position = std::min(size, fasta_line_end(data, size, position) + 1);
+            continue;
+        }
+        // never searching past end, so a sequence all on one line isn't scanned by every range
+        size_t line_end = fasta_line_end(data, end, position);
+        if (line_end >= end)
+        {
+            bases.append(data + position, fasta_bases_end(data, position, end) - position);
+            position = end;
+        }
+        else
+        {
+            bases.append(data + position, fasta_bases_end(data, position, line_end) - position);
+            position = line_end + 1;
+        }
+        if (bases.size() >= FASTA_SEGMENT_BASES + overlap)
+        {
+            segment(bases.c_str());
+            bases.erase(0, bases.size() - overlap);
+        }
+    }
+    if (bases.empty()) return;
+
+    // the overlap, which stops at the end of the record like any other sequence
+    size_t wanted = overlap;
+    while (wanted && position < size && !((position == 0 || data[position - 1] == '\n') && data[position] == '>'))
+    {
+        size_t line_end = fasta_line_end(data, std::min(size, position + wanted + 1), position);
+        size_t taken = std::min(wanted, fasta_bases_end(data, position, line_end) - position);
+        bases.append(data + position, taken);
+        wanted -= taken;
+        position = line_end + 1;
+    }
+    segment(bases.c_str());
+}
+
+/* parses the mapped FASTA file on threads threads (0 for one per core), calling work(worker, sequence) for
+   each segment of bases, with worker the thread's number from 0.  overlap is k - 1 for kmers of length k.
+   Rethrows the first exception from work once every thread has stopped */
+template<typename work_t>
+void parse_fasta_chunks(const mapped_file & file, size_t overlap, unsigned int threads, work_t work,
+    size_t chunk_bytes = FASTA_CHUNK_BYTES)
+{
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunks = (file.size() + chunk_bytes - 1) / chunk_bytes;
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_lock;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0;t < threads;t ++)
+    {
+        workers.push_back(std::thread([&, t]()
+        {
+            std::string bases;
+            bases.reserve(std::min(chunk_bytes, FASTA_SEGMENT_BASES) + overlap);
+            try
+            {
+                for (size_t chunk = next ++;chunk < chunks;chunk = next ++)
+                {
+                    size_t begin = chunk * chunk_bytes, end = std::min(file.size(), begin + chunk_bytes);
+                    for_each_fasta_segment(file.data(), file.size(), begin, end, overlap, bases,
+                        [&work, t](const char * sequence) { work(t, sequence); });
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_lock);
+                if (!error) error = std::current_exception();
+                // the other threads stop after their current chunk
+                next = chunks;
+            }
+        }));
+    }
+    for (auto w = workers.begin();w != workers.end();w ++) w->join();
+    if (error) std::rethrow_exception(error);
+}
+
+#endif
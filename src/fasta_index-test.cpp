@@ -0,0 +1,127 @@
+#include "unit_test.hpp"
+#include "fasta_index.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdio.h>
+
+class test_fasta_index_t : public unit_test
+{
+    bool throws(const std::string & text)
+    {
+        try { build_fasta_index(text.data(), text.size()); }
+        catch (std::runtime_error &) { return true; }
+        return false;
+    }
+
+    void operator() ()
+    {
+        section("fasta index");
+        const char * path = "/tmp/bloom-fasta-index-test.fa";
+        const std::string fai = std::string(path) + ".fai";
+        remove(fai.c_str());
+        std::mt19937 rng(49);
+        const size_t lengths[] = { 1000, 60, 0, 59, 12345, 1 };
+        const size_t widths[] = { 60, 60, 60, 70, 80, 1 };
+        std::vector<std::string> sequences;
+        std::string text;
+        for (size_t i = 0;i < 6;i ++)
+        {
+            std::string sequence(lengths[i], 'A');
+            for (size_t j = 0;j < sequence.size();j ++) sequence[j] = "ACGT"[rng() & 3];
+            sequences.push_back(sequence);
+            // the fourth record has CRLF line breaks and the last no final line break
+            const char * newline = i == 3 ? "\r\n" : "\n";
+            text += ">record_" + std::to_string(i) + " description of it" + newline;
+            for (size_t j = 0;j < sequence.size();j += widths[i])
+                text += sequence.substr(j, widths[i]) + (i == 5 && j + widths[i] >= sequence.size() ? "" : newline);
+        }
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+
+        std::vector<fasta_index_entry> index = build_fasta_index(text.data(), text.size());
+        bool fields = index.size() == 6;
+        for (size_t i = 0;fields && i < 6;i ++)
+        {
+            fields &= index[i].name == "record_" + std::to_string(i) && index[i].length == lengths[i];
+            fields &= text.compare(index[i].offset, std::min<size_t>(lengths[i], widths[i]), sequences[i], 0,
+                std::min<size_t>(lengths[i], widths[i])) == 0;
+            // a record on one line has that line's length, and the last has no line break to count
+            const size_t line_bases = std::min(lengths[i], widths[i]);
+            if (lengths[i])
+                fields &= index[i].line_bases == line_bases && index[i].line_width == line_bases + (i == 3 ? 2 : i == 5 ? 0 : 1);
+        }
+        check(fields, "names, lengths, offsets and line sizes");
+        check(index[0].offset == strlen(">record_0 description of it\n") && index[1].offset == index[0].offset + 1000 + 17
+            + strlen(">record_1 description of it\n"), "offsets as samtools faidx has them");
+
+        write_fasta_index(fai, index);
+        std::vector<fasta_index_entry> read = read_fasta_index(fai);
+        bool same = read.size() == index.size();
+        for (size_t i = 0;same && i < read.size();i ++)
+            same &= read[i].name == index[i].name && read[i].length == index[i].length && read[i].offset == index[i].offset
+                && read[i].line_bases == index[i].line_bases && read[i].line_width == index[i].line_width;
+        check(same, ".fai written and read back");
+
+        for (int with_fai = 1;with_fai >= 0;with_fai --)
+        {
+            if (!with_fai) remove(fai.c_str());
+            indexed_fasta fasta(path);
+            bool records = fasta.size() == 6, ranges = true;
+            for (size_t i = 0;i < fasta.size();i ++)
+            {
+                records &= fasta.fetch(i) == sequences[i] && fasta.find(fasta.entry(i).name) == i;
+                std::string region;
+                for (size_t r = 0;r < 200;r ++)
+                {
+                    size_t begin = rng() % (lengths[i] + 1), end = begin + rng() % (lengths[i] - begin + 1);
+                    fasta.fetch(i, begin, end, region);
+                    ranges &= region == sequences[i].substr(begin, end - begin);
+                }
+            }
+            check(records, with_fai ? "whole records through the .fai" : "whole records, indexed on opening");
+            check(ranges, with_fai ? "subranges through the .fai" : "subranges, indexed on opening");
+            check(fasta.find("record_6") == fasta.size(), "unknown name");
+            bool threw = false;
+            std::string region;
+            try { fasta.fetch(0, 10, 1001, region); }
+            catch (std::runtime_error &) { threw = true; }
+            check(threw, "range past the end throws");
+        }
+
+        check(throws(">a\nACGT\nAC\nACGT\n"), "short line before the last throws");
+        check(throws(">a\nACGT\nACGTA\n"), "long line throws");
+        check(throws("ACGT\n"), "no header throws");
+        check(!throws(">a\nACGT\nAC\n\n>b\nA\n"), "blank lines after the last line are fine");
+
+        // random regions of a chromosome
+        std::string chromosome(1 << 25, 'A');
+        for (size_t j = 0;j < chromosome.size();j ++) chromosome[j] = "ACGT"[rng() & 3];
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out << ">chromosome\n";
+            for (size_t j = 0;j < chromosome.size();j += 60) out << chromosome.substr(j, 60) << '\n';
+        }
+        const int regions = 100000;
+        std::vector<size_t> starts(regions);
+        for (int r = 0;r < regions;r ++) starts[r] = rng() % (chromosome.size() - 1000);
+        bool found = true;
+        std::cout << "fetch " << regions << " random 1000 base regions:" << std::endl;
+        {
+            scoped_timer t("\tindex and fetch", regions);
+            indexed_fasta fasta(path);
+            std::string region;
+            for (int r = 0;r < regions;r ++)
+            {
+                fasta.fetch(0, starts[r], starts[r] + 1000, region);
+                found &= region[999] == chromosome[starts[r] + 999];
+            }
+        }
+        std::cout << std::endl;
+        check(found, "regions of a chromosome");
+        remove(path);
+    }
+} test_fasta_index;
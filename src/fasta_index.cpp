@@ -0,0 +1,173 @@
+#include "fasta_index.hpp"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+/* the end of the line at position - its newline, or size */
+static size_t line_end(const char * data, size_t size, size_t position)
+{
+    const char * end = (const char *)memchr(data + position, '\n', size - position);
+    return end ? end - data : size;
+}
+
+std::vector<fasta_index_entry> build_fasta_index(const char * data, size_t size)
+{
+    std::vector<fasta_index_entry> index;
+    if (size && data[0] != '>') throw std::runtime_error("Expected > character but read something else");
+    size_t position = 0;
+    while (position < size)
+    {
+        // the header, cut at the first whitespace
+        size_t header_end = line_end(data, size, position);
+        size_t name_end = position + 1;
+        while (name_end < header_end && !isspace((unsigned char)data[name_end])) name_end ++;
+        fasta_index_entry entry;
+        entry.name.assign(data + position + 1, name_end - position - 1);
+        entry.length = entry.line_bases = entry.line_width = 0;
+        position = entry.offset = std::min(size, header_end + 1);
+
+        // the lines up to the next header, which must all be line_bases long but the last
+        bool short_line = false;
+        while (position < size && data[position] != '>')
+        {
+            size_t end = line_end(data, size, position);
+            size_t width = std::min(size, end + 1) - position;
+            size_t bases = end - position;
+            if (bases && data[end - 1] == '\r') bases --;
+            if (!entry.line_width)
+            {
+                entry.line_bases = bases;
+                entry.line_width = width;
+            }
+            // only blank lines can follow the short last line
+            else if (bases && (short_line || bases > entry.line_bases))
+                throw std::runtime_error("Different line lengths in FASTA record " + entry.name);
+            if (bases < entry.line_bases || width != entry.line_width) short_line = true;
+            entry.length += bases;
+            position = end + 1;
+        }
+        index.push_back(entry);
+    }
+    return index;
+}
+
+void write_fasta_index(const std::string & path, const std::vector<fasta_index_entry> & index)
+{
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Could not create " + path);
+    for (auto entry = index.begin();entry != index.end();entry ++)
+        out << entry->name << '\t' << entry->length << '\t' << entry->offset << '\t' << entry->line_bases << '\t'
+            << entry->line_width << '\n';
+    if (!out) throw std::runtime_error("Could not write " + path);
+}
+
+std::vector<fasta_index_entry> read_fasta_index(const std::string & path)
+{
+    std::ifstream in(path.c_str());
+    if (!in) throw std::runtime_error("Could not open " + path);
+    std::vector<fasta_index_entry> index;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty()) continue;
+        std::istringstream fields(line);
+        fasta_index_entry entry;
+        if (!std::getline(fields, entry.name, '\t') || !(fields >> entry.length >> entry.offset >> entry.line_bases
+            >> entry.line_width) || (entry.length && (!entry.line_bases || entry.line_width < entry.line_bases)))
+            throw std::runtime_error("Malformed FASTA index line in " + path + ": " + line);
+        index.push_back(entry);
+    }
+    return index;
+}
+
+struct indexed_fasta::privates
+{
+    mapped_file file;
+    std::vector<fasta_index_entry> index;
+    std::unordered_map<std::string, size_t> names;
+
+    privates(const std::string & path) : file(path) {}
+};
+
+indexed_fasta::indexed_fasta(const std::string & path)
+{
+    m = new privates(path);
+    try
+    {
+        struct stat info;
+        const std::string fai = path + ".fai";
+        if (stat(fai.c_str(), &info) == 0) m->index = read_fasta_index(fai);
+        else m->index = build_fasta_index(m->file.data(), m->file.size());
+        for (size_t i = 0;i < m->index.size();i ++)
+        {
+            const fasta_index_entry & entry = m->index[i];
+            // a stale index could point outside the file
+            if (entry.length && entry.offset + (entry.length - 1) / entry.line_bases * entry.line_width
+                + (entry.length - 1) % entry.line_bases >= m->file.size())
+                throw std::runtime_error("FASTA index " + fai + " doesn't match " + path);
+            m->names.insert(std::make_pair(entry.name, i));
+        }
+    }
+    catch (...)
+    {
+        delete m;
+        throw;
+    }
+}
+
+indexed_fasta::~indexed_fasta()
+{
+    delete m;
+}
+
+size_t indexed_fasta::size() const
+{
+    return m->index.size();
+}
+
+const fasta_index_entry & indexed_fasta::entry(size_t record) const
+{
+    if (record >= m->index.size()) throw std::runtime_error("FASTA record out of range");
+    return m->index[record];
+}
+
+const std::vector<fasta_index_entry> & indexed_fasta::index() const
+{
+    return m->index;
+}
+
+size_t indexed_fasta::find(const std::string & name) const
+{
+    auto found = m->names.find(name);
+    return found == m->names.end() ? m->index.size() : found->second;
+}
+
+void indexed_fasta::fetch(size_t record, uint64_t begin, uint64_t end, std::string & sequence) const
+{
+    const fasta_index_entry & e = entry(record);
+    if (begin > end || end > e.length) throw std::runtime_error("Range out of bounds of FASTA record " + e.name);
+    sequence.resize(end - begin);
+    // a line (or what's left of one) at a time
+    uint64_t position = begin;
+    char * out = &sequence[0];
+    while (position < end)
+    {
+        uint64_t column = position % e.line_bases;
+        uint64_t bases = std::min(e.line_bases - column, end - position);
+        memcpy(out, m->file.data() + e.offset + position / e.line_bases * e.line_width + column, bases);
+        out += bases;
+        position += bases;
+    }
+}
+
+std::string indexed_fasta::fetch(size_t record) const
+{
+    std::string sequence;
+    fetch(record, 0, entry(record).length, sequence);
+    return sequence;
+}
@@ -0,0 +1,75 @@
+/*
+    A faidx (.fai) index of a FASTA file, and random access to its records through it
+
+    Each record gets a line of the same five tab separated fields samtools faidx writes, so the index files
+    are interchangeable with it:
+        name        the header up to the first whitespace
+        length      the number of bases
+        offset      the byte offset of the first base
+        line_bases  the bases on each line (all but the last line of a record must be the same length)
+        line_width  the bytes on each line, including the line break (so 61 or 62 for 60 bases a line)
+
+    With those, base p of a record is at offset + p / line_bases * line_width + p % line_bases, so
+    indexed_fasta fetches a record or any range of one straight out of the mapped file without reading the
+    records before it - e.g. workers taking records by number, or a query of one region of a chromosome.
+    fetch() only reads the mapping, so any number of threads can call it at once.
+*/
+#ifndef __FASTA_INDEX_HPP
+#define __FASTA_INDEX_HPP
+#include "mapped_file.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct fasta_index_entry
+{
+    std::string name;
+    uint64_t length;
+    uint64_t offset;
+    uint64_t line_bases;
+    uint64_t line_width;
+};
+
+/* indexes the FASTA data.  Throws std::runtime_error if a record's lines (but the last) differ in length, or
+   the data doesn't start with a header */
+std::vector<fasta_index_entry> build_fasta_index(const char * data, size_t size);
+
+/* writes or reads the index in the .fai format.  Both throw std::runtime_error on failure */
+void write_fasta_index(const std::string & path, const std::vector<fasta_index_entry> & index);
+std::vector<fasta_index_entry> read_fasta_index(const std::string & path);
+
+class indexed_fasta
+{
+private:
+    /* pImpl pattern allows private members to be defined in cpp file */
+    struct privates;
+    privates * m;
+public:
+    /* maps the FASTA file at path and uses path.fai as its index if there is one, otherwise indexes it.
+       Throws std::runtime_error if either can't be read */
+    indexed_fasta(const std::string & path);
+    indexed_fasta(const indexed_fasta &) = delete;
+    indexed_fasta & operator=(const indexed_fasta &) = delete;
+
+    virtual ~indexed_fasta();
+
+    /* the number of records */
+    size_t size() const;
+
+    const fasta_index_entry & entry(size_t record) const;
+
+    const std::vector<fasta_index_entry> & index() const;
+
+    /* the record with the name, or size() if there isn't one */
+    size_t find(const std::string & name) const;
+
+    /* copies bases [begin, end) of the record into sequence, replacing what it held.  Throws
+       std::runtime_error if the record or range is out of bounds */
+    void fetch(size_t record, uint64_t begin, uint64_t end, std::string & sequence) const;
+
+    /* the whole record */
+    std::string fetch(size_t record) const;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include "unit_test.hpp"
 #include "fasta_reader.hpp"
 #include <fstream>
+#include <sstream>
 #include <string>
 
 class test_reader_t : public unit_test
@@ -14,8 +15,26 @@ class test_reader_t : public unit_test
         std::string desired1("GAACGGTCCGGCCGCATCCATTTCTTCCCTGTAGCGAATCGCGAAAATCGTCCGGAGTCTTAGTGTCTAAAGGTGGTTCACACGGAGATATGAGCGCGCC");
         std::string desired2("GCTAGGGCTTCCGGTTCCATGTGGAGATTAGCCCGTAAATTCAGATCCCGATCGCCACCACTCGATCAACTTTTCTTTAACATGTATTCATTTCCAATAA");
         check(std::string(r.get_sequence()) == desired1, "fasta_reader: first sequence read");
+        check(std::string(r.get_header()) == "SEQUENCE_0_length_100", "fasta_reader: first header read");
         check(r.next(), "FASTReader: second Next() call");
         check(std::string(r.get_sequence()) == desired2, "fasta_reader: second sequence read");
+
+        // reads of 150 bases on one line, and a line of a chromosome longer still, with windows line endings
+        std::string read150, line;
+        for (int i = 0;i < 150;i ++) read150 += "ACGT"[(i * 7 + i / 3) & 3];
+        for (int i = 0;i < 100;i ++) line += read150;
+        std::istringstream text(">read_1\n" + read150 + "\n>read_2\r\n" + read150 + "\r\n" + line + "\r\n>empty\n>read_3\n" + read150);
+        fasta_reader lines(&text);
+        check(lines.next() && std::string(lines.get_sequence()) == read150, "fasta_reader: single line record longer than 140 bases");
+        check(lines.next() && std::string(lines.get_sequence()) == read150 + line, "fasta_reader: long lines with windows line endings");
+        check(lines.next() && std::string(lines.get_header()) == "empty" && !*lines.get_sequence(), "fasta_reader: empty record");
+        check(lines.next() && std::string(lines.get_sequence()) == read150 && !lines.next(), "fasta_reader: last line without a line break");
+
+        std::string description(200, 'x');
+        std::istringstream long_header(">read_4 " + description + "\r\n" + read150 + "\n");
+        fasta_reader headers(&long_header);
+        check(headers.next() && std::string(headers.get_header()) == "read_4 " + description
+            && std::string(headers.get_sequence()) == read150, "fasta_reader: 200 character header");
     }
     
 } test_reader;
\ No newline at end of file
@@ -1,19 +1,19 @@
 #include "fasta_reader.hpp"
 #include <vector>
+#include <string>
 #include <algorithm>
 #include <stdexcept>
 
 
 #include <iostream>
-
-/* The maximum anticipated line size including terminating null - if exceeded it causes exceptions */
-const int MAXLINESIZE = 140;
     
 /* Private members and functions */
 struct fasta_reader::privates
 {
-    std::vector<char> header;
-    std::vector<char> buffer;
+    /* the header, the sequence, and the line being read into it - all reused from record to record */
+    std::string header;
+    std::string sequence;
+    std::string line;
     std::istream * inputFile;
 };
 
@@ -22,8 +22,6 @@ fasta_reader::fasta_reader(std::istream * inputFile)
 {
     m = new privates();
     m->inputFile = inputFile;
-    m->header.resize(MAXLINESIZE);
-    m->buffer.resize(MAXLINESIZE);
 }
     
 fasta_reader::~fasta_reader()
@@ -42,36 +40,31 @@ bool fasta_reader::next()
     // validate we have the beginning of sequence marker
     if (gt != '>') throw std::runtime_error("Expected > character but read something else");
     
-    // read until the end of the line
-    m->inputFile->getline(&m->header[0], m->header.size());
-    if (m->inputFile->fail()) throw std::runtime_error("Sequence header longer than maximum line size");
-    
-    // now we can start reading the sequence
-    size_t writePos = 0;
-    m->inputFile->getline(&m->buffer[writePos], m->buffer.size());
-    if (m->inputFile->fail()) throw std::runtime_error("Buffer line longer than maximum allowed line size");
+    // read until the end of the line, however long
+    std::getline(*m->inputFile, m->header);
+    if (!m->header.empty() && m->header[m->header.size() - 1] == '\r') m->header.resize(m->header.size() - 1);
     
-    // peak to see if we have more
-    gt = m->inputFile->peek();
-    while ( (gt != '>') && (gt != EOF) )
+    // now read the sequence lines, of any length, until the next header
+    m->sequence.clear();
+    int next = m->inputFile->peek();
+    while ( (next != '>') && (next != EOF) )
     {
-        // move writePos to the occurance of the null (that must exist as per getLine documentation)
-        writePos = std::find(m->buffer.begin()+writePos, m->buffer.end(), 0) - m->buffer.begin();
-        
-        // expand the buffer
-        m->buffer.resize(writePos + MAXLINESIZE);
-        
-        // read
-        m->inputFile->getline(&m->buffer[writePos], MAXLINESIZE);
-        if (m->inputFile->fail()) throw std::runtime_error("Subsequent buffer line longer than maximum allowed line size");
+        std::getline(*m->inputFile, m->line);
+        if (!m->line.empty() && m->line[m->line.size() - 1] == '\r') m->line.resize(m->line.size() - 1);
+        m->sequence += m->line;
 
         // and peek for the > on the next line
-        gt = m->inputFile->peek();
+        next = m->inputFile->peek();
     }
     return true;
 }
     
 const char * fasta_reader::get_sequence()
 {
-    return &m->buffer[0];
-}
\ No newline at end of file
+    return m->sequence.c_str();
+}
+
+const char * fasta_reader::get_header()
+{
+    return m->header.c_str();
+}
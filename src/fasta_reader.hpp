@@ -34,6 +34,9 @@ public:
        Returns null if Next() has not been called, or Next() returned false indicating end of file
        The pointer is valid until Next() is called again. */
     const char * get_sequence();
+    
+    /* Returns the current sequence's header line without the >, null-terminated.  Same validity as get_sequence() */
+    const char * get_header();
 };
 
 #endif
@@ -0,0 +1,125 @@
+#include "unit_test.hpp"
+#include "fastq_reader.hpp"
+#include "quality_mask.hpp"
+#include "kmer_scan.hpp"
+#include "bloomfilter_perfectcheat.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+class test_fastq_reader_t : public unit_test
+{
+    bool throws(const std::string & text)
+    {
+        std::istringstream in(text);
+        fastq_reader r(&in);
+        try { while (r.next()); }
+        catch (std::runtime_error &) { return true; }
+        return false;
+    }
+
+    void operator() ()
+    {
+        section("reading fastq");
+        std::istringstream in("@read1 first\nACGTN\n+\nII#II\r\n@read2\nGGCC\n+read2\n!!!!\n");
+        fastq_reader r(&in);
+        check(r.next(), "fastq_reader: first next() call");
+        check(std::string(r.get_header()) == "read1 first", "first header");
+        check(std::string(r.get_sequence()) == "ACGTN" && r.get_length() == 5, "first sequence");
+        check(std::string(r.get_quality()) == "II#II", "first quality, carriage return stripped");
+        check(r.next() && std::string(r.get_sequence()) == "GGCC" && std::string(r.get_quality()) == "!!!!", "second record");
+        check(!r.next(), "end of file");
+
+        check(throws("@read\nACGT\n+\nIII\n"), "quality shorter than sequence throws");
+        check(throws("@read\nACGT\n"), "truncated record throws");
+        check(throws("@read\nACGT\n-\nIIII\n"), "missing + line throws");
+        check(throws(">read\nACGT\n+\nIIII\n"), "record not starting with @ throws");
+
+        section("quality masks");
+        std::mt19937 rng(46);
+        std::string sequence(10007, 'A'), quality(sequence.size(), 'I');
+        for (size_t i = 0;i < sequence.size();i ++)
+        {
+            sequence[i] = rng() % 100 ? "ACGT"[rng() & 3] : "Nacgt"[rng() % 5];
+            quality[i] = 33 + rng() % 42;
+        }
+        const char min_quality = 33 + 10;
+        std::vector<uint64_t> scalar(quality_mask_words(sequence.size())), sse2(scalar.size(), ~0ULL),
+            avx2(scalar.size(), ~0ULL);
+        quality_mask_scalar(sequence.c_str(), quality.c_str(), sequence.size(), min_quality, scalar.data());
+        quality_mask_sse2(sequence.c_str(), quality.c_str(), sequence.size(), min_quality, sse2.data());
+        bool expected = true;
+        for (size_t i = 0;i < sequence.size();i ++)
+            expected &= ((scalar[i / 64] >> (i & 63)) & 1) == masked_base(sequence[i], quality[i], min_quality);
+        check(expected, "scalar mask has a bit for each low quality or non ACGT base");
+        check(sse2 == scalar, "sse2 mask matches scalar");
+        if (__builtin_cpu_supports("avx2"))
+        {
+            quality_mask_avx2(sequence.c_str(), quality.c_str(), sequence.size(), min_quality, avx2.data());
+            check(avx2 == scalar, "avx2 mask matches scalar");
+        }
+        check(next_mask_position(scalar.data(), 0, sequence.size(), true) ==
+            next_mask_position(scalar.data(), next_mask_position(scalar.data(), 0, sequence.size(), true), sequence.size(), true),
+            "next_mask_position of a set bit is itself");
+        uint64_t bases = ~0ULL;
+        base_mask("ACgtNa\xc3R", 8, &bases);
+        check(bases == 0xd0, "base mask has a bit for each non ACGT base, soft-masked bases aren't masked");
+
+        section("masked kmer scans");
+        // brute force: every kmer with no masked base
+        kmer_ops ops(15);
+        bloomfilter_perfectcheat<kmer_t> exact(1 << 16, 1);
+        size_t expected_kmers = 0;
+        std::vector<kmer_t> kmers;
+        for (size_t i = 0;i + 15 <= sequence.size();i ++)
+        {
+            bool clean = true;
+            for (size_t j = i;j < i + 15;j ++) clean &= !((scalar[j / 64] >> (j & 63)) & 1);
+            if (!clean) continue;
+            std::string bases = sequence.substr(i, 15);
+            const char * p = bases.c_str();
+            kmer_t kmer;
+            ops.read_first(&kmer, &p);
+            kmers.push_back(kmer);
+            expected_kmers ++;
+        }
+        std::vector<kmer_t> visited;
+        for_each_unmasked_kmer(ops, sequence.c_str(), sequence.size(), scalar.data(), [&](const kmer_t & kmer)
+        {
+            visited.push_back(kmer);
+        });
+        check(visited == kmers, "masked scan visits exactly the kmers clear of the mask");
+        size_t inserted = insert_kmers_masked(exact, ops, sequence.c_str(), sequence.size(), scalar.data());
+        size_t total = 0, hits = count_kmer_hits_masked(exact, ops, sequence.c_str(), sequence.size(), scalar.data(), &total);
+        check(inserted == expected_kmers && total == expected_kmers && hits == total, "masked insert and count agree");
+
+        std::vector<uint64_t> all(quality_mask_words(sequence.size()), ~0ULL);
+        total = 1;
+        check(count_kmer_hits_masked(exact, ops, sequence.c_str(), sequence.size(), all.data(), &total) == 0 && total == 0,
+            "fully masked read has no kmers");
+
+        const size_t iterations = 1000;
+        std::cout << "mask " << sequence.size() << " bases " << iterations << " times:" << std::endl;
+        {
+            scoped_timer t("\tscalar", iterations * sequence.size());
+            for (size_t i = 0;i < iterations;i ++)
+                quality_mask_scalar(sequence.c_str(), quality.c_str(), sequence.size(), min_quality, scalar.data());
+        }
+        {
+            scoped_timer t("\tsse2", iterations * sequence.size());
+            for (size_t i = 0;i < iterations;i ++)
+                quality_mask_sse2(sequence.c_str(), quality.c_str(), sequence.size(), min_quality, sse2.data());
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            scoped_timer t("\tavx2", iterations * sequence.size());
+            for (size_t i = 0;i < iterations;i ++)
+                quality_mask_avx2(sequence.c_str(), quality.c_str(), sequence.size(), min_quality, avx2.data());
+        }
+        std::cout << std::endl;
+    }
+} test_fastq_reader;
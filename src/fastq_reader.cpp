@@ -0,0 +1,71 @@
+#include "fastq_reader.hpp"
+#include <string>
+#include <stdexcept>
+
+/* Private members and functions */
+struct fastq_reader::privates
+{
+    std::string header;
+    std::string sequence;
+    std::string separator;
+    std::string quality;
+    std::istream * inputFile;
+
+    /* reads a line into line, dropping a windows line ending.  Returns false at end of file */
+    bool read_line(std::string & line)
+    {
+        if (!std::getline(*inputFile, line)) return false;
+        if (!line.empty() && line[line.size() - 1] == '\r') line.resize(line.size() - 1);
+        return true;
+    }
+};
+
+/* Public */
+fastq_reader::fastq_reader(std::istream * inputFile)
+{
+    m = new privates();
+    m->inputFile = inputFile;
+}
+    
+fastq_reader::~fastq_reader()
+{
+    delete m;
+}
+    
+bool fastq_reader::next()
+{
+    // ensure the next character is @
+    int at = m->inputFile->get();
+    
+    // check for end of file
+    if (at == EOF) return false; 
+    
+    // validate we have the beginning of record marker
+    if (at != '@') throw std::runtime_error("Expected @ character but read something else");
+    
+    if (!m->read_line(m->header) || !m->read_line(m->sequence) || !m->read_line(m->separator) || !m->read_line(m->quality))
+        throw std::runtime_error("Truncated FASTQ record");
+    if (m->separator.empty() || m->separator[0] != '+') throw std::runtime_error("Expected + line in FASTQ record");
+    if (m->quality.size() != m->sequence.size()) throw std::runtime_error("FASTQ quality and sequence lengths differ");
+    return true;
+}
+    
+const char * fastq_reader::get_sequence()
+{
+    return m->sequence.c_str();
+}
+
+const char * fastq_reader::get_quality()
+{
+    return m->quality.c_str();
+}
+
+const char * fastq_reader::get_header()
+{
+    return m->header.c_str();
+}
+
+size_t fastq_reader::get_length()
+{
+    return m->sequence.size();
+}
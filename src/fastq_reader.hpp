@@ -0,0 +1,44 @@
+/* 
+    Read FASTQ format files into internally re-used buffers
+
+    Each record is four lines: @header, the sequence, a + separator line and the quality string, one
+    character per base (phred + 33).  Sequences and qualities wrapped over several lines aren't supported.
+    See quality_mask.hpp for skipping the kmers that cover low quality bases.
+*/
+
+#ifndef __fastq_reader_HPP
+#define __fastq_reader_HPP
+#include <istream>
+#include <stddef.h>
+
+class fastq_reader
+{
+private:
+    /* pImpl pattern allows private members to be defined in cpp file */
+    struct privates;
+    privates * m;
+public:
+    /* next() must be called before any of the get methods.  Caller retains responsibility for disposing of
+       inputFile */
+    fastq_reader(std::istream * inputFile);
+    
+    virtual ~fastq_reader();
+    
+    /* Reads the next record.  Returns false at end of file, and throws std::runtime_error if the record is
+       malformed or its quality string isn't the length of its sequence */
+    bool next();
+    
+    /* The current record's sequence, null-terminated.  The pointer is valid until next() is called again */
+    const char * get_sequence();
+
+    /* The current record's quality string, null-terminated and get_length() long.  Same validity */
+    const char * get_quality();
+    
+    /* The current record's header line without the @, null-terminated.  Same validity */
+    const char * get_header();
+
+    /* The number of bases in the current record */
+    size_t get_length();
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "unit_test.hpp"
+#include "filter_codec.hpp"
+#include "bloomfilter_basic.hpp"
+#include "bloomfilter_vectorbool.hpp"
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include <sstream>
+#include <random>
+
+class test_filter_codec_t : public unit_test
+{
+    /* encodes and decodes a chunk, returning true if it comes back the same */
+    bool round_trip(const std::vector<uint8_t> & chunk, chunk_codec expected)
+    {
+        std::vector<uint8_t> payload;
+        chunk_codec codec = encode_chunk(&chunk[0], chunk.size(), payload);
+        std::vector<uint8_t> decoded(chunk.size());
+        decode_chunk_or(codec, &payload[0], payload.size(), &decoded[0], decoded.size());
+        return codec == expected && decoded == chunk;
+    }
+
+    void operator() ()
+    {
+        section("filter chunk codecs");
+        std::mt19937_64 rng(5);
+        std::vector<uint8_t> sparse(FILTER_CODEC_CHUNK_BYTES);
+        for (int i = 0;i < 200;i ++) sparse[rng() % sparse.size()] |= 1 << (rng() % 8);
+        check(round_trip(sparse, codec_elias_fano), "sparse chunk uses elias fano");
+        std::vector<uint8_t> dense(1000);
+        for (size_t i = 0;i < dense.size();i ++) dense[i] = rng();
+        check(round_trip(dense, codec_raw), "random chunk stays raw");
+        std::vector<uint8_t> runs(FILTER_CODEC_CHUNK_BYTES);
+        for (size_t i = 0;i < runs.size();i ++) runs[i] = (i / 100) % 2 ? 0xff : 0;
+        check(round_trip(runs, codec_deflate), "chunk with long runs uses deflate");
+        std::vector<uint8_t> empty(100);
+        check(round_trip(empty, codec_elias_fano), "empty chunk");
+
+        section("filter serialization");
+        typedef bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > filter_t;
+        const int m = 2000000;
+        filter_t a(m, 4);
+        filter_t b(m, 4);
+        for (kmer_t k = 0;k < 1000;k ++) a.set(k);
+        for (kmer_t k = 1000;k < 2000;k ++) b.set(k);
+
+        std::stringstream stream;
+        a.serialize(stream);
+        check(stream.str().size() < (size_t)m / 8 / 10, "sparse filter compresses");
+        filter_t copy(m, 4);
+        copy.deserialize(stream);
+        check(copy.count_set_bits() == a.count_set_bits() && copy.test(5) && !copy.test(1500), "deserialized copy");
+
+        std::stringstream stream_b;
+        b.serialize(stream_b);
+        copy.merge_serialized(stream_b);
+        bool all = true;
+        for (kmer_t k = 0;k < 2000;k ++) all &= copy.test(k);
+        check(all, "merge ORs the filters together");
+
+        // the bit layout is the same whatever the implementation
+        std::stringstream stream_c;
+        a.serialize(stream_c);
+        bloomfilter_vectorbool<kmer_t,kmer_fmix_hash<> > vb(m, 4);
+        vb.deserialize(stream_c);
+        check(vb.count_set_bits() == a.count_set_bits() && vb.test(999), "vector<bool> reads a serialized basic filter");
+
+        std::stringstream stream_d;
+        a.serialize(stream_d);
+        filter_t wrong(m, 5);
+        bool threw = false;
+        try { wrong.deserialize(stream_d); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "mismatched h is rejected");
+
+        std::stringstream truncated(stream.str().substr(0, 100));
+        threw = false;
+        try { copy.deserialize(truncated); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "truncated stream is rejected");
+
+        // cut in the last chunk, after the others have decoded fine
+        size_t before = copy.count_set_bits();
+        std::stringstream truncated_late(stream.str().substr(0, stream.str().size() - 10));
+        threw = false;
+        try { copy.deserialize(truncated_late); } catch (std::runtime_error &) { threw = true; }
+        all = true;
+        for (kmer_t k = 0;k < 2000;k ++) all &= copy.test(k);
+        check(threw && all && copy.count_set_bits() == before, "a rejected stream leaves the filter as it was");
+    }
+} test_filter_codec;
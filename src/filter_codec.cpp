@@ -0,0 +1,241 @@
+#include "filter_codec.hpp"
+#include "popcount.hpp"
+#include <stdexcept>
+#include <string.h>
+#include <zlib.h>
+
+/* appends bits to a byte vector, least significant bit first */
+class bit_writer
+{
+    std::vector<uint8_t> & out;
+    size_t start;
+    size_t position;
+public:
+    /* writing starts at the current end of out, and the space for bits is reserved up front */
+    bit_writer(std::vector<uint8_t> & out, size_t bits) : out(out), start(out.size()), position(0)
+    {
+        out.resize(start + (bits + 7) / 8, 0);
+    }
+
+    void write(uint64_t value, int bits)
+    {
+        for (int i = 0;i < bits;i ++, position ++)
+            if ((value >> i) & 1) out[start + position / 8] |= 1 << (position & 7);
+    }
+
+    void set(size_t bit)
+    {
+        out[start + bit / 8] |= 1 << (bit & 7);
+    }
+};
+
+static uint64_t read_bits(const uint8_t * data, size_t position, int bits)
+{
+    uint64_t value = 0;
+    for (int i = 0;i < bits;i ++, position ++)
+        value |= (uint64_t)((data[position / 8] >> (position & 7)) & 1) << i;
+    return value;
+}
+
+static void put_u32(std::vector<uint8_t> & out, uint32_t value)
+{
+    for (int i = 0;i < 4;i ++) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+static uint32_t get_u32(const uint8_t * data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/* the number of low bits per position for n positions out of universe */
+static int elias_fano_low_bits(size_t universe, size_t n)
+{
+    int l = 0;
+    while (n && (universe / n) >> (l + 1)) l ++;
+    return l;
+}
+
+static size_t elias_fano_size(size_t universe, size_t n)
+{
+    // an empty chunk is just the header
+    if (!n) return 5;
+    int l = elias_fano_low_bits(universe, n);
+    return 5 + (n * l + 7) / 8 + (n + (universe >> l) + 1 + 7) / 8;
+}
+
+/* payload: n(u32) l(u8) low bits (n*l) then the high parts in unary (n + (universe >> l) + 1 bits) */
+static void elias_fano_encode(const uint8_t * chunk, size_t bytes, size_t n, std::vector<uint8_t> & payload)
+{
+    size_t universe = bytes * 8;
+    int l = elias_fano_low_bits(universe, n);
+    put_u32(payload, n);
+    payload.push_back((uint8_t)l);
+    if (!n) return;
+    {
+        bit_writer low(payload, n * l);
+        for (size_t byte = 0;byte < bytes;byte ++)
+        {
+            for (uint8_t b = chunk[byte];b;b &= b - 1)
+                low.write((byte * 8 + __builtin_ctz(b)) & ((1ULL << l) - 1), l);
+        }
+    }
+    bit_writer high(payload, n + (universe >> l) + 1);
+    size_t i = 0;
+    for (size_t byte = 0;byte < bytes;byte ++)
+    {
+        for (uint8_t b = chunk[byte];b;b &= b - 1, i ++)
+            high.set(((byte * 8 + __builtin_ctz(b)) >> l) + i);
+    }
+}
+
+static void elias_fano_decode_or(const uint8_t * payload, size_t payload_bytes, uint8_t * out, size_t bytes)
+{
+    if (payload_bytes < 5) throw std::runtime_error("Elias-Fano chunk too short");
+    size_t n = get_u32(payload);
+    int l = payload[4];
+    size_t universe = bytes * 8;
+    if (l > 32 || payload_bytes < elias_fano_size(universe, n)) throw std::runtime_error("Elias-Fano chunk corrupt");
+    const uint8_t * low = payload + 5;
+    const uint8_t * high = low + (n * l + 7) / 8;
+    size_t high_bits = n + (universe >> l) + 1;
+    size_t i = 0;
+    for (size_t bit = 0;bit < high_bits && i < n;bit ++)
+    {
+        if (!((high[bit / 8] >> (bit & 7)) & 1)) continue;
+        size_t position = ((bit - i) << l) | read_bits(low, i * l, l);
+        if (position >= universe) throw std::runtime_error("Elias-Fano chunk corrupt");
+        out[position / 8] |= 1 << (position & 7);
+        i ++;
+    }
+    if (i != n) throw std::runtime_error("Elias-Fano chunk corrupt");
+}
+
+chunk_codec encode_chunk(const uint8_t * chunk, size_t bytes, std::vector<uint8_t> & payload)
+{
+    payload.clear();
+    chunk_codec best = codec_raw;
+    size_t best_size = bytes;
+
+    size_t n = popcount_bytes(chunk, bytes);
+    if (elias_fano_size(bytes * 8, n) < best_size)
+    {
+        best = codec_elias_fano;
+        best_size = elias_fano_size(bytes * 8, n);
+    }
+
+    // only bother with deflate if there's something to gain over elias fano
+    if (best_size > 64)
+    {
+        std::vector<uint8_t> deflated(compressBound(bytes));
+        uLongf deflated_size = deflated.size();
+        if (compress2(&deflated[0], &deflated_size, chunk, bytes, 1) == Z_OK && deflated_size < best_size)
+        {
+            deflated.resize(deflated_size);
+            payload.swap(deflated);
+            return codec_deflate;
+        }
+    }
+
+    if (best == codec_elias_fano) elias_fano_encode(chunk, bytes, n, payload);
+    else payload.assign(chunk, chunk + bytes);
+    return best;
+}
+
+void decode_chunk_or(chunk_codec codec, const uint8_t * payload, size_t payload_bytes, uint8_t * out, size_t bytes)
+{
+    switch (codec)
+    {
+    case codec_raw:
+        if (payload_bytes != bytes) throw std::runtime_error("Raw chunk has the wrong size");
+        for (size_t i = 0;i < bytes;i ++) out[i] |= payload[i];
+        break;
+    case codec_elias_fano:
+        elias_fano_decode_or(payload, payload_bytes, out, bytes);
+        break;
+    case codec_deflate:
+    {
+        // inflate a piece at a time so we only need a small buffer on top of out
+        uint8_t buffer[4096];
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+        if (inflateInit(&z) != Z_OK) throw std::runtime_error("inflateInit failed");
+        z.next_in = (Bytef *)payload;
+        z.avail_in = payload_bytes;
+        size_t written = 0;
+        int status = Z_OK;
+        while (status == Z_OK)
+        {
+            z.next_out = buffer;
+            z.avail_out = sizeof(buffer);
+            status = inflate(&z, Z_NO_FLUSH);
+            size_t got = sizeof(buffer) - z.avail_out;
+            if (written + got > bytes) status = Z_DATA_ERROR;
+            else for (size_t i = 0;i < got;i ++) out[written + i] |= buffer[i];
+            written += got;
+        }
+        inflateEnd(&z);
+        if (status != Z_STREAM_END || written != bytes) throw std::runtime_error("Deflate chunk corrupt");
+        break;
+    }
+    default:
+        throw std::runtime_error("Unknown chunk codec");
+    }
+}
+
+static void write_u32(std::ostream & out, uint32_t value)
+{
+    uint8_t bytes[4];
+    for (int i = 0;i < 4;i ++) bytes[i] = (uint8_t)(value >> (8 * i));
+    out.write((const char *)bytes, 4);
+}
+
+static uint32_t read_u32(std::istream & in)
+{
+    uint8_t bytes[4];
+    if (!in.read((char *)bytes, 4)) throw std::runtime_error("Unexpected end of serialized filter");
+    return get_u32(bytes);
+}
+
+void write_codec_header(std::ostream & out, const filter_codec_header & header)
+{
+    out.write("BLMF", 4);
+    write_u32(out, FILTER_CODEC_VERSION);
+    write_u32(out, (uint32_t)header.m);
+    write_u32(out, (uint32_t)(header.m >> 32));
+    write_u32(out, header.h);
+    write_u32(out, header.chunk_bytes);
+    write_u32(out, header.chunk_count);
+}
+
+filter_codec_header read_codec_header(std::istream & in)
+{
+    char magic[4];
+    if (!in.read(magic, 4) || memcmp(magic, "BLMF", 4)) throw std::runtime_error("Not a serialized filter");
+    if (read_u32(in) != FILTER_CODEC_VERSION) throw std::runtime_error("Unsupported serialized filter version");
+    filter_codec_header header;
+    header.m = read_u32(in);
+    header.m |= (uint64_t)read_u32(in) << 32;
+    header.h = read_u32(in);
+    header.chunk_bytes = read_u32(in);
+    header.chunk_count = read_u32(in);
+    if (header.chunk_bytes == 0 || header.chunk_count != filter_codec_chunk_count(header.m, header.chunk_bytes))
+        throw std::runtime_error("Serialized filter header corrupt");
+    return header;
+}
+
+void write_chunk(std::ostream & out, chunk_codec codec, const std::vector<uint8_t> & payload)
+{
+    out.put((char)codec);
+    write_u32(out, payload.size());
+    if (!payload.empty()) out.write((const char *)&payload[0], payload.size());
+}
+
+chunk_codec read_chunk(std::istream & in, std::vector<uint8_t> & payload)
+{
+    int codec = in.get();
+    if (codec == EOF) throw std::runtime_error("Unexpected end of serialized filter");
+    size_t bytes = read_u32(in);
+    payload.resize(bytes);
+    if (bytes && !in.read((char *)&payload[0], bytes)) throw std::runtime_error("Unexpected end of serialized filter");
+    return (chunk_codec)codec;
+}
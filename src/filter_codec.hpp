@@ -0,0 +1,65 @@
+/*
+    Compression of filter bit arrays for sending between nodes or writing to disk - see bloomfilter::serialize()
+
+    The bit array is cut into 64KB chunks and each chunk is stored with whichever codec makes it smallest:
+        raw        - the bytes as they are (a well filled filter is close to random, so this is usually it)
+        elias_fano - the positions of the set bits, Elias-Fano coded: about 2 + log2(chunk bits / set bits)
+                     bits per set bit, so sparse chunks shrink enormously
+        deflate    - zlib at its fastest level, for anything with other structure
+
+    Layout (all integers little endian):
+        "BLMF" version(u32) m(u64) h(u32) chunk_bytes(u32) chunk_count(u32)
+        then per chunk: codec(u8) payload_bytes(u32) payload
+
+    Decoding ORs each chunk into the destination, so a stream can be merged into an existing filter one chunk at
+    a time without ever holding the uncompressed filter in memory.
+*/
+#ifndef __FILTER_CODEC_HPP
+#define __FILTER_CODEC_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+enum chunk_codec { codec_raw = 0, codec_elias_fano = 1, codec_deflate = 2 };
+
+const uint32_t FILTER_CODEC_VERSION = 1;
+
+/* bytes of bit array per chunk */
+const size_t FILTER_CODEC_CHUNK_BYTES = 65536;
+
+/* the header at the start of a serialized filter */
+struct filter_codec_header
+{
+    uint64_t m;
+    uint32_t h;
+    uint32_t chunk_bytes;
+    uint32_t chunk_count;
+};
+
+/* the number of chunks needed for m bits */
+inline uint32_t filter_codec_chunk_count(uint64_t m, size_t chunk_bytes)
+{
+    return (uint32_t)(((m + 7) / 8 + chunk_bytes - 1) / chunk_bytes);
+}
+
+/* compresses bytes of bit array into payload with the codec that gives the smallest result, which is returned */
+chunk_codec encode_chunk(const uint8_t * chunk, size_t bytes, std::vector<uint8_t> & payload);
+
+/* decodes payload and ORs the result into out, which is bytes long.  Throws std::runtime_error if the
+   payload is corrupt */
+void decode_chunk_or(chunk_codec codec, const uint8_t * payload, size_t payload_bytes, uint8_t * out, size_t bytes);
+
+void write_codec_header(std::ostream & out, const filter_codec_header & header);
+
+/* throws std::runtime_error if the stream doesn't start with a valid header */
+filter_codec_header read_codec_header(std::istream & in);
+
+/* writes one chunk */
+void write_chunk(std::ostream & out, chunk_codec codec, const std::vector<uint8_t> & payload);
+
+/* reads one chunk into payload, returning its codec */
+chunk_codec read_chunk(std::istream & in, std::vector<uint8_t> & payload);
+
+#endif
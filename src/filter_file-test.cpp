@@ -0,0 +1,45 @@
+#include "unit_test.hpp"
+#include "filter_file.hpp"
+#include "kmer_scan.hpp"
+#include <stdio.h>
+
+class test_filter_file_t : public unit_test
+{
+    void operator() ()
+    {
+        section("filter files");
+        const char * path = "/tmp/bloom-filter-file-test.blm";
+        const int k = 25;
+        kmer_ops ops(k);
+
+        kmer_filter filter(100003, 4);
+        const char * sequence = "GAACGGTCCGGCCGCATCCATTTCTTCCCTGTAGCGAATCGCGAAAATCGTCCGGAGTCT";
+        size_t kmers = insert_kmers(filter, ops, sequence);
+        write_filter_file(path, filter, k);
+
+        filter_file_header header = read_filter_file_header(path);
+        check(header.k == k && header.m == 100003 && header.h == 4, "filter file header reads back");
+
+        std::unique_ptr<kmer_filter> mapped = map_filter_file(path, header);
+        size_t total;
+        check(count_kmer_hits(*mapped, ops, sequence, &total) == kmers && total == kmers, "mapped filter finds every kmer");
+        check(mapped->count_set_bits() == filter.count_set_bits(), "mapped filter has the same bits set");
+        mapped->add(12345);
+        check(read_filter_file_header(path).m == 100003 && !map_filter_file(path, header)->test(12345), 
+            "writes to a mapped filter don't reach the file");
+
+        typedef kmer_filter_type<kmer128_t>::type long_filter;
+        fixed_kmer_ops<51> long_ops;
+        long_filter long_kmers(100003, 4);
+        kmers = insert_kmers(long_kmers, long_ops, sequence);
+        write_filter_file(path, long_kmers, 51);
+        std::unique_ptr<long_filter> long_mapped = map_filter_file<long_filter>(path, header);
+        check(header.k == 51 && count_kmer_hits(*long_mapped, long_ops, sequence, &total) == kmers,
+            "long kmer filters map back");
+
+        remove(path);
+        bool threw = false;
+        try { read_filter_file_header(path); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "missing filter file throws");
+    }
+} test_filter_file;
@@ -0,0 +1,66 @@
+#include "filter_file.hpp"
+#include <fstream>
+#include <vector>
+#include <stdexcept>
+#include <string.h>
+
+/* the bytes of storage kmer_filter allocates for m bits: whole 64 bit blocks plus room to (mis)align */
+static uint64_t storage_bytes(uint64_t m)
+{
+    return (m + 63) / 64 * 8 + 8;
+}
+
+static void put_u32(uint8_t * out, uint32_t value)
+{
+    for (int i = 0;i < 4;i ++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const uint8_t * data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+void write_filter_file(const std::string & path, int k, uint64_t m, int h,
+    const std::function<void(size_t first, size_t bytes, uint8_t * chunk)> & read_bits)
+{
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Could not create " + path);
+
+    std::vector<uint8_t> chunk(FILTER_FILE_HEADER_BYTES, 0);
+    memcpy(&chunk[0], "BLMK", 4);
+    put_u32(&chunk[4], FILTER_FILE_VERSION);
+    put_u32(&chunk[8], k);
+    put_u32(&chunk[12], (uint32_t)m);
+    put_u32(&chunk[16], (uint32_t)(m >> 32));
+    put_u32(&chunk[20], h);
+    out.write((const char *)&chunk[0], chunk.size());
+
+    uint64_t bytes = storage_bytes(m);
+    uint64_t bit_bytes = (m + 7) / 8;
+    chunk.resize(FILTER_CODEC_CHUNK_BYTES);
+    for (uint64_t first = 0;first < bytes;first += chunk.size())
+    {
+        size_t todo = std::min((uint64_t)chunk.size(), bytes - first);
+        memset(&chunk[0], 0, todo);
+        if (first < bit_bytes) read_bits(first, std::min((uint64_t)todo, bit_bytes - first), &chunk[0]);
+        out.write((const char *)&chunk[0], todo);
+    }
+    out.close();
+    if (out.fail()) throw std::runtime_error("Could not write " + path);
+}
+
+filter_file_header read_filter_file_header(const std::string & path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    uint8_t data[24];
+    if (!in.read((char *)data, sizeof(data)) || memcmp(data, "BLMK", 4))
+        throw std::runtime_error("Not a filter file: " + path);
+    if (get_u32(data + 4) != FILTER_FILE_VERSION) throw std::runtime_error("Unsupported filter file version: " + path);
+    filter_file_header header;
+    header.k = get_u32(data + 8);
+    header.m = get_u32(data + 12) | ((uint64_t)get_u32(data + 16) << 32);
+    header.h = get_u32(data + 20);
+    if (header.m == 0 || header.h <= 0 || header.k <= 0 || header.k > (int)KMER_DISPATCH_MAX_LENGTH)
+        throw std::runtime_error("Filter file header corrupt: " + path);
+    return header;
+}
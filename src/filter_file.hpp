@@ -0,0 +1,86 @@
+/*
+    A kmer filter on disk in a form that can be mapped straight back into memory
+
+    Unlike bloomfilter::serialize(), which compresses, this writes the bit array as it is held in memory so
+    map_filter_file() can hand back a working filter without reading the file - pages come in as queries touch
+    them (see storage_options::file).  This is what bloom-build writes and bloom-classify reads.
+
+    k can be anything dispatch_kmer_length() handles; kmer_filter_type<kmer type>::type is the filter for the
+    kmer type it picks, e.g. map_filter_file<kmer_filter_type<kmer128_t>::type>(path, header) for k 33-64.
+
+    Layout (integers little endian):
+        "BLMK" version(u32) k(u32) m(u64) h(u32), zero padded to 4KB
+        the bit array, padded to the filter's storage size
+*/
+#ifndef __FILTER_FILE_HPP
+#define __FILTER_FILE_HPP
+#include "bloomfilter_basic.hpp"
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include "kmer_dispatch.hpp"
+#include <string>
+#include <memory>
+#include <functional>
+
+/* the filter the command line tools build and query */
+typedef bloomfilter_basic<kmer_t, uint64_t, kmer_fmix_hash<> > kmer_filter;
+
+/* the same filter for the other kmer types, with the hash that agrees with kmer_fmix_hash on one word */
+template<typename kmer_type>
+struct kmer_filter_type
+{
+    typedef long_kmer_hash<kmer_type> hash;
+    typedef bloomfilter_basic<kmer_type, uint64_t, hash> type;
+};
+
+template<>
+struct kmer_filter_type<uint64_t>
+{
+    typedef kmer_fmix_hash<> hash;
+    typedef kmer_filter type;
+};
+
+const uint32_t FILTER_FILE_VERSION = 1;
+
+/* the header is padded to a page so the bit array can be mapped */
+const uint64_t FILTER_FILE_HEADER_BYTES = 4096;
+
+struct filter_file_header
+{
+    /* the length of the kmers that were inserted */
+    int k;
+    uint64_t m;
+    int h;
+};
+
+/* writes the m bit filter, read through read_bits (see bloomfilter::read_bits), to path.  Throws
+   std::runtime_error on failure */
+void write_filter_file(const std::string & path, int k, uint64_t m, int h,
+    const std::function<void(size_t first, size_t bytes, uint8_t * chunk)> & read_bits);
+
+/* writes filter, which holds kmers of length k, to path.  Throws std::runtime_error on failure */
+template<typename index_t>
+void write_filter_file(const std::string & path, const bloomfilter<index_t> & filter, int k)
+{
+    write_filter_file(path, k, filter.getm(), filter.geth(), [&filter](size_t first, size_t bytes, uint8_t * chunk)
+    {
+        filter.read_bits(first, bytes, chunk);
+    });
+}
+
+/* reads the header of a file written by write_filter_file.  Throws std::runtime_error if it isn't one */
+filter_file_header read_filter_file_header(const std::string & path);
+
+/* maps the filter in the file at path, filling in header.  Writes to the filter stay in memory */
+template<typename filter_t = kmer_filter>
+std::unique_ptr<filter_t> map_filter_file(const std::string & path, filter_file_header & header,
+    const storage_options & options = storage_options())
+{
+    header = read_filter_file_header(path);
+    storage_options mapping = options;
+    mapping.file = path.c_str();
+    mapping.file_offset = FILTER_FILE_HEADER_BYTES;
+    return std::unique_ptr<filter_t>(new filter_t(header.m, header.h, mapping));
+}
+
+#endif
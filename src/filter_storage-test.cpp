@@ -0,0 +1,91 @@
+#include "unit_test.hpp"
+#include "filter_storage.hpp"
+#include "bloomfilter_basic.hpp"
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include <algorithm>
+#include <vector>
+#include <thread>
+
+class test_filter_storage_t : public unit_test
+{
+    static bool all_zero(const filter_storage & s)
+    {
+        return std::count(s.data(), s.data() + s.size(), 0) == (long)s.size();
+    }
+
+    void operator() ()
+    {
+        section("filter storage");
+        filter_storage small(1000);
+        check((size_t)small.data() % 64 == 0, "small allocation is 64 byte aligned");
+        check(all_zero(small), "small allocation is zeroed");
+
+        storage_options options;
+        options.prefault_threads = 4;
+        filter_storage large(5 << 20, options);
+        check((size_t)large.data() % 64 == 0, "mmapped allocation is 64 byte aligned");
+        check(all_zero(large), "mmapped, prefaulted allocation is zeroed");
+
+        options.huge_pages = true;
+        filter_storage huge(3 << 20, options);
+        check((size_t)huge.data() % (2 << 20) == 0, "huge page allocation is 2MB aligned");
+
+        storage_arena arena(1 << 20);
+        storage_options from_arena;
+        from_arena.arena = &arena;
+        filter_storage a(1000, from_arena);
+        filter_storage b(1000, from_arena);
+        check(b.data() >= a.data() + 1000 && (size_t)b.data() % 64 == 0, "arena allocations don't overlap");
+        check(arena.available() < (1 << 20) - 2000, "arena space is used");
+
+        bool threw = false;
+        try { filter_storage too_big(2 << 20, from_arena); } catch (std::bad_alloc &) { threw = true; }
+        check(threw, "full arena throws bad_alloc");
+
+        // filters sharing an arena
+        bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > bf1(10000, 5, from_arena);
+        bloomfilter_basic<kmer_t,uint8_t,kmer_fmix_hash<>,3> bf2(10000, 5, from_arena);
+        bf1.set(42);
+        bf2.set(43);
+        check(bf1.test(42) && !bf1.test(43) && bf2.test(43) && !bf2.test(42), "filters in one arena are independent");
+
+        section("clearing filter storage");
+        storage_options parallel;
+        parallel.clear_threads = 3;
+        filter_storage streamed((3 << 20) + 5, parallel);
+        std::fill(streamed.data(), streamed.data() + streamed.size(), 0xff);
+        streamed.clear();
+        check(all_zero(streamed), "parallel streaming clear zeroes everything");
+
+        storage_options dirty;
+        dirty.track_dirty = true;
+        filter_storage tracked(100000, dirty);
+        check(tracked.tracks_dirty(), "dirty tracking enabled");
+        tracked.data()[5] = 1;
+        tracked.mark_dirty(5);
+        tracked.data()[99999] = 1;
+        tracked.mark_dirty(99999);
+        // not marked, so should survive the clear
+        tracked.data()[50000] = 1;
+        tracked.clear();
+        check(tracked.data()[5] == 0 && tracked.data()[99999] == 0, "dirty regions are zeroed");
+        check(tracked.data()[50000] == 1, "clean regions are left alone");
+
+        bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<>,5> bf3(1000000, 5, dirty);
+        kmer_t kmers[100];
+        for (int i = 0;i < 100;i ++) kmers[i] = i * 7919;
+        bf3.set_batch(kmers, 50);
+        for (int i = 50;i < 100;i ++) bf3.set(kmers[i]);
+        bf3.clear();
+        check(bf3.count_set_bits() == 0, "clear with dirty tracking empties the filter");
+
+        // several threads marking the regions they write at once
+        std::vector<std::thread> workers;
+        for (int t = 0;t < 4;t ++)
+            workers.push_back(std::thread([&bf3, t]() { for (int i = t;i < 20000;i += 4) bf3.add_concurrent(i * 7919); }));
+        for (auto w = workers.begin();w != workers.end();w ++) w->join();
+        bf3.clear();
+        check(bf3.count_set_bits() == 0, "clear with dirty tracking after add_concurrent empties the filter");
+    }
+} test_filter_storage;
@@ -0,0 +1,219 @@
+#include "filter_storage.hpp"
+#include <new>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <string>
+#include <emmintrin.h>
+
+/* sizes at or above this are mmapped */
+const size_t MMAP_THRESHOLD = 2 << 20;
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+const size_t STORAGE_PAGE_SIZE = 4096;
+
+/* sizes at or above this are cleared with non-temporal stores rather than memset */
+const size_t STREAM_THRESHOLD = 1 << 20;
+
+static size_t round_up(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/* runs work(start, length) over [0, bytes) split into page aligned slices, one per thread */
+template<typename work_t>
+static void split_across_threads(size_t bytes, unsigned int threads, work_t work)
+{
+    if (threads <= 1 || bytes < STORAGE_PAGE_SIZE * threads)
+    {
+        work(0, bytes);
+        return;
+    }
+    size_t slice = round_up((bytes + threads - 1) / threads, STORAGE_PAGE_SIZE);
+    std::vector<std::thread> workers;
+    for (size_t start = 0;start < bytes;start += slice)
+        workers.push_back(std::thread(work, start, std::min(slice, bytes - start)));
+    for (auto i = workers.begin();i != workers.end();i ++) i->join();
+}
+
+void filter_storage::prefault(uint8_t * data, size_t bytes, unsigned int threads)
+{
+    split_across_threads(bytes, threads, [data](size_t start, size_t length)
+    {
+        // volatile so the writes of zero to zeroed memory aren't optimised away
+        volatile uint8_t * p = data + start;
+        for (size_t i = 0;i < length;i += STORAGE_PAGE_SIZE) p[i] = 0;
+    });
+}
+
+void filter_storage::parallel_zero(uint8_t * data, size_t bytes, unsigned int threads)
+{
+    split_across_threads(bytes, threads, [data](size_t start, size_t length)
+    {
+        memset(data + start, 0, length);
+    });
+}
+
+/* zeroes with 16 byte non-temporal stores, bypassing the cache */
+static void stream_zero(uint8_t * data, size_t bytes)
+{
+    // memset up to the first 16 byte boundary, and the tail
+    size_t head = std::min(bytes, (16 - ((size_t)data & 15)) & 15);
+    memset(data, 0, head);
+    data += head;
+    bytes -= head;
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (;i + 64 <= bytes;i += 64)
+    {
+        _mm_stream_si128((__m128i *)(data + i), zero);
+        _mm_stream_si128((__m128i *)(data + i + 16), zero);
+        _mm_stream_si128((__m128i *)(data + i + 32), zero);
+        _mm_stream_si128((__m128i *)(data + i + 48), zero);
+    }
+    memset(data + i, 0, bytes - i);
+    // make the streamed stores visible before anyone else reads the memory
+    _mm_sfence();
+}
+
+void filter_storage::clear_memory(uint8_t * data, size_t bytes, unsigned int threads)
+{
+    if (bytes < STREAM_THRESHOLD)
+    {
+        memset(data, 0, bytes);
+        return;
+    }
+    split_across_threads(bytes, threads, [data](size_t start, size_t length)
+    {
+        stream_zero(data + start, length);
+    });
+}
+
+void filter_storage::fold_memory(uint8_t * data, size_t bytes, size_t folded_bytes)
+{
+    // a block of the first slice at a time, ORing in the matching block of every other slice, so each byte is
+    // read once and the destination block stays in cache while we stream through the sources
+    const size_t block = 4096;
+    for (size_t start = 0;start < folded_bytes;start += block)
+    {
+        size_t length = std::min(block, folded_bytes - start);
+        uint8_t * target = data + start;
+        for (size_t source = folded_bytes + start;source < bytes;source += folded_bytes)
+        {
+            const uint8_t * from = data + source;
+            size_t i = 0;
+            for (;i + 64 <= length;i += 64)
+            {
+                for (size_t j = 0;j < 64;j += 16)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(target + i + j));
+                    __m128i b = _mm_loadu_si128((const __m128i *)(from + i + j));
+                    _mm_storeu_si128((__m128i *)(target + i + j), _mm_or_si128(a, b));
+                }
+            }
+            for (;i < length;i ++) target[i] |= from[i];
+        }
+    }
+    clear_memory(data + folded_bytes, bytes - folded_bytes, 1);
+}
+
+void filter_storage::clear()
+{
+    if (dirty.empty())
+    {
+        clear_memory(base, bytes, clear_threads);
+        return;
+    }
+    for (size_t region = 0;region < dirty.size();region ++)
+    {
+        if (!dirty[region]) continue;
+        size_t start = region << dirty_region_bits;
+        memset(base + start, 0, std::min(dirty_region_size, bytes - start));
+        dirty[region] = 0;
+    }
+}
+
+filter_storage::filter_storage(size_t bytes, const storage_options & options)
+    : base(0), bytes(bytes), allocated(0), mapped(0), clear_threads(options.clear_threads)
+{
+    if (options.track_dirty) dirty.resize((bytes + dirty_region_size - 1) / dirty_region_size);
+    size_t alignment = options.huge_pages ? std::max(options.alignment, HUGE_PAGE_SIZE) : options.alignment;
+    if (options.arena)
+    {
+        // arena memory is already zeroed (and prefaulted if the arena was)
+        base = options.arena->allocate(bytes, alignment);
+        return;
+    }
+
+    if (options.file)
+    {
+        int fd = open(options.file, O_RDONLY);
+        if (fd < 0) throw std::runtime_error(std::string("Could not open ") + options.file);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < options.file_offset + bytes)
+        {
+            close(fd);
+            throw std::runtime_error(std::string("File too short to map: ") + options.file);
+        }
+        // mmap offsets have to be page aligned
+        uint64_t start = options.file_offset / STORAGE_PAGE_SIZE * STORAGE_PAGE_SIZE;
+        mapped = options.file_offset - start + bytes;
+        // prefault() would write zeroes over the contents, so have the kernel read the pages in instead
+        int flags = MAP_PRIVATE | (options.prefault_threads ? MAP_POPULATE : 0);
+        void * p = mmap(0, mapped, PROT_READ | PROT_WRITE, flags, fd, start);
+        close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error(std::string("Could not map ") + options.file);
+        allocated = p;
+        base = (uint8_t *)p + (options.file_offset - start);
+        return;
+    }
+
+    if (options.huge_pages || bytes >= MMAP_THRESHOLD)
+    {
+        // over-allocate so we can align within the mapping
+        size_t length = round_up(bytes, options.huge_pages ? HUGE_PAGE_SIZE : STORAGE_PAGE_SIZE);
+        mapped = length + (alignment > STORAGE_PAGE_SIZE ? alignment : 0);
+        void * p = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        allocated = p;
+        base = (uint8_t *)round_up((size_t)p, alignment);
+#ifdef MADV_HUGEPAGE
+        if (options.huge_pages) madvise(base, length, MADV_HUGEPAGE);
+#endif
+        if (options.prefault_threads) prefault(base, bytes, options.prefault_threads);
+        return;
+    }
+
+    // aligned_alloc requires the size to be a multiple of the alignment
+    allocated = aligned_alloc(alignment, round_up(std::max(bytes, (size_t)1), alignment));
+    if (!allocated) throw std::bad_alloc();
+    base = (uint8_t *)allocated;
+    parallel_zero(base, bytes, options.prefault_threads);
+}
+
+filter_storage::~filter_storage()
+{
+    if (mapped) munmap(allocated, mapped);
+    else free(allocated);
+}
+
+storage_arena::storage_arena(size_t bytes, const storage_options & options)
+    : storage(bytes, [&options]() { storage_options o = options; o.arena = 0; return o; }()), used(0)
+{
+}
+
+uint8_t * storage_arena::allocate(size_t bytes, size_t alignment)
+{
+    size_t start = round_up((size_t)storage.data() + used, alignment) - (size_t)storage.data();
+    if (start > storage.size() || bytes > storage.size() - start) throw std::bad_alloc();
+    used = start + bytes;
+    return storage.data() + start;
+}
@@ -0,0 +1,150 @@
+/*
+    Zeroed, aligned memory for the filters' bit arrays
+
+    filter_storage allocates
+        - small sizes with aligned_alloc (and zeroes them)
+        - sizes of 2MB or more, or whenever huge pages are requested, with an anonymous mmap - the kernel
+          hands these out already zeroed, so there's no need for the filters to memset them
+        - or carves them out of a storage_arena, so several filters can share one mapping
+
+    With file set, the memory is a private (copy on write) mapping of that file from file_offset on, so a filter
+    written to disk can be used without reading it in - pages are only read as they are touched and the kernel
+    can drop them again under memory pressure.  Writes to the filter never reach the file.
+
+    Untouched mmapped pages are only faulted in on first write, which for a large filter means the first
+    few seconds of inserts are mostly page faults on a single thread.  Setting prefault_threads touches every
+    page up front, split across that many threads.
+
+    clear() zeroes the memory again for filters that are reset over and over.  Large areas are zeroed with
+    non-temporal stores (so the zeroes don't evict everything else from the cache) split across
+    clear_threads threads.  If track_dirty is set the filter calls mark_dirty() for every byte it writes and
+    clear() only zeroes the dirty_region_size regions that were touched since the last clear().
+*/
+#ifndef __FILTER_STORAGE_HPP
+#define __FILTER_STORAGE_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+class storage_arena;
+
+/* how to allocate a filter's storage */
+struct storage_options
+{
+    /* the alignment of the returned memory in bytes (a power of two) - 64 is a cache line */
+    size_t alignment;
+
+    /* align to 2MB and ask for transparent huge pages, to cut TLB misses on large filters */
+    bool huge_pages;
+
+    /* if non-zero, fault in every page using this many threads before returning */
+    unsigned int prefault_threads;
+
+    /* if set, the memory comes from this arena, which must outlive the filter */
+    storage_arena * arena;
+
+    /* the number of threads clear() splits large areas across */
+    unsigned int clear_threads;
+
+    /* record which regions are written so clear() only zeroes those */
+    bool track_dirty;
+
+    /* if set, map the contents of this file (starting at file_offset) rather than allocating zeroed memory.
+       file_offset should be a multiple of alignment for the memory to be aligned */
+    const char * file;
+    uint64_t file_offset;
+
+    storage_options() : alignment(64), huge_pages(false), prefault_threads(0), arena(0), clear_threads(1), 
+        track_dirty(false), file(0), file_offset(0) {}
+};
+
+class filter_storage
+{
+private:
+    uint8_t * base;
+    size_t bytes;
+    /* what we have to give back on destruction: mapped is non-zero for mmap, and both are 0 for arena memory */
+    void * allocated;
+    size_t mapped;
+    unsigned int clear_threads;
+    /* a flag per dirty region - empty unless track_dirty was set */
+    std::vector<uint8_t> dirty;
+public:
+    static const int dirty_region_bits = 12;
+    static const size_t dirty_region_size = 1 << dirty_region_bits;
+
+    /* allocates at least bytes of zeroed memory according to options.  Throws std::bad_alloc on failure, or
+       std::runtime_error if options.file can't be mapped or is too short */
+    filter_storage(size_t bytes, const storage_options & options = storage_options());
+
+    filter_storage(const filter_storage &) = delete;
+    filter_storage & operator=(const filter_storage &) = delete;
+
+    ~filter_storage();
+
+    /* the start of the memory, aligned as requested */
+    uint8_t * data() const { return base; }
+
+    /* the number of usable bytes */
+    size_t size() const { return bytes; }
+
+    /* note that the byte at data() + offset has been written - does nothing unless track_dirty was set */
+    inline void mark_dirty(size_t offset)
+    {
+        if (!dirty.empty()) set_dirty(offset);
+    }
+
+    /* mark_dirty() for callers that have already checked tracks_dirty(), e.g. once outside a probe loop.  The
+       flag is set with a relaxed atomic store, so several threads can mark regions at once */
+    inline void set_dirty(size_t offset)
+    {
+        __atomic_store_n(&dirty[offset >> dirty_region_bits], (uint8_t)1, __ATOMIC_RELAXED);
+    }
+
+    /* note that bytes starting at data() + offset have been written */
+    void mark_dirty(size_t offset, size_t bytes)
+    {
+        if (dirty.empty() || !bytes) return;
+        for (size_t region = offset >> dirty_region_bits;region <= (offset + bytes - 1) >> dirty_region_bits;region ++)
+            __atomic_store_n(&dirty[region], (uint8_t)1, __ATOMIC_RELAXED);
+    }
+
+    /* true if clear() only zeroes the regions passed to mark_dirty() */
+    bool tracks_dirty() const { return !dirty.empty(); }
+
+    /* zeroes all the memory (or just the dirty regions) */
+    void clear();
+
+    /* zeroes the given memory: memset for small sizes, otherwise non-temporal stores split across threads */
+    static void clear_memory(uint8_t * data, size_t bytes, unsigned int threads);
+
+    /* ORs each folded_bytes slice of the given memory into the first one then zeroes everything after it.
+       bytes must be a multiple of folded_bytes */
+    static void fold_memory(uint8_t * data, size_t bytes, size_t folded_bytes);
+
+    /* writes a zero to every page of the given memory, splitting the work across threads */
+    static void prefault(uint8_t * data, size_t bytes, unsigned int threads);
+
+    /* sets the given memory to zero, splitting the work across threads */
+    static void parallel_zero(uint8_t * data, size_t bytes, unsigned int threads);
+};
+
+/* A single allocation that filter_storage can be carved out of, so several filters can share one (huge page,
+   prefaulted) mapping.  Memory is only given back when the arena is destroyed.  Not thread safe */
+class storage_arena
+{
+private:
+    filter_storage storage;
+    size_t used;
+public:
+    /* reserves bytes, allocated according to options (options.arena is ignored) */
+    storage_arena(size_t bytes, const storage_options & options = storage_options());
+
+    /* returns zeroed memory aligned to alignment, throws std::bad_alloc if the arena is full */
+    uint8_t * allocate(size_t bytes, size_t alignment);
+
+    /* the number of bytes still free (ignoring alignment) */
+    size_t available() const { return storage.size() - used; }
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "unit_test.hpp"
+#include "hyperloglog.hpp"
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include "kmer_scan.hpp"
+#include "scoped_timer.hpp"
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <ctype.h>
+
+class test_hyperloglog_t : public unit_test
+{
+    typedef hyperloglog<kmer_t, kmer_fmix_hash<> > counter_t;
+
+    void operator() ()
+    {
+        section("hyperloglog");
+        counter_t empty;
+        check(empty.estimate() == 0, "empty sketch estimates 0");
+
+        std::mt19937_64 rng(3);
+        const size_t sizes[] = { 10, 1000, 50000, 2000000 };
+        bool within = true;
+        for (size_t s = 0;s < 4;s ++)
+        {
+            counter_t counter;
+            std::vector<kmer_t> items(sizes[s]);
+            for (size_t i = 0;i < items.size();i ++) items[i] = rng();
+            // duplicates don't count
+            for (int repeat = 0;repeat < 2;repeat ++)
+                for (size_t i = 0;i < items.size();i ++) counter.add(items[i]);
+            within &= std::abs(counter.estimate() - sizes[s]) <= std::max(1.0, sizes[s] * 0.01);
+        }
+        check(within, "estimates within 1% from 10 to 2 million items");
+
+        std::vector<kmer_t> items(1000000);
+        for (size_t i = 0;i < items.size();i ++) items[i] = rng();
+        counter_t one_at_a_time, batched;
+        std::cout << "hyperloglog adding " << items.size() << " items:";
+        {
+            scoped_timer t("\tadd", items.size());
+            for (size_t i = 0;i < items.size();i ++) one_at_a_time.add(items[i]);
+        }
+        {
+            scoped_timer t("\tset_batch", items.size());
+            batched.set_batch(&items[0], items.size());
+        }
+        std::cout << std::endl;
+        check(one_at_a_time.estimate() == batched.estimate(), "set_batch matches add");
+
+        std::vector<uint32_t> indexes(19), scalar_indexes(19);
+        std::vector<uint8_t> ranks(19), scalar_ranks(19);
+        hll_index_rank(&items[0], 19, 12, &indexes[0], &ranks[0]);
+        hll_index_rank_scalar(&items[0], 19, 12, &scalar_indexes[0], &scalar_ranks[0]);
+        check(indexes == scalar_indexes && ranks == scalar_ranks, "vectorised index and rank match scalar");
+
+        counter_t a, b, both;
+        for (int i = 0;i < 50000;i ++)
+        {
+            kmer_t item = rng();
+            (i & 1 ? a : b).add(item);
+            both.add(item);
+        }
+        a.merge(b);
+        check(a.estimate() == both.estimate(), "merged sketches estimate the union");
+
+        counter_t coarse(10);
+        bool threw = false;
+        try { a.merge(coarse); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "merging different precisions throws");
+
+        // the reference has ~100000 kmers of which a handful are repeats
+        std::ifstream f("data/test_reference.fa");
+        std::string line, sequence;
+        std::getline(f, line);
+        while (std::getline(f, line)) sequence += line;
+        kmer_ops ops(31);
+        counter_t kmers;
+        size_t total = insert_kmers_batch(kmers, ops, sequence.c_str());
+        std::unordered_set<kmer_t> exact;
+        const char * p = sequence.c_str();
+        kmer_t kmer;
+        if (ops.read_first(&kmer, &p)) do exact.insert(kmer); while (ops.read_next(&kmer, &p));
+        check(total == sequence.size() - 30, "insert_kmers_batch sees every kmer");
+        check(std::abs(kmers.estimate() - exact.size()) < exact.size() * 0.01, "distinct kmers of the reference within 1%");
+
+        // an N drops the 31 kmers covering it, and soft-masked bases are read as bases
+        std::string masked = sequence;
+        masked[1000] = 'N';
+        for (size_t i = 2000;i < 3000;i ++) masked[i] = tolower(masked[i]);
+        std::vector<uint64_t> mask(quality_mask_words(masked.size()));
+        base_mask(masked.c_str(), masked.size(), mask.data());
+        counter_t masked_batch, one_by_one;
+        total = insert_kmers_batch_masked(masked_batch, ops, masked.c_str(), masked.size(), mask.data());
+        check(total == sequence.size() - 30 - 31, "insert_kmers_batch_masked skips the kmers covering an N");
+        check(insert_kmers_masked(one_by_one, ops, masked.c_str(), masked.size(), mask.data()) == total &&
+            masked_batch.estimate() == one_by_one.estimate(), "insert_kmers_batch_masked matches insert_kmers_masked");
+    }
+} test_hyperloglog;
@@ -0,0 +1,224 @@
+/*
+    HyperLogLog sketch - estimates the number of distinct items in a stream in a few KB
+
+    Each item is hashed; the top precision bits pick one of 2^precision registers, which keeps the largest
+    "rank" (leading zeros + 1 of the remaining bits) it has seen.  The count is estimated from the histogram of
+    register values with Ertl's improved estimator (New cardinality estimation algorithms for HyperLogLog
+    sketches, 2017), which needs no bias correction tables or switch to linear counting for small counts.  The
+    relative standard error is about 1.04/sqrt(2^precision) - 0.4% at the default precision of 16 (64KB), so
+    estimates are almost always within 1%.  See Flajolet et al, HyperLogLog: the analysis of a near-optimal
+    cardinality estimation algorithm (2007) for the original.
+
+    set_batch() hashes a batch of 64 bit items with batch_hash (so kmer_fmix_hash is vectorised) and works out their
+    register indexes and ranks 8 at a time with AVX-512 (lzcnt from AVX-512CD) when the cpu has it.  Only the
+    final max into the registers is scalar, since items in a batch may hit the same register.
+
+    Sketches merge by taking the larger of each register (AVX2 max when available), so each thread can fill its
+    own and they can be combined at the end.  bloom-build uses this to count the distinct kmers of its input
+    before sizing the filter.
+
+    index_t and Hash have the same meaning as for the filters.  add() and set_batch() have the same signatures
+    as the filters' so the loops in kmer_scan.hpp work with a sketch too.
+*/
+#ifndef __HYPERLOGLOG_HPP
+#define __HYPERLOGLOG_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <immintrin.h>
+#include "bloomfilter.hpp"
+
+inline void hll_index_rank_scalar(const uint64_t * hashes, size_t count, int precision, uint32_t * indexes, uint8_t * ranks)
+{
+    for (size_t i = 0;i < count;i ++)
+    {
+        indexes[i] = hashes[i] >> (64 - precision);
+        // the low bit stops the count of leading zeros running past the end
+        ranks[i] = __builtin_clzll((hashes[i] << precision) | (1ULL << (precision - 1))) + 1;
+    }
+}
+
+/* the zero-masked shifts and conversions avoid spurious gcc -Wmaybe-uninitialized warnings from the plain forms */
+__attribute__ ((target ("avx512f,avx512cd")))
+inline void hll_index_rank_avx512(const uint64_t * hashes, size_t count, int precision, uint32_t * indexes, uint8_t * ranks)
+{
+    const __m128i index_shift = _mm_cvtsi32_si128(64 - precision);
+    const __m128i rest_shift = _mm_cvtsi32_si128(precision);
+    const __m512i guard = _mm512_set1_epi64(1ULL << (precision - 1));
+    const __m512i one = _mm512_set1_epi64(1);
+    size_t i = 0;
+    for (;i + 8 <= count;i += 8)
+    {
+        __m512i h = _mm512_loadu_si512((const void *)(hashes + i));
+        __m512i rest = _mm512_or_si512(_mm512_maskz_sll_epi64(0xFF, h, rest_shift), guard);
+        _mm256_storeu_si256((__m256i *)(indexes + i),
+            _mm512_maskz_cvtepi64_epi32(0xFF, _mm512_maskz_srl_epi64(0xFF, h, index_shift)));
+        _mm_storel_epi64((__m128i *)(ranks + i),
+            _mm512_maskz_cvtepi64_epi8(0xFF, _mm512_add_epi64(_mm512_lzcnt_epi64(rest), one)));
+    }
+    hll_index_rank_scalar(hashes + i, count - i, precision, indexes + i, ranks + i);
+}
+
+typedef void (*hll_index_rank_fn)(const uint64_t *, size_t, int, uint32_t *, uint8_t *);
+
+/* splits count hashes into register indexes (the top precision bits) and ranks (leading zeros + 1 of the rest) */
+inline void hll_index_rank(const uint64_t * hashes, size_t count, int precision, uint32_t * indexes, uint8_t * ranks)
+{
+    static const hll_index_rank_fn kernel = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd")
+        ? hll_index_rank_avx512 : hll_index_rank_scalar;
+    kernel(hashes, count, precision, indexes, ranks);
+}
+
+inline void hll_max_scalar(uint8_t * registers, const uint8_t * other, size_t count)
+{
+    for (size_t i = 0;i < count;i ++) registers[i] = std::max(registers[i], other[i]);
+}
+
+__attribute__ ((target ("avx2")))
+inline void hll_max_avx2(uint8_t * registers, const uint8_t * other, size_t count)
+{
+    size_t i = 0;
+    for (;i + 32 <= count;i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(registers + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(other + i));
+        _mm256_storeu_si256((__m256i *)(registers + i), _mm256_max_epu8(a, b));
+    }
+    hll_max_scalar(registers + i, other + i, count - i);
+}
+
+typedef void (*hll_max_fn)(uint8_t *, const uint8_t *, size_t);
+
+/* registers[i] = max(registers[i], other[i]) */
+inline void hll_max(uint8_t * registers, const uint8_t * other, size_t count)
+{
+    static const hll_max_fn kernel = __builtin_cpu_supports("avx2") ? hll_max_avx2 : hll_max_scalar;
+    kernel(registers, other, count);
+}
+
+template<typename index_t, typename Hash = std::hash<index_t> >
+class hyperloglog
+{
+private:
+    int precision;
+    std::vector<uint8_t> registers;
+public:
+    /* the number of items set_batch() hashes at a time */
+    static const size_t batch_size = 64;
+
+    /* 2^precision registers, precision from 4 to 18 */
+    hyperloglog(int precision = 16) : precision(precision), registers((size_t)1 << precision, 0)
+    {
+        if (precision < 4 || precision > 18) throw std::runtime_error("hyperloglog precision must be from 4 to 18");
+    }
+
+    inline void add(const index_t & item)
+    {
+        static Hash hashfunction;
+        add_hash(hashfunction(item));
+    }
+
+    /* adds an item that has already been hashed to 64 bits */
+    inline void add_hash(uint64_t hash)
+    {
+        uint32_t index;
+        uint8_t rank;
+        hll_index_rank_scalar(&hash, 1, precision, &index, &rank);
+        if (rank > registers[index]) registers[index] = rank;
+    }
+
+    /* add() for count items */
+    void set_batch(const index_t * items, size_t count)
+    {
+        uint64_t hashes[batch_size];
+        uint32_t indexes[batch_size];
+        uint8_t ranks[batch_size];
+        for (size_t start = 0;start < count;start += batch_size)
+        {
+            size_t todo = std::min(batch_size, count - start);
+            hash_items(items + start, todo, hashes);
+            hll_index_rank(hashes, todo, precision, indexes, ranks);
+            for (size_t i = 0;i < todo;i ++)
+                if (ranks[i] > registers[indexes[i]]) registers[indexes[i]] = ranks[i];
+        }
+    }
+
+    /* combines other into this sketch, which then estimates the size of the union.  Throws
+       std::runtime_error if the precisions differ */
+    void merge(const hyperloglog & other)
+    {
+        if (other.precision != precision) throw std::runtime_error("Can't merge hyperloglogs of different precision");
+        hll_max(&registers[0], &other.registers[0], registers.size());
+    }
+
+    /* the estimated number of distinct items added */
+    double estimate() const
+    {
+        // the histogram of register values - ranks go up to q + 1
+        const int q = 64 - precision;
+        std::vector<double> counts(q + 2, 0);
+        for (size_t i = 0;i < registers.size();i ++) counts[registers[i]] ++;
+        double m = registers.size();
+        if (counts[0] == m) return 0;
+        double z = m * tau(1 - counts[q + 1] / m);
+        for (int k = q;k >= 1;k --) z = 0.5 * (z + counts[k]);
+        z += m * sigma(counts[0] / m);
+        return m * m / (2 * log(2.0) * z);
+    }
+
+    void clear()
+    {
+        std::fill(registers.begin(), registers.end(), 0);
+    }
+
+    int getprecision() const { return precision; }
+private:
+    /* 64 bit items go through batch_hash, so kmer_fmix_hash is vectorised */
+    static void hash_items(const uint64_t * items, size_t count, uint64_t * hashes)
+    {
+        static Hash hashfunction;
+        std::copy(items, items + count, hashes);
+        batch_hash<uint64_t,Hash>::apply(hashfunction, hashes, count);
+    }
+
+    /* wider items (the long kmers) are hashed one at a time */
+    template<typename item_t>
+    static void hash_items(const item_t * items, size_t count, uint64_t * hashes)
+    {
+        static Hash hashfunction;
+        for (size_t i = 0;i < count;i ++) hashes[i] = hashfunction(items[i]);
+    }
+
+    /* the series from Ertl's estimator that account for empty and saturated registers */
+    static double sigma(double x)
+    {
+        if (x == 1) return INFINITY;
+        double y = 1, z = x, previous;
+        do {
+            x *= x;
+            previous = z;
+            z += x * y;
+            y += y;
+        } while (z != previous);
+        return z;
+    }
+
+    static double tau(double x)
+    {
+        if (x == 0 || x == 1) return 0;
+        double y = 1, z = 1 - x, previous;
+        do {
+            x = sqrt(x);
+            previous = z;
+            y *= 0.5;
+            z -= (1 - x) * (1 - x) * y;
+        } while (z != previous);
+        return z / 3;
+    }
+};
+
+#endif
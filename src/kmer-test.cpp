@@ -1,7 +1,11 @@
 #include "unit_test.hpp"
 #include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include "kmer_scan.hpp"
+#include "bloomfilter_basic.hpp"
 #include "fasta_reader.hpp"
 #include <sstream>
+#include <vector>
 
 class test_kmer_t : public unit_test
 {
@@ -21,5 +25,48 @@ class test_kmer_t : public unit_test
         check(ops.read_next(&kmer,&i), "read 3rd kmer");
         check(ops.str(kmer) == "ATA", "3rd kmer is correct");
         check(!ops.read_next(&kmer,&i), "end read");
+        const char * soft = "ggAtA";
+        kmer_t lower;
+        check(ops.read_first(&lower,&soft) && ops.str(lower) == "GGA", "lowercase bases read as uppercase");
     }
 } test_kmer;
+
+class test_kmer_hash_t : public unit_test
+{
+    void operator() ()
+    {
+        section("vectorised kmer hash");
+        kmer_fmix_hash<> hashfunction;
+        // odd count so that the scalar tail of the kernel is exercised too
+        std::vector<uint64_t> values(37);
+        for (size_t i = 0;i < values.size();i ++) values[i] = i * 0x123456789ULL;
+        std::vector<uint64_t> expected(values.size());
+        for (size_t i = 0;i < values.size();i ++) expected[i] = hashfunction(values[i]);
+        kmer_fmix_hash<>::hash_batch(&values[0], values.size());
+        check(values == expected, "hash_batch matches scalar hash");
+        if (__builtin_cpu_supports("avx2"))
+        {
+            for (size_t i = 0;i < values.size();i ++) values[i] = i * 0x123456789ULL;
+            kmer_fmix64_batch_avx2(&values[0], values.size(), 0x9e3779b97f4a7c15ULL);
+            check(values == expected, "AVX2 kernel matches scalar hash");
+        }
+        check(hashfunction(0) != 0, "zero is not a fixed point");
+        check(kmer_fmix_hash<1>()(42) != hashfunction(42), "different seeds give different hashes");
+    }
+} test_kmer_hash;
+
+class test_kmer_scan_t : public unit_test
+{
+    void operator() ()
+    {
+        section("scanning kmers through a filter");
+        kmer_ops ops(5);
+        bloomfilter_basic<kmer_t,uint64_t,kmer_fmix_hash<> > bf(1000, 4);
+        check(insert_kmers(bf, ops, "GGATACCAGT") == 6, "insert_kmers inserts every kmer");
+        size_t total;
+        check(count_kmer_hits(bf, ops, "GATACC", &total) == 2 && total == 2, "count_kmer_hits on the concrete filter");
+        const bloomfilter<kmer_t> & base = bf;
+        check(count_kmer_hits(base, ops, "GATACC", &total) == 2 && total == 2, "count_kmer_hits through the base class");
+        check(count_kmer_hits(bf, ops, "GGA", &total) == 0 && total == 0, "sequence shorter than k");
+    }
+} test_kmer_scan;
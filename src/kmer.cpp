@@ -1,26 +1,23 @@
 #include <stdexcept>
 #include "kmer.hpp"
 
-struct text_mapping_t {
-    /* Stores the unshifted NUCLEOTIDE_ values for the given ascii characters or kmer_invalid otherwise */
-    kmer_t asciiToBits[128];
-    char bitsToAscii[4];
-    text_mapping_t()
+/* a constant expression, so the table is filled in at compile time and is valid during static initialisation of
+   other translation units.  Lowercase (soft-masked) bases read the same as uppercase */
+#define X KMER_INVALID
+extern constexpr text_mapping_t text_mapping = {
     {
-        // generate the mapping from ascii to bits
-        for (int i = 0;i < 128;i ++) asciiToBits[i] = KMER_INVALID;
-        asciiToBits[(size_t)'A'] = NUCLEOTIDE_A;
-        asciiToBits[(size_t)'C'] = NUCLEOTIDE_C;
-        asciiToBits[(size_t)'G'] = NUCLEOTIDE_G;
-        asciiToBits[(size_t)'T'] = NUCLEOTIDE_T;
-        
-        // and the reverse
-        bitsToAscii[NUCLEOTIDE_A] = 'A';
-        bitsToAscii[NUCLEOTIDE_C] = 'C';
-        bitsToAscii[NUCLEOTIDE_G] = 'G';
-        bitsToAscii[NUCLEOTIDE_T] = 'T';        
-    }
-} text_mapping;
+        X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+        X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+        X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+        X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X,
+        X, NUCLEOTIDE_A, X, NUCLEOTIDE_C, X, X, X, NUCLEOTIDE_G, X, X, X, X, X, X, X, X,
+        X, X, X, X, NUCLEOTIDE_T, X, X, X, X, X, X, X, X, X, X, X,
+        X, NUCLEOTIDE_A, X, NUCLEOTIDE_C, X, X, X, NUCLEOTIDE_G, X, X, X, X, X, X, X, X,
+        X, X, X, X, NUCLEOTIDE_T, X, X, X, X, X, X, X, X, X, X, X
+    },
+    { 'A', 'C', 'G', 'T' }
+};
+#undef X
 
 kmer_ops::kmer_ops(kmer_size_t length) : length(length)
 {
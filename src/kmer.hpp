@@ -46,6 +46,16 @@ struct kmer_hash
 #define NUCLEOTIDE_G 2
 #define NUCLEOTIDE_T 3
 
+/* the mapping between nucleotide letters and bits, shared by kmer_ops and the long kmer ops in long_kmer.hpp */
+struct text_mapping_t {
+    /* Stores the unshifted NUCLEOTIDE_ values for the given ascii characters or kmer_invalid otherwise */
+    kmer_t asciiToBits[128];
+    char bitsToAscii[4];
+};
+
+/* constant-initialised (see kmer.cpp), so safe to use from other static initialisers */
+extern const text_mapping_t text_mapping;
+
 /* the kmewOps class 
    I see a need for a kmer length variable that I don't want to pass
    around with every kmer.  Rather than establish a global variable this kmer_ops class records the length
@@ -60,6 +70,9 @@ private:
        also used to generate complements */
     kmer_t mask;
 public:
+    /* the type of kmer these ops work on (see long_kmer.hpp for others) */
+    typedef kmer_t kmer_type;
+    
     kmer_ops(kmer_size_t length);
     
     /* advances sequence to the next character after the first kmer
@@ -74,6 +87,8 @@ public:
     
     /* generates the complement A->T, C->G, G->C, T->A */
     kmer_t complement(const kmer_t kmer) const;
+
+    kmer_size_t getlength() const { return length; }
 }; 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "unit_test.hpp"
+#include "kmer_dispatch.hpp"
+#include "kmer_scan.hpp"
+#include "filter_file.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <random>
+#include <string>
+
+class test_kmer_dispatch_t : public unit_test
+{
+    /* reads every kmer with the dispatched ops and with basic_kmer_ops and compares them */
+    struct compare_visitor
+    {
+        typedef bool result_type;
+        const std::string * sequence;
+        kmer_size_t k;
+
+        template<typename ops_t>
+        bool operator()(const ops_t & ops)
+        {
+            typedef typename ops_t::kmer_type kmer_type;
+            basic_kmer_ops<kmer_type> reference(k);
+            const char * p = sequence->c_str(), * q = sequence->c_str();
+            kmer_type a, b;
+            if (ops.getlength() != k || !ops.read_first(&a, &p) || !reference.read_first(&b, &q)) return false;
+            bool ok = true;
+            do {
+                ok &= a == b && ops.str(a) == reference.str(b) && ops.complement(a) == reference.complement(b)
+                    && ops.reverse_complement(a) == reference.reverse_complement(b);
+            } while (ops.read_next(&a, &p) & reference.read_next(&b, &q));
+            return ok && !*p && !*q;
+        }
+    };
+
+    /* counts the kmers of the sequence found in a filter of the sequence */
+    struct scan_visitor
+    {
+        typedef size_t result_type;
+        const std::string * sequence;
+
+        template<typename ops_t>
+        size_t operator()(const ops_t & ops)
+        {
+            typename kmer_filter_type<typename ops_t::kmer_type>::type filter(1 << 20, 3);
+            insert_kmers(filter, ops, sequence->c_str());
+            size_t total;
+            return count_kmer_hits(filter, ops, sequence->c_str(), &total);
+        }
+    };
+
+    void operator() ()
+    {
+        section("kmer length dispatch");
+        std::mt19937 rng(11);
+        std::string sequence(300, 'A');
+        for (size_t i = 0;i < sequence.size();i ++) sequence[i] = "ACGT"[rng() & 3];
+
+        bool same = true;
+        for (kmer_size_t k = 1;k <= KMER_DISPATCH_MAX_LENGTH;k ++)
+        {
+            compare_visitor compare = { &sequence, k };
+            same &= dispatch_kmer_length(k, compare);
+        }
+        check(same, "dispatched ops match basic_kmer_ops for every k");
+
+        scan_visitor scan = { &sequence };
+        check(dispatch_kmer_length(21, scan) == 280 && dispatch_kmer_length(51, scan) == 250
+            && dispatch_kmer_length(101, scan) == 200, "dispatched scans find every kmer");
+
+        kmer_ops ops(31);
+        fixed_kmer_ops<31> fixed;
+        const char * p = sequence.c_str(), * q = sequence.c_str();
+        kmer_t a, b;
+        ops.read_first(&a, &p);
+        fixed.read_first(&b, &q);
+        check(a == b && ops.complement(a) == fixed.complement(b), "fixed ops match kmer_ops");
+
+        bool threw = false;
+        try { dispatch_kmer_length(KMER_DISPATCH_MAX_LENGTH + 1, scan); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "k out of range throws");
+
+        std::string reads(1 << 20, 'A');
+        for (size_t i = 0;i < reads.size();i ++) reads[i] = "ACGT"[rng() & 3];
+        kmer_filter filter(1 << 24, 3);
+        kmer_ops runtime_ops(31);
+        insert_kmers(filter, runtime_ops, reads.c_str());
+        size_t total, hits = 0, fixed_hits = 0;
+        std::cout << "scan " << reads.size() << " bases, k = 31:" << std::endl;
+        {
+            scoped_timer t("\tkmer_ops", reads.size());
+            hits += count_kmer_hits(filter, runtime_ops, reads.c_str(), &total);
+        }
+        {
+            scoped_timer t("\tfixed_kmer_ops<31>", reads.size());
+            fixed_hits += count_kmer_hits(filter, fixed, reads.c_str(), &total);
+        }
+        std::cout << std::endl;
+        check(hits == fixed_hits, "both scans agree");
+    }
+} test_kmer_dispatch;
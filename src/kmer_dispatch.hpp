@@ -0,0 +1,157 @@
+/*
+    Run time k, compile time kernels
+
+    kmer_ops and basic_kmer_ops take the length at run time, so the mask in read_next() is a load and
+    read_first() is a loop of unknown length.  fixed_kmer_ops<K> has the same interface with the length as a
+    template parameter, so the mask and the reverse complement shift are immediates and the scan loops in
+    kmer_scan.hpp compile down to a shift, an or and an and per base.
+
+    dispatch_kmer_length(k, visitor) picks the instantiation for a k only known at run time - from the command
+    line or a filter file - and calls visitor(ops) with it, so one binary serves every k:
+        k 1-32      fixed_kmer_ops<k>, kmer type uint64_t
+        k 33-64     fixed_kmer_ops<k>, kmer type kmer128_t
+        k 65-96     basic_kmer_ops<kmer_words<3> >
+        k 97-128    basic_kmer_ops<kmer_words<4> >
+    The multi word kmers are bucketed rather than specialised per k, since their rolling update is a loop over
+    the words anyway and another 64 instantiations of the visitor would mostly add compile time.  Which kmer
+    type a k maps to decides how its kmers hash, so filters written for a k have to be read back through the
+    same bucket - kmer_length_type<k> is that mapping.
+
+    The visitor is a class with a templated operator() and a result_type (generic lambdas need C++14):
+
+        struct insert_visitor
+        {
+            typedef size_t result_type;
+            const char * sequence;
+            template<typename ops_t> size_t operator()(const ops_t & ops)
+            {
+                typedef typename ops_t::kmer_type kmer_type;
+                bloomfilter_basic<kmer_type, uint64_t, long_kmer_hash<kmer_type> > filter(1 << 20, 3);
+                return insert_kmers(filter, ops, sequence);
+            }
+        };
+*/
+#ifndef __KMER_DISPATCH_HPP
+#define __KMER_DISPATCH_HPP
+#include "long_kmer.hpp"
+#include <stdexcept>
+
+/* the longest kmer with a compile time length, and the longest dispatch_kmer_length() handles */
+const unsigned int KMER_FIXED_MAX_LENGTH = 64;
+const unsigned int KMER_DISPATCH_MAX_LENGTH = 128;
+
+/* the kmer type dispatch_kmer_length() uses for kmers of the given length */
+template<unsigned int length, bool one_word = (length <= 32), bool fixed = (length <= KMER_FIXED_MAX_LENGTH)>
+struct kmer_length_type
+{
+    typedef kmer_words<(length + 31) / 32> type;
+};
+
+template<unsigned int length>
+struct kmer_length_type<length, true, true>
+{
+    typedef uint64_t type;
+};
+
+template<unsigned int length>
+struct kmer_length_type<length, false, true>
+{
+    typedef kmer128_t type;
+};
+
+/* kmer_ops with the length fixed at compile time - see kmer_ops for the methods */
+template<unsigned int length_t>
+class fixed_kmer_ops
+{
+public:
+    static_assert(length_t >= 1 && length_t <= KMER_FIXED_MAX_LENGTH, "fixed_kmer_ops length out of range");
+    typedef typename kmer_length_type<length_t>::type kmer_type;
+    static const kmer_size_t length = length_t;
+private:
+    /* the bottom 2 * length bits, a constant once inlined */
+    static kmer_type mask()
+    {
+        return ~kmer_type(0) >> (2 * (kmer_traits<kmer_type>::max_length - length));
+    }
+public:
+    bool read_first(kmer_type * kmer, char const * * sequence) const
+    {
+        *kmer = 0;
+        for (kmer_size_t todo = length;todo > 0;todo --)
+            if (!read_next(kmer, sequence)) return false;
+        return true;
+    }
+
+    inline bool read_next(kmer_type * kmer, char const * * sequence) const
+    {
+        size_t ix = (unsigned char)**sequence;
+        if (!ix) return false;
+        if (ix > 127) throw std::runtime_error("Non-ascii characters encountered when reading nucleotides");
+        (*sequence)++;
+        kmer_t bits = text_mapping.asciiToBits[ix];
+        if (bits == KMER_INVALID) throw std::runtime_error("Invalid character when reading nucleotides");
+        *kmer = ((*kmer << 2) | bits) & mask();
+        return true;
+    }
+
+    std::string str(kmer_type kmer) const
+    {
+        std::string buf(length, '?');
+        for (kmer_size_t todo = length;todo > 0;todo --)
+        {
+            buf[todo - 1] = text_mapping.bitsToAscii[(unsigned int)(kmer & 3)];
+            kmer >>= 2;
+        }
+        return buf;
+    }
+
+    /* A->T, C->G, G->C, T->A in place */
+    kmer_type complement(kmer_type kmer) const
+    {
+        return kmer ^ mask();
+    }
+
+    /* the kmer of the opposite strand: complemented and reversed */
+    kmer_type reverse_complement(kmer_type kmer) const
+    {
+        return kmer_traits<kmer_type>::reverse_complement(kmer, length);
+    }
+
+    kmer_size_t getlength() const { return length; }
+};
+
+/* binary search over [first, last] for the instantiation to call */
+template<unsigned int first, unsigned int last>
+struct kmer_length_dispatch
+{
+    template<typename visitor_t>
+    static typename visitor_t::result_type call(unsigned int k, visitor_t & visitor)
+    {
+        const unsigned int middle = (first + last) / 2;
+        return k <= middle ? kmer_length_dispatch<first, middle>::call(k, visitor)
+            : kmer_length_dispatch<middle + 1, last>::call(k, visitor);
+    }
+};
+
+template<unsigned int length>
+struct kmer_length_dispatch<length, length>
+{
+    template<typename visitor_t>
+    static typename visitor_t::result_type call(unsigned int, visitor_t & visitor)
+    {
+        return visitor(fixed_kmer_ops<length>());
+    }
+};
+
+/* calls visitor(ops) with the kmer ops for k (see the table above).  Throws std::runtime_error if k is out of
+   range */
+template<typename visitor_t>
+typename visitor_t::result_type dispatch_kmer_length(unsigned int k, visitor_t & visitor)
+{
+    if (k < 1 || k > KMER_DISPATCH_MAX_LENGTH) throw std::runtime_error("kmer length out of range");
+    if (k <= KMER_FIXED_MAX_LENGTH) return kmer_length_dispatch<1, KMER_FIXED_MAX_LENGTH>::call(k, visitor);
+    if (k <= 96) return visitor(basic_kmer_ops<kmer_length_type<96>::type>(k));
+    return visitor(basic_kmer_ops<kmer_length_type<KMER_DISPATCH_MAX_LENGTH>::type>(k));
+}
+
+#endif
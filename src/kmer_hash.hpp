@@ -0,0 +1,138 @@
+/*
+    Hash functions specialised for a single 64 bit kmer_t
+
+    SpookyHash (kmer_hash) gives good false positive rates but is built for long byte streams, and
+    std::hash<uint64_t> is the identity on libstdc++ so repeated application (as the filters do to get
+    h hash values) just yields the same bit h times.
+
+    kmer_fmix_hash is the murmur3 fmix64 finaliser - two multiplies and three xor-shifts - applied to
+    the kmer xor'd with a seed (the seed stops 0 from being a fixed point, and different seeds give a
+    family of independent hashes).
+
+    kmer_fmix_hash::hash_batch hashes a whole array in place, using AVX-512 (8 kmers per instruction)
+    or AVX2 (4 per instruction) if the cpu supports it.  It gives identical results to operator().
+    The filters pick this up via the batch_hash specialisation at the bottom of this file.
+*/
+#ifndef __KMER_HASH_HPP
+#define __KMER_HASH_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <immintrin.h>
+#include "bloomfilter.hpp"
+
+/* the scalar mixing function shared by all the seeds */
+inline uint64_t kmer_fmix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* scalar fallback for hash_batch */
+inline void kmer_fmix64_batch_scalar(uint64_t * values, size_t count, uint64_t seed)
+{
+    for (size_t i = 0;i < count;i ++)
+        values[i] = kmer_fmix64(values[i] ^ seed);
+}
+
+/* AVX2 has no 64 bit multiply so build one from three 32x32->64 multiplies */
+__attribute__ ((target ("avx2")))
+inline __m256i kmer_mullo64_avx2(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross1 = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+    __m256i cross2 = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(_mm256_add_epi64(cross1, cross2), 32));
+}
+
+__attribute__ ((target ("avx2")))
+inline void kmer_fmix64_batch_avx2(uint64_t * values, size_t count, uint64_t seed)
+{
+    const __m256i s = _mm256_set1_epi64x(seed);
+    const __m256i c1 = _mm256_set1_epi64x(0xff51afd7ed558ccdULL);
+    const __m256i c2 = _mm256_set1_epi64x(0xc4ceb9fe1a85ec53ULL);
+    size_t i = 0;
+    for (;i + 4 <= count;i += 4)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(values + i));
+        x = _mm256_xor_si256(x, s);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+        x = kmer_mullo64_avx2(x, c1);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+        x = kmer_mullo64_avx2(x, c2);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 33));
+        _mm256_storeu_si256((__m256i *)(values + i), x);
+    }
+    kmer_fmix64_batch_scalar(values + i, count - i, seed);
+}
+
+/* x >> 33 - the zero-masked form avoids a spurious gcc -Wmaybe-uninitialized from _mm512_srli_epi64 */
+__attribute__ ((target ("avx512f")))
+inline __m512i kmer_srli33_avx512(__m512i x)
+{
+    return _mm512_maskz_srli_epi64(0xFF, x, 33);
+}
+
+__attribute__ ((target ("avx512f,avx512dq")))
+inline void kmer_fmix64_batch_avx512(uint64_t * values, size_t count, uint64_t seed)
+{
+    const __m512i s = _mm512_set1_epi64(seed);
+    const __m512i c1 = _mm512_set1_epi64(0xff51afd7ed558ccdULL);
+    const __m512i c2 = _mm512_set1_epi64(0xc4ceb9fe1a85ec53ULL);
+    size_t i = 0;
+    for (;i + 8 <= count;i += 8)
+    {
+        __m512i x = _mm512_loadu_si512((const void *)(values + i));
+        x = _mm512_xor_si512(x, s);
+        x = _mm512_xor_si512(x, kmer_srli33_avx512(x));
+        x = _mm512_mullo_epi64(x, c1);
+        x = _mm512_xor_si512(x, kmer_srli33_avx512(x));
+        x = _mm512_mullo_epi64(x, c2);
+        x = _mm512_xor_si512(x, kmer_srli33_avx512(x));
+        _mm512_storeu_si512((void *)(values + i), x);
+    }
+    kmer_fmix64_batch_scalar(values + i, count - i, seed);
+}
+
+typedef void (*kmer_fmix64_batch_fn)(uint64_t *, size_t, uint64_t);
+
+/* picks the widest kernel the cpu supports - resolved once on first use */
+inline kmer_fmix64_batch_fn kmer_fmix64_batch_kernel()
+{
+    static const kmer_fmix64_batch_fn kernel =
+        (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) ? kmer_fmix64_batch_avx512 :
+        __builtin_cpu_supports("avx2") ? kmer_fmix64_batch_avx2 :
+        kmer_fmix64_batch_scalar;
+    return kernel;
+}
+
+/* fmix64 based hash - use as the Hash template argument of any of the filters */
+template<uint64_t seed = 0x9e3779b97f4a7c15ULL>
+struct kmer_fmix_hash
+{
+    std::size_t operator()(uint64_t const& kmer) const
+    {
+        return (size_t)kmer_fmix64(kmer ^ seed);
+    }
+
+    /* replaces each of the count values with its hash */
+    static void hash_batch(uint64_t * values, size_t count)
+    {
+        kmer_fmix64_batch_kernel()(values, count, seed);
+    }
+};
+
+/* lets the filters' set_batch/test_batch use the vectorised kernel */
+template<uint64_t seed>
+struct batch_hash<uint64_t, kmer_fmix_hash<seed> >
+{
+    static void apply(const kmer_fmix_hash<seed> & hashfunction, uint64_t * values, size_t count)
+    {
+        kmer_fmix_hash<seed>::hash_batch(values, count);
+    }
+};
+
+#endif
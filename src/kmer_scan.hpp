@@ -0,0 +1,175 @@
+/*
+    Loops that run every kmer of a sequence through a filter
+
+    These are templated on the filter type and call the non-virtual add()/contains(), so given a concrete
+    filter (e.g. bloomfilter_basic<...>) the hash and probe loop is inlined into the scan.  Given a
+    bloomfilter<kmer_t> they fall back to the virtual set()/test().
+
+    They are templated on the kmer ops too, so they work for the long kmer types in long_kmer.hpp.
+
+    The _masked versions take a bitmap from quality_mask() and skip every kmer covering a masked base.
+*/
+#ifndef __KMER_SCAN_HPP
+#define __KMER_SCAN_HPP
+#include "kmer.hpp"
+#include "quality_mask.hpp"
+
+/* inserts every kmer of the null-terminated sequence, returning the number of kmers */
+template<typename filter_t, typename ops_t>
+size_t insert_kmers(filter_t & filter, const ops_t & ops, const char * sequence)
+{
+    typename ops_t::kmer_type kmer;
+    if (!ops.read_first(&kmer, &sequence)) return 0;
+    size_t count = 0;
+    do {
+        filter.add(kmer);
+        count ++;
+    } while (ops.read_next(&kmer, &sequence));
+    return count;
+}
+
+/* insert_kmers() through set_batch(), a buffer of kmers at a time, for filters (or sketches) that hash 
+   a batch faster than one kmer at a time */
+template<typename filter_t, typename ops_t>
+size_t insert_kmers_batch(filter_t & filter, const ops_t & ops, const char * sequence)
+{
+    const size_t buffer_size = 256;
+    typename ops_t::kmer_type buffer[buffer_size];
+    size_t buffered = 0, count = 0;
+    typename ops_t::kmer_type kmer;
+    if (!ops.read_first(&kmer, &sequence)) return 0;
+    do {
+        buffer[buffered ++] = kmer;
+        if (buffered == buffer_size)
+        {
+            filter.set_batch(buffer, buffered);
+            count += buffered;
+            buffered = 0;
+        }
+    } while (ops.read_next(&kmer, &sequence));
+    filter.set_batch(buffer, buffered);
+    return count + buffered;
+}
+
+/* insert_kmers() for a filter other threads are inserting into too (see bloomfilter_basic::add_concurrent) */
+template<typename filter_t, typename ops_t>
+size_t insert_kmers_concurrent(filter_t & filter, const ops_t & ops, const char * sequence)
+{
+    typename ops_t::kmer_type kmer;
+    if (!ops.read_first(&kmer, &sequence)) return 0;
+    size_t count = 0;
+    do {
+        filter.add_concurrent(kmer);
+        count ++;
+    } while (ops.read_next(&kmer, &sequence));
+    return count;
+}
+
+/* returns how many of the kmers of the null-terminated sequence the filter contains,
+   and sets total to the number of kmers */
+template<typename filter_t, typename ops_t>
+size_t count_kmer_hits(const filter_t & filter, const ops_t & ops, const char * sequence, size_t * total)
+{
+    *total = 0;
+    typename ops_t::kmer_type kmer;
+    if (!ops.read_first(&kmer, &sequence)) return 0;
+    size_t hits = 0;
+    do {
+        if (filter.contains(kmer)) hits ++;
+        (*total) ++;
+    } while (ops.read_next(&kmer, &sequence));
+    return hits;
+}
+
+/* calls visit(kmer) for every kmer of the length bases of sequence that doesn't cover a bit set in mask.
+   The runs between masked bases are read with the ops separately, so masked bases are never decoded (and an
+   N doesn't throw) */
+template<typename ops_t, typename visit_t>
+void for_each_unmasked_kmer(const ops_t & ops, const char * sequence, size_t length, const uint64_t * mask, visit_t visit)
+{
+    const size_t k = ops.getlength();
+    size_t start = next_mask_position(mask, 0, length, false);
+    while (start < length)
+    {
+        size_t end = next_mask_position(mask, start, length, true);
+        if (end - start >= k)
+        {
+            const char * p = sequence + start;
+            typename ops_t::kmer_type kmer;
+            ops.read_first(&kmer, &p);
+            visit(kmer);
+            for (size_t i = start + k;i < end;i ++)
+            {
+                ops.read_next(&kmer, &p);
+                visit(kmer);
+            }
+        }
+        start = next_mask_position(mask, end, length, false);
+    }
+}
+
+/* insert_kmers() skipping the kmers that cover a bit set in mask */
+template<typename filter_t, typename ops_t>
+size_t insert_kmers_masked(filter_t & filter, const ops_t & ops, const char * sequence, size_t length, const uint64_t * mask)
+{
+    size_t count = 0;
+    for_each_unmasked_kmer(ops, sequence, length, mask, [&](const typename ops_t::kmer_type & kmer)
+    {
+        filter.add(kmer);
+        count ++;
+    });
+    return count;
+}
+
+/* insert_kmers_batch() skipping the kmers that cover a bit set in mask */
+template<typename filter_t, typename ops_t>
+size_t insert_kmers_batch_masked(filter_t & filter, const ops_t & ops, const char * sequence, size_t length,
+    const uint64_t * mask)
+{
+    const size_t buffer_size = 256;
+    typename ops_t::kmer_type buffer[buffer_size];
+    size_t buffered = 0, count = 0;
+    for_each_unmasked_kmer(ops, sequence, length, mask, [&](const typename ops_t::kmer_type & kmer)
+    {
+        buffer[buffered ++] = kmer;
+        if (buffered == buffer_size)
+        {
+            filter.set_batch(buffer, buffered);
+            count += buffered;
+            buffered = 0;
+        }
+    });
+    filter.set_batch(buffer, buffered);
+    return count + buffered;
+}
+
+/* insert_kmers_concurrent() skipping the kmers that cover a bit set in mask */
+template<typename filter_t, typename ops_t>
+size_t insert_kmers_concurrent_masked(filter_t & filter, const ops_t & ops, const char * sequence, size_t length,
+    const uint64_t * mask)
+{
+    size_t count = 0;
+    for_each_unmasked_kmer(ops, sequence, length, mask, [&](const typename ops_t::kmer_type & kmer)
+    {
+        filter.add_concurrent(kmer);
+        count ++;
+    });
+    return count;
+}
+
+/* count_kmer_hits() skipping the kmers that cover a bit set in mask - they count towards neither */
+template<typename filter_t, typename ops_t>
+size_t count_kmer_hits_masked(const filter_t & filter, const ops_t & ops, const char * sequence, size_t length,
+    const uint64_t * mask, size_t * total)
+{
+    size_t hits = 0;
+    *total = 0;
+    for_each_unmasked_kmer(ops, sequence, length, mask, [&](const typename ops_t::kmer_type & kmer)
+    {
+        if (filter.contains(kmer)) hits ++;
+        (*total) ++;
+    });
+    return hits;
+}
+
+#endif
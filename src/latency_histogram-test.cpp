@@ -0,0 +1,41 @@
+#include "unit_test.hpp"
+#include "latency_histogram.hpp"
+#include <thread>
+#include <cmath>
+
+class test_latency_histogram_t : public unit_test
+{
+    void operator() ()
+    {
+        section("latency histogram");
+        latency_histogram small;
+        for (uint64_t v = 1;v <= 50;v ++) small.record(v);
+        check(small.total() == 50, "total counts all values");
+        check(small.percentile(0.5) == 25, "small values are exact");
+
+        bool mapping_ok = true;
+        for (uint64_t v = 1;v < (1ULL << 40);v = v * 3 + 1)
+        {
+            size_t i = latency_histogram::index_of(v);
+            mapping_ok &= i < latency_histogram::bucket_count;
+            mapping_ok &= latency_histogram::lowest_value(i) <= v;
+            mapping_ok &= std::abs((double)latency_histogram::representative_value(i) - v) <= v / 32.0;
+        }
+        check(mapping_ok, "buckets are within 1/32 of the value");
+        check(latency_histogram::index_of(~0ULL) == latency_histogram::bucket_count - 1, "largest value fits");
+
+        // one histogram per thread, then merged
+        latency_histogram a, b, merged;
+        std::thread ta([&a]() { for (uint64_t v = 1;v <= 1000;v ++) a.record(v * 1000); });
+        std::thread tb([&b]() { for (uint64_t v = 1001;v <= 2000;v ++) b.record(v * 1000); });
+        ta.join();
+        tb.join();
+        merged.merge(a);
+        merged.merge(b);
+        check(merged.total() == 2000, "merged total");
+        double p99 = merged.percentile(0.99);
+        check(std::abs(p99 - 1980000) < 1980000 / 32.0, "merged p99");
+        double p50 = merged.percentile(0.5);
+        check(std::abs(p50 - 1000000) < 1000000 / 32.0, "merged p50");
+    }
+} test_latency_histogram;
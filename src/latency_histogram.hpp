@@ -0,0 +1,121 @@
+/*
+    HDR-style latency histogram
+
+    Values (nanoseconds, or any unsigned 64 bit quantity) are counted in log-linear buckets: each power of two
+    is split into 2^sub_bucket_bits linear sub-buckets, so any recorded value is reported to within
+    1/2^sub_bucket_bits (about 3%) over the full 64 bit range, in a fixed 15KB of counts.
+
+    Each thread should record into its own histogram - record() is a relaxed atomic increment so it never
+    blocks, and another thread may merge() or read percentiles at the same time.  Histograms merge by adding
+    counts, so per-thread histograms can be combined into one for reporting.
+*/
+#ifndef __LATENCY_HISTOGRAM_HPP
+#define __LATENCY_HISTOGRAM_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+
+class latency_histogram
+{
+public:
+    static const int sub_bucket_bits = 5;
+    static const uint64_t sub_bucket_count = 1ULL << sub_bucket_bits;
+    static const size_t bucket_count = (65 - sub_bucket_bits) * sub_bucket_count;
+
+    latency_histogram() { reset(); }
+
+    latency_histogram(const latency_histogram &) = delete;
+    latency_histogram & operator=(const latency_histogram &) = delete;
+
+    /* count one occurrence of value */
+    void record(uint64_t value)
+    {
+        counts[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* add all the counts of another histogram to this one */
+    void merge(const latency_histogram & other)
+    {
+        for (size_t i = 0;i < bucket_count;i ++)
+        {
+            uint64_t c = other.counts[i].load(std::memory_order_relaxed);
+            if (c) counts[i].fetch_add(c, std::memory_order_relaxed);
+        }
+    }
+
+    void reset()
+    {
+        for (size_t i = 0;i < bucket_count;i ++) counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    /* the number of values recorded */
+    uint64_t total() const
+    {
+        uint64_t t = 0;
+        for (size_t i = 0;i < bucket_count;i ++) t += counts[i].load(std::memory_order_relaxed);
+        return t;
+    }
+
+    /* the value below which the fraction q (0..1) of the recorded values fall, e.g. 0.99 for p99
+       returns 0 if nothing has been recorded */
+    uint64_t percentile(double q) const
+    {
+        uint64_t t = total();
+        if (!t) return 0;
+        // the rank of the value we want, counting from 1
+        uint64_t rank = (uint64_t)(q * t + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > t) rank = t;
+        uint64_t seen = 0;
+        for (size_t i = 0;i < bucket_count;i ++)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return representative_value(i);
+        }
+        return representative_value(bucket_count - 1);
+    }
+
+    /* values below 2*sub_bucket_count get a bucket each, above that the top sub_bucket_bits+1 bits
+       pick the bucket within each power of two */
+    static size_t index_of(uint64_t value)
+    {
+        if (value < 2 * sub_bucket_count) return (size_t)value;
+        int shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+        return (size_t)((shift + 1) * sub_bucket_count + ((value >> shift) - sub_bucket_count));
+    }
+
+    /* the lowest value that maps to the bucket */
+    static uint64_t lowest_value(size_t index)
+    {
+        if (index < 2 * sub_bucket_count) return index;
+        int shift = (int)(index / sub_bucket_count) - 1;
+        return (sub_bucket_count + index % sub_bucket_count) << shift;
+    }
+
+    /* the middle of the range of values that map to the bucket */
+    static uint64_t representative_value(size_t index)
+    {
+        if (index < 2 * sub_bucket_count) return index;
+        int shift = (int)(index / sub_bucket_count) - 1;
+        return lowest_value(index) + ((1ULL << shift) >> 1);
+    }
+
+private:
+    std::atomic<uint64_t> counts[bucket_count];
+};
+
+/* records the nanoseconds between construction and destruction into a histogram */
+class scoped_latency
+{
+    latency_histogram & histogram;
+    std::chrono::steady_clock::time_point started;
+public:
+    scoped_latency(latency_histogram & histogram) : histogram(histogram), started(std::chrono::steady_clock::now()) {}
+    ~scoped_latency()
+    {
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+    }
+};
+
+#endif
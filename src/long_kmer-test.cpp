@@ -0,0 +1,89 @@
+#include "unit_test.hpp"
+#include "long_kmer.hpp"
+#include "kmer_scan.hpp"
+#include "bloomfilter_basic.hpp"
+#include "bloomfilter_perfectcheat.hpp"
+#include <random>
+#include <string>
+#include <algorithm>
+
+class test_long_kmer_t : public unit_test
+{
+    static std::string reverse_complement(const std::string & s)
+    {
+        std::string r(s.rbegin(), s.rend());
+        for (size_t i = 0;i < r.size();i ++)
+            r[i] = r[i] == 'A' ? 'T' : r[i] == 'C' ? 'G' : r[i] == 'G' ? 'C' : 'A';
+        return r;
+    }
+
+    /* every kmer read matches the text and reverse complements correctly */
+    template<typename kmer_type>
+    bool check_rolling(const std::string & sequence, kmer_size_t k)
+    {
+        basic_kmer_ops<kmer_type> ops(k);
+        const char * p = sequence.c_str();
+        kmer_type kmer;
+        if (!ops.read_first(&kmer, &p)) return false;
+        size_t position = 0;
+        bool ok = true;
+        do {
+            std::string expected = sequence.substr(position ++, k);
+            ok &= ops.str(kmer) == expected;
+            ok &= ops.str(ops.reverse_complement(kmer)) == reverse_complement(expected);
+            ok &= ops.reverse_complement(ops.reverse_complement(kmer)) == kmer;
+        } while (ops.read_next(&kmer, &p));
+        return ok && position == sequence.size() - k + 1;
+    }
+
+    template<typename kmer_type>
+    bool check_filter(const std::string & sequence, const std::string & other, kmer_size_t k)
+    {
+        basic_kmer_ops<kmer_type> ops(k);
+        bloomfilter_basic<kmer_type, uint64_t, long_kmer_hash<kmer_type> > filter(1 << 16, 4);
+        size_t kmers = insert_kmers(filter, ops, sequence.c_str());
+        size_t total, hits = count_kmer_hits(filter, ops, sequence.c_str(), &total);
+        size_t other_total, other_hits = count_kmer_hits(filter, ops, other.c_str(), &other_total);
+        return hits == kmers && total == kmers && other_hits < other_total / 50;
+    }
+
+    void operator() ()
+    {
+        section("long kmers");
+        std::mt19937 rng(17);
+        std::string sequence(400, 'A'), other(400, 'A');
+        for (size_t i = 0;i < sequence.size();i ++) sequence[i] = "ACGT"[rng() & 3];
+        for (size_t i = 0;i < other.size();i ++) other[i] = "ACGT"[rng() & 3];
+
+        check(check_rolling<uint64_t>(sequence, 31) && check_rolling<uint64_t>(sequence, 32), "64 bit kmers roll");
+        check(check_rolling<kmer128_t>(sequence, 51) && check_rolling<kmer128_t>(sequence, 64), "128 bit kmers roll");
+        check(check_rolling<kmer_words<2> >(sequence, 63) && check_rolling<kmer_words<2> >(sequence, 64),
+            "2 word kmers roll");
+        check(check_rolling<kmer_words<4> >(sequence, 101) && check_rolling<kmer_words<4> >(sequence, 127),
+            "4 word kmers roll");
+
+        kmer_ops ops(21);
+        basic_kmer_ops<uint64_t> long_ops(21);
+        const char * p = sequence.c_str(), * q = sequence.c_str();
+        kmer_t a, b;
+        ops.read_first(&a, &p);
+        long_ops.read_first(&b, &q);
+        check(a == b && ops.complement(a) == long_ops.complement(b), "64 bit long kmer ops match kmer_ops");
+        check(long_kmer_hash<kmer_words<1> >()(kmer_words<1>(a)) == kmer_fmix_hash<>()(a),
+            "one word long kmer hash matches kmer_fmix_hash");
+
+        bool threw = false;
+        try { basic_kmer_ops<kmer128_t> too_long(65); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "kmers longer than the type throw");
+
+        check(check_filter<kmer128_t>(sequence, other, 55), "filter of 128 bit kmers");
+        check(check_filter<kmer_words<2> >(sequence, other, 63), "filter of 2 word kmers");
+        check(check_filter<kmer_words<4> >(sequence, other, 127), "filter of 4 word kmers");
+
+        basic_kmer_ops<kmer_words<2> > ops63(63);
+        bloomfilter_perfectcheat<kmer_words<2> > exact(1 << 16, 4);
+        insert_kmers(exact, ops63, sequence.c_str());
+        size_t total;
+        check(count_kmer_hits(exact, ops63, other.c_str(), &total) == 0, "kmer_words works with std::hash");
+    }
+} test_long_kmer;
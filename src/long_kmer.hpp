@@ -0,0 +1,269 @@
+/*
+    Kmers longer than 31 bases
+
+    kmer_t is a single 64 bit word, so kmer.hpp stops at MAXKMERLENGTH 31.  This adds two wider kmer types
+    using the same 2 bit encoding (first base most significant):
+        kmer128_t          - __uint128_t, up to 64 bases
+        kmer_words<words>  - a fixed array of 64 bit words, least significant first, up to 32 * words bases
+    Both are plain values that the compiler keeps in registers, so the rolling update in read_next() is a
+    couple of shifts and ors per word.
+
+    basic_kmer_ops<kmer type> has the same interface as kmer_ops plus reverse_complement(), and the length is
+    picked at run time up to the type's limit.  long_kmer_hash<kmer type> is fmix64 folded over the words and
+    can be the Hash of any of the filters, with the kmer type as index_t:
+
+        basic_kmer_ops<kmer_words<2> > ops(101);
+        bloomfilter_basic<kmer_words<2>, uint64_t, long_kmer_hash<kmer_words<2> > > filter(m, h);
+        insert_kmers(filter, ops, sequence);
+
+    The filters keep their iterated hash value in an index_t and take it modulo m, so both types convert from
+    a 64 bit hash and kmer_words has a % that uses the bottom word - which is all a hash value occupies.
+*/
+#ifndef __LONG_KMER_HPP
+#define __LONG_KMER_HPP
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <functional>
+#include <stdexcept>
+
+typedef __uint128_t kmer128_t;
+
+/* a kmer of up to 32 * words bases, least significant word first */
+template<unsigned int words>
+struct kmer_words
+{
+    static_assert(words >= 1, "kmer_words needs at least one word");
+    uint64_t word[words];
+
+    /* uninitialised, like the built in types */
+    kmer_words() {}
+
+    /* value in the bottom word - how a hash value gets back into the filters' index_t */
+    kmer_words(uint64_t value)
+    {
+        word[0] = value;
+        for (unsigned int i = 1;i < words;i ++) word[i] = 0;
+    }
+
+    /* shift is less than 64 */
+    kmer_words & operator<<=(unsigned int shift)
+    {
+        for (unsigned int i = words - 1;i > 0;i --) word[i] = (word[i] << shift) | (word[i - 1] >> (64 - shift));
+        word[0] <<= shift;
+        return *this;
+    }
+
+    /* any shift */
+    kmer_words & operator>>=(unsigned int shift)
+    {
+        unsigned int whole = shift / 64, bits = shift % 64;
+        for (unsigned int i = 0;i < words;i ++)
+        {
+            uint64_t low = i + whole < words ? word[i + whole] : 0;
+            uint64_t high = i + whole + 1 < words ? word[i + whole + 1] : 0;
+            word[i] = bits ? (low >> bits) | (high << (64 - bits)) : low;
+        }
+        return *this;
+    }
+
+    kmer_words & operator|=(uint64_t bits)
+    {
+        word[0] |= bits;
+        return *this;
+    }
+
+    kmer_words & operator&=(const kmer_words & other)
+    {
+        for (unsigned int i = 0;i < words;i ++) word[i] &= other.word[i];
+        return *this;
+    }
+
+    kmer_words operator^(const kmer_words & other) const
+    {
+        kmer_words result;
+        for (unsigned int i = 0;i < words;i ++) result.word[i] = word[i] ^ other.word[i];
+        return result;
+    }
+
+    /* the bottom bits, e.g. & 3 for the last base */
+    uint64_t operator&(uint64_t mask) const { return word[0] & mask; }
+
+    /* only meaningful for a hash value, which occupies the bottom word */
+    size_t operator%(size_t m) const { return word[0] % m; }
+
+    bool operator==(const kmer_words & other) const
+    {
+        for (unsigned int i = 0;i < words;i ++) if (word[i] != other.word[i]) return false;
+        return true;
+    }
+
+    bool operator!=(const kmer_words & other) const { return !(*this == other); }
+};
+
+/* the operations on each kmer type that differ by representation */
+template<typename kmer_type>
+struct kmer_traits;
+
+/* reverses the order of the 32 bases in x and complements them */
+inline uint64_t reverse_complement_word(uint64_t x)
+{
+    x = ~x;
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((x & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    return __builtin_bswap64(x);
+}
+
+template<>
+struct kmer_traits<uint64_t>
+{
+    static const unsigned int max_length = 32;
+
+    static uint64_t reverse_complement(uint64_t kmer, unsigned int length)
+    {
+        return reverse_complement_word(kmer) >> (64 - 2 * length);
+    }
+
+    static uint64_t hash(uint64_t kmer, uint64_t seed)
+    {
+        return kmer_fmix64(kmer ^ seed);
+    }
+};
+
+template<>
+struct kmer_traits<kmer128_t>
+{
+    static const unsigned int max_length = 64;
+
+    static kmer128_t reverse_complement(kmer128_t kmer, unsigned int length)
+    {
+        kmer128_t reversed = ((kmer128_t)reverse_complement_word((uint64_t)kmer) << 64) |
+            reverse_complement_word((uint64_t)(kmer >> 64));
+        return reversed >> (128 - 2 * length);
+    }
+
+    static uint64_t hash(kmer128_t kmer, uint64_t seed)
+    {
+        return kmer_fmix64(kmer_fmix64((uint64_t)kmer ^ seed) ^ (uint64_t)(kmer >> 64));
+    }
+};
+
+template<unsigned int words>
+struct kmer_traits<kmer_words<words> >
+{
+    static const unsigned int max_length = 32 * words;
+
+    static kmer_words<words> reverse_complement(const kmer_words<words> & kmer, unsigned int length)
+    {
+        kmer_words<words> reversed;
+        for (unsigned int i = 0;i < words;i ++) reversed.word[i] = reverse_complement_word(kmer.word[words - 1 - i]);
+        reversed >>= 64 * words - 2 * length;
+        return reversed;
+    }
+
+    static uint64_t hash(const kmer_words<words> & kmer, uint64_t seed)
+    {
+        uint64_t h = kmer_fmix64(kmer.word[0] ^ seed);
+        for (unsigned int i = 1;i < words;i ++) h = kmer_fmix64(h ^ kmer.word[i]);
+        return h;
+    }
+};
+
+/* fmix64 folded over the words of the kmer - use as the Hash of the filters for long kmers.  For a single
+   word it is identical to kmer_fmix_hash */
+template<typename kmer_type, uint64_t seed = 0x9e3779b97f4a7c15ULL>
+struct long_kmer_hash
+{
+    std::size_t operator()(const kmer_type & kmer) const
+    {
+        return (size_t)kmer_traits<kmer_type>::hash(kmer, seed);
+    }
+};
+
+/* kmer_ops for any of the kmer types above - see kmer_ops for the methods */
+template<typename kmer_type_t>
+class basic_kmer_ops
+{
+public:
+    typedef kmer_type_t kmer_type;
+private:
+    kmer_size_t length;
+    /* the bottom 2 * length bits */
+    kmer_type mask;
+public:
+    basic_kmer_ops(kmer_size_t length) : length(length)
+    {
+        if (length < 1 || length > kmer_traits<kmer_type>::max_length) throw std::runtime_error("kmer length too long");
+        mask = kmer_type(0);
+        for (kmer_size_t i = 0;i < length;i ++)
+        {
+            mask <<= 2;
+            mask |= 3;
+        }
+    }
+
+    bool read_first(kmer_type * kmer, char const * * sequence) const
+    {
+        *kmer = kmer_type(0);
+        for (kmer_size_t todo = length;todo > 0;todo --)
+            if (!read_next(kmer, sequence)) return false;
+        return true;
+    }
+
+    inline bool read_next(kmer_type * kmer, char const * * sequence) const
+    {
+        size_t ix = (unsigned char)**sequence;
+        if (!ix) return false;
+        if (ix > 127) throw std::runtime_error("Non-ascii characters encountered when reading nucleotides");
+        (*sequence)++;
+        kmer_t bits = text_mapping.asciiToBits[ix];
+        if (bits == KMER_INVALID) throw std::runtime_error("Invalid character when reading nucleotides");
+        *kmer <<= 2;
+        *kmer |= bits;
+        *kmer &= mask;
+        return true;
+    }
+
+    std::string str(const kmer_type & kmer) const
+    {
+        std::string buf(length, '?');
+        kmer_type working = kmer;
+        for (kmer_size_t todo = length;todo > 0;todo --)
+        {
+            buf[todo - 1] = text_mapping.bitsToAscii[(unsigned int)(working & 3)];
+            working >>= 2;
+        }
+        return buf;
+    }
+
+    /* A->T, C->G, G->C, T->A in place */
+    kmer_type complement(const kmer_type & kmer) const
+    {
+        return kmer ^ mask;
+    }
+
+    /* the kmer of the opposite strand: complemented and reversed */
+    kmer_type reverse_complement(const kmer_type & kmer) const
+    {
+        return kmer_traits<kmer_type>::reverse_complement(kmer, length);
+    }
+
+    kmer_size_t getlength() const { return length; }
+};
+
+namespace std
+{
+    /* so long kmers work with the standard containers (and bloomfilter_perfectcheat) */
+    template<unsigned int words>
+    struct hash<kmer_words<words> >
+    {
+        size_t operator()(const kmer_words<words> & kmer) const
+        {
+            return long_kmer_hash<kmer_words<words> >()(kmer);
+        }
+    };
+}
+
+#endif
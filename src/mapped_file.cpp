@@ -0,0 +1,39 @@
+#include "mapped_file.hpp"
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+mapped_file::mapped_file(const std::string & path) : mapping(0), length(0)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Could not open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Could not stat " + path);
+    }
+    length = info.st_size;
+    if (length)
+    {
+        void * mapped = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Could not map " + path + ": " + strerror(error));
+        }
+        mapping = (const char *)mapped;
+    }
+    // the mapping keeps the file open
+    close(fd);
+}
+
+mapped_file::~mapped_file()
+{
+    if (mapping) munmap((void *)mapping, length);
+}
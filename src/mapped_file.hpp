@@ -0,0 +1,30 @@
+/*
+    A whole file mapped read-only into memory
+
+    Pages are read in as they are first touched, by whichever thread touches them, so several threads working
+    on different parts of a file read it in parallel without any reads being issued by hand - see
+    fasta_chunks.hpp.  An empty file maps to a null data() with size() 0.
+*/
+#ifndef __MAPPED_FILE_HPP
+#define __MAPPED_FILE_HPP
+#include <string>
+#include <stddef.h>
+
+class mapped_file
+{
+private:
+    const char * mapping;
+    size_t length;
+public:
+    /* maps the file at path.  Throws std::runtime_error if it can't be opened or mapped */
+    mapped_file(const std::string & path);
+    mapped_file(const mapped_file &) = delete;
+    mapped_file & operator=(const mapped_file &) = delete;
+
+    virtual ~mapped_file();
+
+    const char * data() const { return mapping; }
+    size_t size() const { return length; }
+};
+
+#endif
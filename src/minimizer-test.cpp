@@ -0,0 +1,89 @@
+#include "unit_test.hpp"
+#include "minimizer.hpp"
+#include "partitioned_filter.hpp"
+#include "bloomfilter_basic.hpp"
+#include "kmer_scan.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+class test_minimizer_t : public unit_test
+{
+    void operator() ()
+    {
+        section("minimizers");
+        std::mt19937 rng(23);
+        std::string sequence(2000, 'A');
+        for (size_t i = 0;i < sequence.size();i ++) sequence[i] = "ACGT"[rng() & 3];
+
+        const kmer_size_t k = 31, m = 15;
+        minimizer_ops ops(k, m);
+        minimizer_scan scan;
+        size_t count = ops.scan(sequence.c_str(), scan);
+
+        // brute force: hash every m-mer of every kmer
+        kmer_ops mmers(m);
+        kmer_fmix_hash<MINIMIZER_SEED> hash;
+        bool same = count == sequence.size() - k + 1;
+        for (size_t i = 0;same && i < count;i ++)
+        {
+            uint64_t smallest = ~0ULL;
+            for (size_t j = 0;j + m <= k;j ++)
+            {
+                std::string mmer = sequence.substr(i + j, m);
+                const char * p = mmer.c_str();
+                kmer_t value;
+                mmers.read_first(&value, &p);
+                smallest = std::min(smallest, (uint64_t)hash(value));
+            }
+            same = scan.minimizers[i] == smallest;
+        }
+        check(same, "minimizers match a brute force scan");
+
+        size_t super_kmers = 0;
+        for (size_t first = 0;first < count;first += scan.super_kmer_length(first)) super_kmers ++;
+        check(super_kmers < count / 5, "consecutive kmers share minimizers");
+        check(ops.scan("ACGT", scan) == 0, "short sequences have no kmers");
+
+        bool threw = false;
+        try { minimizer_ops bad(15, 21); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "minimizers longer than k throw");
+
+        section("partitioned filter");
+        partitioned_filter<> filter(1 << 20, 3, 16 * 1024);
+        size_t inserted = insert_super_kmers(filter, ops, sequence.c_str(), scan);
+        size_t total;
+        check(filter.getpartitions() == 8 && count_super_kmer_hits(filter, ops, sequence.c_str(), scan, &total) == inserted
+            && total == inserted, "partitioned filter finds every kmer");
+        std::string other(2000, 'A');
+        for (size_t i = 0;i < other.size();i ++) other[i] = "ACGT"[rng() & 3];
+        check(count_super_kmer_hits(filter, ops, other.c_str(), scan, &total) < total / 50, "few false positives");
+
+        // a filter much bigger than the cache: random inserts against a super-kmer at a time
+        std::vector<std::string> reads(4096, std::string(1000, 'A'));
+        for (size_t r = 0;r < reads.size();r ++)
+            for (size_t i = 0;i < reads[r].size();i ++) reads[r][i] = "ACGT"[rng() & 3];
+        const size_t big = (size_t)1 << 30;
+        // prefaulted, so the timings are the cache misses rather than the page faults
+        storage_options options;
+        options.prefault_threads = 1;
+        bloomfilter_basic<kmer_t, uint64_t, kmer_fmix_hash<> > basic(big, 3, options);
+        partitioned_filter<> partitioned(big, 3, PARTITION_BYTES, options);
+        kmer_ops kmers(k);
+        size_t basic_kmers = 0, partitioned_kmers = 0;
+        std::cout << "insert " << reads.size() << " reads into a " << (big >> 23) << "MB filter:" << std::endl;
+        {
+            scoped_timer t("\tbloomfilter_basic", reads.size());
+            for (size_t r = 0;r < reads.size();r ++) basic_kmers += insert_kmers(basic, kmers, reads[r].c_str());
+        }
+        {
+            scoped_timer t("\tpartitioned by minimizer", reads.size());
+            for (size_t r = 0;r < reads.size();r ++) partitioned_kmers += insert_super_kmers(partitioned, ops, reads[r].c_str(), scan);
+        }
+        std::cout << std::endl;
+        check(basic_kmers == partitioned_kmers && count_super_kmer_hits(partitioned, ops, reads[0].c_str(), scan, &total) == total,
+            "large partitioned filter finds every kmer");
+    }
+} test_minimizer;
@@ -0,0 +1,58 @@
+#include "minimizer.hpp"
+#include <stdexcept>
+#include <string.h>
+
+minimizer_ops::minimizer_ops(kmer_size_t k, kmer_size_t m) : k(k), m(m)
+{
+    if (k < 1 || k > MAXKMERLENGTH) throw std::runtime_error("kmer length too long");
+    if (m < 1 || m > k) throw std::runtime_error("Minimizer length must be from 1 to k");
+}
+
+size_t minimizer_ops::scan(const char * sequence, minimizer_scan & result) const
+{
+    size_t length = strlen(sequence);
+    if (length < k)
+    {
+        result.kmers.clear();
+        result.minimizers.clear();
+        return 0;
+    }
+    result.kmers.resize(length - k + 1);
+    result.hashes.resize(length - m + 1);
+
+    // one pass over the sequence: the last m bases of each kmer as it rolls are the m-mers
+    const kmer_t kmer_mask = (1ULL << (2 * k)) - 1, mmer_mask = (1ULL << (2 * m)) - 1;
+    kmer_t * kmers = &result.kmers[0];
+    uint64_t * mmers = &result.hashes[0];
+    kmer_t rolling = 0;
+    for (size_t i = 0;i < length;i ++)
+    {
+        size_t ix = (unsigned char)sequence[i];
+        if (ix > 127) throw std::runtime_error("Non-ascii characters encountered when reading nucleotides");
+        kmer_t bits = text_mapping.asciiToBits[ix];
+        if (bits == KMER_INVALID) throw std::runtime_error("Invalid character when reading nucleotides");
+        rolling = ((rolling << 2) | bits) & kmer_mask;
+        if (i + 1 >= m) mmers[i + 1 - m] = rolling & mmer_mask;
+        if (i + 1 >= k) kmers[i + 1 - k] = rolling;
+    }
+    kmer_fmix_hash<MINIMIZER_SEED>::hash_batch(&result.hashes[0], result.hashes.size());
+
+    // window holds the positions whose hashes could still be the minimum of a later window, in increasing
+    // position and increasing hash, so the front is the minimum of the current one.  Each position goes on
+    // and comes off at most once
+    const size_t w = k - m + 1;
+    result.window.resize(result.hashes.size());
+    result.minimizers.resize(result.kmers.size());
+    uint32_t * window = &result.window[0];
+    const uint64_t * hashes = &result.hashes[0];
+    size_t head = 0, tail = 0;
+    for (size_t i = 0;i < result.hashes.size();i ++)
+    {
+        // on ties the leftmost stays the minimum
+        while (tail > head && hashes[window[tail - 1]] > hashes[i]) tail --;
+        window[tail ++] = i;
+        if (window[head] + w <= i) head ++;
+        if (i + 1 >= w) result.minimizers[i + 1 - w] = hashes[window[head]];
+    }
+    return result.kmers.size();
+}
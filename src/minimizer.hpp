@@ -0,0 +1,63 @@
+/*
+    Minimizers and super-kmers
+
+    The minimizer of a kmer is its m-mer (m <= k) with the smallest hash.  Consecutive kmers of a sequence
+    overlap by k - 1 bases, so they usually share a minimizer, and a maximal run of kmers sharing one is a
+    super-kmer - about (k - m + 2) / 2 kmers long on average with random hashes.  Anything keyed on the
+    minimizer (see partitioned_filter.hpp) then sees a super-kmer's kmers together rather than scattered.
+
+    minimizer_ops::scan() reads every kmer and m-mer of a sequence in one pass (the m-mers are the last m bases
+    of each rolling kmer), hashes the m-mers in one go with the vectorised kmer_fmix_hash kernel, and takes the
+    minimum over each window of k - m + 1 m-mers with a monotone deque, so the whole scan is linear in the
+    sequence length.  The m-mer hash has its own
+    seed so that it isn't correlated with the kmer hashes of a filter using kmer_fmix_hash<>.
+*/
+#ifndef __MINIMIZER_HPP
+#define __MINIMIZER_HPP
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/* seeds the m-mer hash */
+const uint64_t MINIMIZER_SEED = 0x8ebc6af09c88c6e3ULL;
+
+/* the kmers of a sequence and the hash of each one's minimizer, reused between scans to save allocating */
+struct minimizer_scan
+{
+    std::vector<kmer_t> kmers;
+    /* minimizers[i] is the hash of the minimizer of kmers[i] */
+    std::vector<uint64_t> minimizers;
+    /* working space: the hash of every m-mer, and the deque of m-mer positions */
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> window;
+
+    size_t size() const { return kmers.size(); }
+
+    /* the length of the super-kmer starting at kmer first - the run of kmers with the same minimizer */
+    size_t super_kmer_length(size_t first) const
+    {
+        size_t last = first + 1;
+        while (last < minimizers.size() && minimizers[last] == minimizers[first]) last ++;
+        return last - first;
+    }
+};
+
+class minimizer_ops
+{
+private:
+    kmer_size_t k;
+    kmer_size_t m;
+public:
+    /* kmers of length k with minimizers of length m.  Throws std::runtime_error unless 1 <= m <= k */
+    minimizer_ops(kmer_size_t k, kmer_size_t m);
+
+    /* fills result with the kmers of the null-terminated sequence and their minimizers, returning how many */
+    size_t scan(const char * sequence, minimizer_scan & result) const;
+
+    kmer_size_t getk() const { return k; }
+    kmer_size_t getm() const { return m; }
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+    A bloom filter split into cache sized partitions picked by minimizer
+
+    In a filter of several GB every insert is h cache misses at random places.  Here the bit array is split
+    into partitions of partition_bytes (256KB by default, to sit in L2) and all h bits of a kmer go in the
+    partition its minimizer hashes to (see minimizer.hpp).  Inserting a sequence a super-kmer at a time then
+    touches one partition per super-kmer, which stays in cache while its kmers are inserted, instead of one
+    random line per hash per kmer.
+
+    The cost is that the partitions fill unevenly, so for the same m and h the false positive rate is a little
+    higher than bloomfilter_basic's, and a query has to know the kmer's minimizer - which count_super_kmer_hits
+    gets from the same scan.  Within a partition bit positions are chosen with Hash iterated as in the other
+    filters.
+*/
+#ifndef __PARTITIONED_FILTER_HPP
+#define __PARTITIONED_FILTER_HPP
+#include "minimizer.hpp"
+#include "popcount.hpp"
+#include "filter_storage.hpp"
+#include "kmer_hash.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdexcept>
+#include <algorithm>
+
+/* the default partition size - a typical L2 cache */
+const size_t PARTITION_BYTES = 256 * 1024;
+
+template<typename Hash = kmer_fmix_hash<> >
+class partitioned_filter
+{
+private:
+    int h;
+    size_t partitions;
+    size_t partition_bits;
+    /* partition_bits - 1, since partition_bits is a power of two */
+    size_t bit_mask;
+    filter_storage storage;
+    uint64_t * bits;
+
+    /* the first word of the partition for minimizer */
+    const uint64_t * partition(uint64_t minimizer) const { return bits + (minimizer % partitions) * (partition_bits / 64); }
+    uint64_t * partition(uint64_t minimizer) { return bits + (minimizer % partitions) * (partition_bits / 64); }
+public:
+    /* at least m bits, rounded up to whole partitions of partition_bytes (a power of two of at least 8) */
+    partitioned_filter(size_t m, int h, size_t partition_bytes = PARTITION_BYTES,
+        const storage_options & options = storage_options())
+        : h(h), partitions(std::max((size_t)1, (m + partition_bytes * 8 - 1) / (partition_bytes * 8))),
+        partition_bits(partition_bytes * 8), bit_mask(partition_bits - 1), storage(partitions * partition_bytes, options)
+    {
+        if (h <= 0) throw std::runtime_error("partitioned_filter needs at least one hash function");
+        if (partition_bytes < 8 || (partition_bytes & (partition_bytes - 1)))
+            throw std::runtime_error("Partition size must be a power of two of at least 8 bytes");
+        bits = (uint64_t *)storage.data();
+    }
+
+    /* adds a kmer whose minimizer hash is minimizer */
+    inline void add(kmer_t kmer, uint64_t minimizer)
+    {
+        add_super_kmer(&kmer, 1, minimizer);
+    }
+
+    inline bool contains(kmer_t kmer, uint64_t minimizer) const
+    {
+        static Hash hashfunction;
+        const uint64_t * words = partition(minimizer);
+        uint64_t hashvalue = kmer;
+        for (int hcount = h; hcount > 0; hcount--)
+        {
+            hashvalue = hashfunction(hashvalue);
+            size_t bitindex = hashvalue & bit_mask;
+            if (!(words[bitindex / 64] & (1ULL << (bitindex & 63)))) return false;
+        }
+        return true;
+    }
+
+    /* adds count kmers that share the minimizer hash minimizer */
+    void add_super_kmer(const kmer_t * kmers, size_t count, uint64_t minimizer)
+    {
+        static Hash hashfunction;
+        uint64_t * words = partition(minimizer);
+        for (size_t i = 0;i < count;i ++)
+        {
+            uint64_t hashvalue = kmers[i];
+            for (int hcount = h; hcount > 0; hcount--)
+            {
+                hashvalue = hashfunction(hashvalue);
+                size_t bitindex = hashvalue & bit_mask;
+                words[bitindex / 64] |= 1ULL << (bitindex & 63);
+            }
+        }
+    }
+
+    size_t count_set_bits() const
+    {
+        return popcount_bytes(bits, partitions * partition_bits / 8);
+    }
+
+    size_t getm() const { return partitions * partition_bits; }
+    int geth() const { return h; }
+    size_t getpartitions() const { return partitions; }
+};
+
+/* inserts every kmer of the null-terminated sequence a super-kmer at a time, returning the number of kmers.
+   scan is working space */
+template<typename Hash>
+size_t insert_super_kmers(partitioned_filter<Hash> & filter, const minimizer_ops & ops, const char * sequence,
+    minimizer_scan & scan)
+{
+    size_t count = ops.scan(sequence, scan);
+    for (size_t first = 0, length;first < count;first += length)
+    {
+        length = scan.super_kmer_length(first);
+        filter.add_super_kmer(&scan.kmers[first], length, scan.minimizers[first]);
+    }
+    return count;
+}
+
+/* returns how many of the kmers of the null-terminated sequence the filter contains, and sets total to the
+   number of kmers */
+template<typename Hash>
+size_t count_super_kmer_hits(const partitioned_filter<Hash> & filter, const minimizer_ops & ops, const char * sequence,
+    minimizer_scan & scan, size_t * total)
+{
+    *total = ops.scan(sequence, scan);
+    size_t hits = 0;
+    for (size_t i = 0;i < *total;i ++) hits += filter.contains(scan.kmers[i], scan.minimizers[i]);
+    return hits;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+    Hardware performance counters for the calling thread via linux perf_event_open
+
+    Counts cycles, instructions, last level cache misses, data TLB misses and branch misses (user space only,
+    so it works with the default perf_event_paranoid setting).  Each event is opened separately so that one
+    the cpu/hypervisor doesn't support doesn't stop the others - check available() before using a value.
+    Values are scaled up if the kernel had to multiplex the counters.
+
+    On other platforms nothing is available.
+*/
+#ifndef __PERF_COUNTERS_HPP
+#define __PERF_COUNTERS_HPP
+#include <stdint.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+class perf_counters
+{
+public:
+    enum event { cycles, instructions, llc_misses, dtlb_misses, branch_misses, event_count };
+
+    /* short name of the event, suitable as a column or key name */
+    static const char * name(int e)
+    {
+        static const char * names[event_count] = { "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+        return names[e];
+    }
+
+    /* opens the counters (stopped) */
+    perf_counters()
+    {
+        for (int e = 0;e < event_count;e ++)
+        {
+            fds[e] = -1;
+            values[e] = 0;
+        }
+#ifdef __linux__
+        const uint32_t types[event_count] =
+            { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+        const uint64_t configs[event_count] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_BRANCH_MISSES };
+        for (int e = 0;e < event_count;e ++)
+        {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[e];
+            attr.config = configs[e];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[e] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    perf_counters(const perf_counters &) = delete;
+    perf_counters & operator=(const perf_counters &) = delete;
+
+    ~perf_counters()
+    {
+#ifdef __linux__
+        for (int e = 0;e < event_count;e ++)
+            if (fds[e] >= 0) close(fds[e]);
+#endif
+    }
+
+    /* zeroes and starts all the available counters */
+    void start()
+    {
+#ifdef __linux__
+        for (int e = 0;e < event_count;e ++)
+        {
+            if (fds[e] < 0) continue;
+            ioctl(fds[e], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /* stops the counters and reads their values */
+    void stop()
+    {
+#ifdef __linux__
+        for (int e = 0;e < event_count;e ++)
+            if (fds[e] >= 0) ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        for (int e = 0;e < event_count;e ++)
+        {
+            if (fds[e] < 0) continue;
+            // value, time enabled, time running
+            uint64_t data[3];
+            if (read(fds[e], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+                values[e] = 0;
+            else
+                values[e] = data[0] * ((double)data[1] / data[2]);
+        }
+#endif
+    }
+
+    /* true if the event could be opened */
+    bool available(int e) const { return fds[e] >= 0; }
+
+    /* true if any of the events could be opened */
+    bool any_available() const
+    {
+        for (int e = 0;e < event_count;e ++)
+            if (available(e)) return true;
+        return false;
+    }
+
+    /* the count between the last start() and stop() */
+    double value(int e) const { return values[e]; }
+
+private:
+    int fds[event_count];
+    double values[event_count];
+};
+
+#endif
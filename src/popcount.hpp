@@ -0,0 +1,102 @@
+/*
+    Counts the set bits in a block of memory
+
+    popcount_bytes uses the AVX2 nibble lookup (pshufb on each half byte, summed with psadbw) when the cpu
+    supports it, otherwise __builtin_popcountll 8 bytes at a time.  Used by the filters to work out their
+    fill ratio - see bloomfilter::statistics()
+
+    popcount_words_relaxed is for memory other threads are setting bits in (see
+    bloomfilter::statistics_async): each word is read with a relaxed atomic load, so it can't use the vector
+    loads, but it is compiled for the popcnt instruction when the cpu has it - without -mpopcnt
+    __builtin_popcountll is a call into libgcc for every word.
+*/
+#ifndef __POPCOUNT_HPP
+#define __POPCOUNT_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <immintrin.h>
+
+inline size_t popcount_bytes_scalar(const uint8_t * data, size_t bytes)
+{
+    size_t count = 0;
+    size_t i = 0;
+    for (;i + 8 <= bytes;i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        count += __builtin_popcountll(word);
+    }
+    for (;i < bytes;i ++) count += __builtin_popcount(data[i]);
+    return count;
+}
+
+__attribute__ ((target ("avx2,popcnt")))
+inline size_t popcount_bytes_avx2(const uint8_t * data, size_t bytes)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    while (i + 32 <= bytes)
+    {
+        // the byte counts can't overflow for 255/8 = 31 iterations, so sum them with psadbw every 31
+        __m256i local = _mm256_setzero_si256();
+        for (int j = 0;j < 31 && i + 32 <= bytes;j ++, i += 32)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+            __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+            __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+            local = _mm256_add_epi8(local, _mm256_add_epi8(lo, hi));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcount_bytes_scalar(data + i, bytes - i);
+}
+
+typedef size_t (*popcount_bytes_fn)(const uint8_t *, size_t);
+
+/* the number of 1 bits in the given bytes */
+inline size_t popcount_bytes(const void * data, size_t bytes)
+{
+    static const popcount_bytes_fn kernel = __builtin_cpu_supports("avx2") ? popcount_bytes_avx2 : popcount_bytes_scalar;
+    return kernel((const uint8_t *)data, bytes);
+}
+
+/* the 1 bits of count words, each read with a relaxed atomic load.  Four counts so the popcnts overlap */
+template<typename word_t>
+inline size_t popcount_words_relaxed_scalar(const word_t * words, size_t count)
+{
+    size_t counts[4] = { 0, 0, 0, 0 };
+    size_t i = 0;
+    for (;i + 4 <= count;i += 4)
+        for (int j = 0;j < 4;j ++) counts[j] += __builtin_popcountll((uint64_t)__atomic_load_n(&words[i + j], __ATOMIC_RELAXED));
+    for (;i < count;i ++) counts[0] += __builtin_popcountll((uint64_t)__atomic_load_n(&words[i], __ATOMIC_RELAXED));
+    return counts[0] + counts[1] + counts[2] + counts[3];
+}
+
+template<typename word_t>
+__attribute__ ((target ("popcnt")))
+inline size_t popcount_words_relaxed_popcnt(const word_t * words, size_t count)
+{
+    size_t counts[4] = { 0, 0, 0, 0 };
+    size_t i = 0;
+    for (;i + 4 <= count;i += 4)
+        for (int j = 0;j < 4;j ++) counts[j] += __builtin_popcountll((uint64_t)__atomic_load_n(&words[i + j], __ATOMIC_RELAXED));
+    for (;i < count;i ++) counts[0] += __builtin_popcountll((uint64_t)__atomic_load_n(&words[i], __ATOMIC_RELAXED));
+    return counts[0] + counts[1] + counts[2] + counts[3];
+}
+
+/* the number of 1 bits in count words that other threads may be writing to concurrently */
+template<typename word_t>
+inline size_t popcount_words_relaxed(const word_t * words, size_t count)
+{
+    static const bool popcnt = __builtin_cpu_supports("popcnt");
+    return popcnt ? popcount_words_relaxed_popcnt(words, count) : popcount_words_relaxed_scalar(words, count);
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+    Bitmaps of the bases of a read that kmers shouldn't be taken from
+
+    quality_mask() sets bit i (bit i % 64 of word i / 64) for every base whose quality is below min_quality
+    or which isn't one of ACGT (in either case), so an N is masked whatever its quality.  Qualities are the
+    FASTQ characters, so min_quality is the phred threshold + 33 - e.g. '+' (Q10) or '5' (Q20).  base_mask()
+    is the same without qualities, for FASTA.
+
+    The bitmap is built 32 bases at a time with AVX2 (16 with SSE2 otherwise): one compare of the quality
+    bytes against the threshold, four compares of the bases (lowercased with an or of 0x20) against a, c, g
+    and t, and a movemask.  The
+    masked scans in kmer_scan.hpp then skip every kmer that covers a set bit, so the bases that would only
+    add errors to a filter never reach it.
+*/
+#ifndef __QUALITY_MASK_HPP
+#define __QUALITY_MASK_HPP
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <immintrin.h>
+
+/* the number of 64 bit words in the bitmap for length bases */
+inline size_t quality_mask_words(size_t length)
+{
+    return (length + 63) / 64;
+}
+
+inline bool masked_base(char base, char quality, char min_quality)
+{
+    base |= 0x20;
+    return quality < min_quality || (base != 'a' && base != 'c' && base != 'g' && base != 't');
+}
+
+/* sets the bits from first to length one base at a time - the tail of the vector versions */
+inline void quality_mask_tail(const char * sequence, const char * quality, size_t first, size_t length, char min_quality,
+    uint64_t * mask)
+{
+    for (size_t i = first;i < length;i ++)
+        if (masked_base(sequence[i], quality[i], min_quality)) mask[i / 64] |= 1ULL << (i & 63);
+}
+
+inline void quality_mask_scalar(const char * sequence, const char * quality, size_t length, char min_quality, uint64_t * mask)
+{
+    memset(mask, 0, quality_mask_words(length) * sizeof(uint64_t));
+    quality_mask_tail(sequence, quality, 0, length, min_quality, mask);
+}
+
+inline void quality_mask_sse2(const char * sequence, const char * quality, size_t length, char min_quality, uint64_t * mask)
+{
+    memset(mask, 0, quality_mask_words(length) * sizeof(uint64_t));
+    // FASTQ qualities are printable ascii, so the signed byte compare is fine
+    const __m128i threshold = _mm_set1_epi8(min_quality);
+    const __m128i a = _mm_set1_epi8('a'), c = _mm_set1_epi8('c'), g = _mm_set1_epi8('g'), t = _mm_set1_epi8('t');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (;i + 16 <= length;i += 16)
+    {
+        __m128i q = _mm_loadu_si128((const __m128i *)(quality + i));
+        __m128i s = _mm_or_si128(_mm_loadu_si128((const __m128i *)(sequence + i)), lower);
+        __m128i valid = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(s, a), _mm_cmpeq_epi8(s, c)),
+            _mm_or_si128(_mm_cmpeq_epi8(s, g), _mm_cmpeq_epi8(s, t)));
+        __m128i bad = _mm_or_si128(_mm_cmplt_epi8(q, threshold), _mm_andnot_si128(valid, _mm_set1_epi8(-1)));
+        mask[i / 64] |= (uint64_t)(uint16_t)_mm_movemask_epi8(bad) << (i & 63);
+    }
+    quality_mask_tail(sequence, quality, i, length, min_quality, mask);
+}
+
+__attribute__ ((target ("avx2")))
+inline void quality_mask_avx2(const char * sequence, const char * quality, size_t length, char min_quality, uint64_t * mask)
+{
+    memset(mask, 0, quality_mask_words(length) * sizeof(uint64_t));
+    const __m256i threshold = _mm256_set1_epi8(min_quality);
+    const __m256i a = _mm256_set1_epi8('a'), c = _mm256_set1_epi8('c'), g = _mm256_set1_epi8('g'), t = _mm256_set1_epi8('t');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (;i + 32 <= length;i += 32)
+    {
+        __m256i q = _mm256_loadu_si256((const __m256i *)(quality + i));
+        __m256i s = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(sequence + i)), lower);
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(s, a), _mm256_cmpeq_epi8(s, c)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(s, g), _mm256_cmpeq_epi8(s, t)));
+        __m256i bad = _mm256_or_si256(_mm256_cmpgt_epi8(threshold, q), _mm256_andnot_si256(valid, _mm256_set1_epi8(-1)));
+        mask[i / 64] |= (uint64_t)(uint32_t)_mm256_movemask_epi8(bad) << (i & 63);
+    }
+    quality_mask_tail(sequence, quality, i, length, min_quality, mask);
+}
+
+typedef void (*quality_mask_fn)(const char *, const char *, size_t, char, uint64_t *);
+
+/* fills mask (quality_mask_words(length) words) with a bit for each base of sequence that is below
+   min_quality or isn't ACGT */
+inline void quality_mask(const char * sequence, const char * quality, size_t length, char min_quality, uint64_t * mask)
+{
+    static const quality_mask_fn kernel = __builtin_cpu_supports("avx2") ? quality_mask_avx2 : quality_mask_sse2;
+    kernel(sequence, quality, length, min_quality, mask);
+}
+
+/* fills mask with a bit for each base of sequence that isn't ACGT.  The sequence stands in for its own
+   qualities: every ascii byte passes a threshold of 0 and anything else isn't a base anyway */
+inline void base_mask(const char * sequence, size_t length, uint64_t * mask)
+{
+    quality_mask(sequence, sequence, length, 0, mask);
+}
+
+/* the first position from first on (up to length) whose bit in mask is set, if set, or clear otherwise */
+inline size_t next_mask_position(const uint64_t * mask, size_t first, size_t length, bool set)
+{
+    while (first < length)
+    {
+        uint64_t word = mask[first / 64];
+        if (!set) word = ~word;
+        word &= ~0ULL << (first & 63);
+        if (word) return std::min(length, (first & ~(size_t)63) + __builtin_ctzll(word));
+        first = (first & ~(size_t)63) + 64;
+    }
+    return length;
+}
+
+#endif
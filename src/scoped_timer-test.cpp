@@ -0,0 +1,21 @@
+#include "unit_test.hpp"
+#include "scoped_timer.hpp"
+#include <sstream>
+#include <string>
+
+class test_scoped_timer_t : public unit_test
+{
+    void operator() ()
+    {
+        section("scoped timer records");
+        std::stringstream record;
+        {
+            scoped_timer t("\ttimed \"scope\"", 10, true, &record);
+        }
+        std::cout << std::endl;
+        std::string line = record.str();
+        check(line.find("{\"description\":\"timed \\\"scope\\\"\"") == 0, "record starts with escaped description");
+        check(line.find("\"iterations\":10") != std::string::npos, "record has iterations");
+        check(line.find("}\n") == line.size() - 2, "record is a single line");
+    }
+} test_scoped_timer;
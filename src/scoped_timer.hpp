@@ -1,38 +1,83 @@
 /*
     Simple scope-based timer that prints the amount of time between instantiation and destruction - to be used to time blocks of code
+
+    Optionally it also counts cycles, instructions, LLC misses, dTLB misses and branch misses over the scope
+    (see perf_counters.hpp) and prints them per iteration, and/or writes a JSON record of everything to a stream
 */
 #ifndef __SCOPED_TIMER_H
 #define __SCOPED_TIMER_H
 #include <chrono>
 #include <iostream>
 #include <string>
+#include <memory>
+#include "perf_counters.hpp"
 
 class scoped_timer {
     std::chrono::high_resolution_clock::time_point started;
     std::string description;
     int iterations;
+    std::unique_ptr<perf_counters> counters;
+    std::ostream * record;
 public:
-    
-    /* constructs and starts the timer */
-    scoped_timer(const char * description, int iterations = 0) 
-        : started(std::chrono::high_resolution_clock::now()), 
-        description(description),
-        iterations(iterations)
+
+    /* constructs and starts the timer
+       if use_counters is true the hardware counters are reported too
+       if record is given a JSON object (one per line) describing the scope is written to it */
+    scoped_timer(const char * description, int iterations = 0, bool use_counters = false, std::ostream * record = 0)
+        : description(description),
+        iterations(iterations),
+        counters(use_counters ? new perf_counters() : 0),
+        record(record)
     {
+        if (counters) counters->start();
+        started = std::chrono::high_resolution_clock::now();
     }
-    
+
     /* destroys and writes the message */
     ~scoped_timer()
     {
         std::chrono::high_resolution_clock::time_point stopped = std::chrono::high_resolution_clock::now();
+        if (counters) counters->stop();
         std::chrono::duration<double> seconds = std::chrono::duration_cast<std::chrono::duration<double> >(stopped-started);
         std::cout << description << " " << std::fixed << seconds.count() << "s";
-        if (iterations > 0) 
+        if (iterations > 0)
         {
             //suppress per-iteration calculation
             //std::cout << std::scientific << " (" << (seconds.count()/iterations) << " x " << iterations << " its)";
         }
+        if (counters)
+        {
+            // per iteration if we know how many there were
+            double divisor = iterations > 0 ? iterations : 1;
+            for (int e = 0;e < perf_counters::event_count;e ++)
+            {
+                if (!counters->available(e)) continue;
+                std::cout << " " << perf_counters::name(e) << (iterations > 0 ? "/it " : " ")
+                    << (counters->value(e) / divisor);
+            }
+            if (!counters->any_available()) std::cout << " (no hardware counters)";
+        }
+        if (record) write_record(seconds.count());
+    }
+
+private:
+    void write_record(double seconds)
+    {
+        *record << "{\"description\":\"";
+        // skip the tabs etc used for formatting the terminal output
+        for (std::string::iterator i = description.begin();i != description.end();i ++)
+        {
+            if (*i == '"' || *i == '\\') *record << '\\' << *i;
+            else if ((unsigned char)*i >= ' ') *record << *i;
+        }
+        *record << "\",\"seconds\":" << seconds << ",\"iterations\":" << iterations;
+        if (counters)
+        {
+            for (int e = 0;e < perf_counters::event_count;e ++)
+                if (counters->available(e)) *record << ",\"" << perf_counters::name(e) << "\":" << counters->value(e);
+        }
+        *record << "}" << std::endl;
     }
 };
 
-#endif
\ No newline at end of file
+#endif
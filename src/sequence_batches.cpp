@@ -0,0 +1,71 @@
+#include "sequence_batches.hpp"
+#include "fasta_reader.hpp"
+#include "fastq_reader.hpp"
+#include "compressed_input.hpp"
+#include <stdexcept>
+
+/* hands the batch over and starts the next one */
+static void push_batch(sequence_batch & batch, bounded_queue<sequence_batch> & queue)
+{
+    size_t number = batch.number;
+    queue.push(std::move(batch));
+    batch = sequence_batch();
+    batch.number = number + 1;
+}
+
+static void push_if_full(sequence_batch & batch, bounded_queue<sequence_batch> & queue, size_t batch_size)
+{
+    if (batch.sequences.size() == batch_size) push_batch(batch, queue);
+}
+
+static void read_all(const std::vector<std::string> & inputs, bounded_queue<sequence_batch> & queue, size_t batch_size,
+    unsigned int decompress_threads)
+{
+    sequence_batch batch;
+    batch.number = 0;
+    for (auto input = inputs.begin();input != inputs.end();input ++)
+    {
+        compressed_input in(*input, decompress_threads);
+        // FASTQ records start with @ where FASTA ones start with >
+        bool fastq = in.peek() == '@';
+        // a batch is all FASTQ or all FASTA, so the tools can tell which from the batch
+        if (!batch.sequences.empty() && fastq == batch.qualities.empty()) push_batch(batch, queue);
+        if (fastq)
+        {
+            fastq_reader reader(&in);
+            while (reader.next())
+            {
+                batch.headers.push_back(reader.get_header());
+                batch.sequences.push_back(reader.get_sequence());
+                batch.qualities.push_back(reader.get_quality());
+                push_if_full(batch, queue, batch_size);
+            }
+        }
+        else
+        {
+            fasta_reader reader(&in);
+            while (reader.next())
+            {
+                batch.headers.push_back(reader.get_header());
+                batch.sequences.push_back(reader.get_sequence());
+                push_if_full(batch, queue, batch_size);
+            }
+        }
+    }
+    if (!batch.sequences.empty()) queue.push(std::move(batch));
+}
+
+void read_sequence_batches(const std::vector<std::string> & inputs, bounded_queue<sequence_batch> & queue,
+    size_t batch_size, unsigned int decompress_threads)
+{
+    try
+    {
+        read_all(inputs, queue, batch_size, decompress_threads);
+    }
+    catch (...)
+    {
+        queue.close();
+        throw;
+    }
+    queue.close();
+}
@@ -0,0 +1,33 @@
+/*
+    The parsing stage of the command line tools' pipelines
+
+    read_sequence_batches() parses FASTA or FASTQ files (or stdin for "-") on the calling thread into numbered batches
+    of reads on a bounded_queue, for worker threads to pop.  The numbers let a later stage put results back into
+    input order.  Inputs can be gzip or BGZF compressed, and are decompressed on background threads (see
+    compressed_input.hpp).
+*/
+#ifndef __SEQUENCE_BATCHES_HPP
+#define __SEQUENCE_BATCHES_HPP
+#include "bounded_queue.hpp"
+#include <string>
+#include <vector>
+
+/* reads per batch - enough to make the queue operations cheap relative to the work on each batch */
+const size_t SEQUENCE_BATCH_SIZE = 1024;
+
+struct sequence_batch
+{
+    /* the position of the batch in the input, from 0 */
+    size_t number;
+    std::vector<std::string> headers;
+    std::vector<std::string> sequences;
+    /* the quality string of each read - empty for FASTA input */
+    std::vector<std::string> qualities;
+};
+
+/* parses every input in turn onto queue, then closes it.  decompress_threads inflate BGZF inputs (0 for one
+   per core).  The queue is closed and std::runtime_error thrown if an input can't be opened or parsed */
+void read_sequence_batches(const std::vector<std::string> & inputs, bounded_queue<sequence_batch> & queue,
+    size_t batch_size = SEQUENCE_BATCH_SIZE, unsigned int decompress_threads = 0);
+
+#endif
@@ -0,0 +1,65 @@
+#include "unit_test.hpp"
+#include "sequence_bloom_tree.hpp"
+#include "kmer_scan.hpp"
+#include <random>
+#include <stdio.h>
+
+class test_sequence_bloom_tree_t : public unit_test
+{
+    static std::string random_sequence(std::mt19937 & rng, size_t length)
+    {
+        std::string sequence(length, 'A');
+        for (size_t i = 0;i < length;i ++) sequence[i] = "ACGT"[rng() & 3];
+        return sequence;
+    }
+
+    void operator() ()
+    {
+        section("sequence bloom tree");
+        const char * path = "/tmp/bloom-sbt-test.sbt";
+        const int k = 21, samples = 13, m = 1 << 18, h = 3;
+        kmer_ops ops(k);
+        std::mt19937 rng(7);
+        std::vector<std::string> genomes;
+        {
+            sequence_bloom_tree_builder builder(path, k, m, h);
+            for (int i = 0;i < samples;i ++)
+            {
+                genomes.push_back(random_sequence(rng, 20000));
+                sbt_filter filter(m, h);
+                insert_kmers(filter, ops, genomes.back().c_str());
+                builder.add_sample("sample" + std::to_string(i), filter);
+            }
+            builder.finish();
+
+            sbt_filter wrong(m / 2, h);
+            bool threw = false;
+            try { builder.add_sample("late", wrong); } catch (std::runtime_error &) { threw = true; }
+            check(threw, "can't add a sample once finished");
+        }
+
+        sequence_bloom_tree tree(path);
+        check(tree.node_count() == 2 * samples - 1 && tree.getk() == k && tree.getm() == m && tree.geth() == h,
+            "tree header reads back");
+        check(tree.loaded_nodes() == 0, "no nodes are mapped until queried");
+
+        std::string read = genomes[5].substr(1000, 150);
+        std::vector<std::string> found = tree.query(read.c_str(), 0.9);
+        check(found.size() == 1 && found[0] == "sample5", "read is found in its own sample only");
+        check(tree.loaded_nodes() < tree.node_count(), "query only maps the subtrees it descends into");
+
+        // half from one sample, half from another
+        std::string chimera = genomes[2].substr(0, 100) + genomes[11].substr(0, 100);
+        check(tree.query(chimera.c_str(), 0.9).empty(), "chimeric read fails a 90% threshold");
+        check(tree.query(chimera.c_str(), 0.4).size() == 2, "chimeric read passes a 40% threshold in both samples");
+
+        std::string novel = random_sequence(rng, 150);
+        check(tree.query(novel.c_str(), 0.5).empty(), "novel read is found nowhere");
+        check(tree.query("ACGT", 0.5).empty(), "read shorter than k is found nowhere");
+
+        remove(path);
+        bool threw = false;
+        try { sequence_bloom_tree missing(path); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "opening a missing tree throws");
+    }
+} test_sequence_bloom_tree;
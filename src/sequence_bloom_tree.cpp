@@ -0,0 +1,259 @@
+#include "sequence_bloom_tree.hpp"
+#include <stdexcept>
+#include <string.h>
+
+/* nodes start on a page boundary so they can be mapped directly */
+const uint64_t SBT_NODE_ALIGNMENT = 4096;
+
+static uint64_t round_up(uint64_t value, uint64_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+uint64_t sbt_node_bytes(uint64_t m)
+{
+    // what bloomfilter_basic allocates: whole 64 bit blocks plus room to (mis)align
+    return round_up((m + 63) / 64 * 8 + 8, SBT_NODE_ALIGNMENT);
+}
+
+static void write_u32(std::ostream & out, uint32_t value)
+{
+    uint8_t bytes[4];
+    for (int i = 0;i < 4;i ++) bytes[i] = (uint8_t)(value >> (8 * i));
+    out.write((const char *)bytes, 4);
+}
+
+static void write_u64(std::ostream & out, uint64_t value)
+{
+    write_u32(out, (uint32_t)value);
+    write_u32(out, (uint32_t)(value >> 32));
+}
+
+static uint32_t read_u32(std::istream & in)
+{
+    uint8_t bytes[4];
+    if (!in.read((char *)bytes, 4)) throw std::runtime_error("Unexpected end of sequence bloom tree");
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static uint64_t read_u64(std::istream & in)
+{
+    uint64_t low = read_u32(in);
+    return low | ((uint64_t)read_u32(in) << 32);
+}
+
+static void write_header(std::ostream & out, int k, uint64_t m, int h, uint32_t node_count, uint64_t table_offset)
+{
+    out.write("SBT1", 4);
+    write_u32(out, SBT_VERSION);
+    write_u32(out, k);
+    write_u64(out, m);
+    write_u32(out, h);
+    write_u32(out, node_count);
+    write_u64(out, table_offset);
+}
+
+sequence_bloom_tree_builder::sequence_bloom_tree_builder(const std::string & path, int k, uint64_t m, int h)
+    : path(path), out(path.c_str(), std::ios::binary | std::ios::trunc), k(k), m(m), h(h), finished(false)
+{
+    if (!out) throw std::runtime_error("Could not create " + path);
+    // a placeholder until finish() knows the node count and where the table goes
+    write_header(out, k, m, h, 0, 0);
+}
+
+sequence_bloom_tree_builder::~sequence_bloom_tree_builder()
+{
+    try
+    {
+        if (!finished && !nodes.empty()) finish();
+    }
+    catch (std::exception &)
+    {
+    }
+}
+
+uint64_t sequence_bloom_tree_builder::write_bits(const sbt_filter & filter)
+{
+    uint64_t start = round_up(out.tellp(), SBT_NODE_ALIGNMENT);
+    out.seekp(start);
+    uint64_t bytes = sbt_node_bytes(m);
+    std::vector<uint8_t> chunk(FILTER_CODEC_CHUNK_BYTES);
+    for (uint64_t first = 0;first < bytes;first += chunk.size())
+    {
+        size_t todo = std::min((uint64_t)chunk.size(), bytes - first);
+        // read_bits gives zeroes past the end of the filter, which pads the node out
+        size_t valid = first < (uint64_t)(m + 7) / 8 ? std::min((uint64_t)todo, (m + 7) / 8 - first) : 0;
+        memset(&chunk[0], 0, todo);
+        if (valid) filter.read_bits(first, valid, &chunk[0]);
+        out.write((const char *)&chunk[0], todo);
+    }
+    if (!out) throw std::runtime_error("Could not write " + path);
+    return start;
+}
+
+void sequence_bloom_tree_builder::add_sample(const std::string & name, const sbt_filter & filter)
+{
+    if (finished) throw std::runtime_error("Sequence bloom tree already finished");
+    if (filter.getm() != m || filter.geth() != h)
+        throw std::runtime_error("Sample filter has a different m or h to the tree");
+    node leaf;
+    leaf.bits_offset = write_bits(filter);
+    leaf.left = leaf.right = -1;
+    leaf.name = name;
+    nodes.push_back(leaf);
+}
+
+void sequence_bloom_tree_builder::finish()
+{
+    if (finished) return;
+    if (nodes.empty()) throw std::runtime_error("Sequence bloom tree has no samples");
+    finished = true;
+
+    std::vector<int32_t> level;
+    for (size_t i = 0;i < nodes.size();i ++) level.push_back(i);
+    sbt_filter parent(m, h);
+    while (level.size() > 1)
+    {
+        std::vector<int32_t> next;
+        for (size_t i = 0;i < level.size();i += 2)
+        {
+            // an odd one out moves up a level on its own
+            if (i + 1 == level.size())
+            {
+                next.push_back(level[i]);
+                continue;
+            }
+            // the children are already in the file, so map them back rather than keeping every filter around
+            out.flush();
+            parent.clear();
+            for (int child = 0;child < 2;child ++)
+            {
+                storage_options options;
+                options.file = path.c_str();
+                options.file_offset = nodes[level[i + child]].bits_offset;
+                sbt_filter mapped(m, h, options);
+                parent.merge(mapped);
+            }
+            node internal;
+            internal.bits_offset = write_bits(parent);
+            internal.left = level[i];
+            internal.right = level[i + 1];
+            nodes.push_back(internal);
+            next.push_back(nodes.size() - 1);
+        }
+        level.swap(next);
+    }
+
+    uint64_t table_offset = out.tellp();
+    for (size_t i = 0;i < nodes.size();i ++)
+    {
+        write_u64(out, nodes[i].bits_offset);
+        write_u32(out, (uint32_t)nodes[i].left);
+        write_u32(out, (uint32_t)nodes[i].right);
+    }
+    for (size_t i = 0;i < nodes.size();i ++)
+    {
+        write_u32(out, nodes[i].name.size());
+        out.write(nodes[i].name.data(), nodes[i].name.size());
+    }
+    out.seekp(0);
+    write_header(out, k, m, h, nodes.size(), table_offset);
+    out.close();
+    if (out.fail()) throw std::runtime_error("Could not write " + path);
+}
+
+/* checks the magic and version and returns k, so ops can be constructed in the initialiser list */
+static int read_k(const std::string & path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[4];
+    if (!in.read(magic, 4) || memcmp(magic, "SBT1", 4)) throw std::runtime_error("Not a sequence bloom tree: " + path);
+    if (read_u32(in) != SBT_VERSION) throw std::runtime_error("Unsupported sequence bloom tree version");
+    return read_u32(in);
+}
+
+sequence_bloom_tree::sequence_bloom_tree(const std::string & path) : path(path), ops(read_k(path))
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    // read_k has checked the magic and version
+    in.seekg(8);
+    k = read_u32(in);
+    m = read_u64(in);
+    h = read_u32(in);
+    uint32_t node_count = read_u32(in);
+    uint64_t table_offset = read_u64(in);
+    if (m == 0 || node_count == 0) throw std::runtime_error("Sequence bloom tree header corrupt");
+
+    in.seekg(table_offset);
+    nodes.resize(node_count);
+    for (size_t i = 0;i < nodes.size();i ++)
+    {
+        nodes[i].bits_offset = read_u64(in);
+        nodes[i].left = (int32_t)read_u32(in);
+        nodes[i].right = (int32_t)read_u32(in);
+        if (nodes[i].left >= (int32_t)i || nodes[i].right >= (int32_t)i || (nodes[i].left < 0) != (nodes[i].right < 0))
+            throw std::runtime_error("Sequence bloom tree node table corrupt");
+    }
+    for (size_t i = 0;i < nodes.size();i ++)
+    {
+        nodes[i].name.resize(read_u32(in));
+        if (!nodes[i].name.empty() && !in.read(&nodes[i].name[0], nodes[i].name.size()))
+            throw std::runtime_error("Unexpected end of sequence bloom tree");
+    }
+    filters.resize(node_count);
+}
+
+const sbt_filter & sequence_bloom_tree::filter(size_t index)
+{
+    if (!filters[index])
+    {
+        storage_options options;
+        options.file = path.c_str();
+        options.file_offset = nodes[index].bits_offset;
+        filters[index].reset(new sbt_filter(m, h, options));
+    }
+    return *filters[index];
+}
+
+std::vector<std::string> sequence_bloom_tree::query(const char * sequence, double threshold)
+{
+    std::vector<std::string> samples;
+    std::vector<kmer_t> kmers;
+    kmer_t kmer;
+    if (!ops.read_first(&kmer, &sequence)) return samples;
+    do {
+        kmers.push_back(kmer);
+    } while (ops.read_next(&kmer, &sequence));
+
+    size_t needed = (size_t)std::ceil(threshold * kmers.size());
+    size_t allowed_misses = kmers.size() - std::min(needed, kmers.size());
+    std::vector<int32_t> stack(1, nodes.size() - 1);
+    while (!stack.empty())
+    {
+        int32_t index = stack.back();
+        stack.pop_back();
+        const sbt_filter & f = filter(index);
+        // stop counting as soon as the outcome is known
+        size_t hits = 0, misses = 0;
+        for (size_t i = 0;i < kmers.size() && hits < needed && misses <= allowed_misses;i ++)
+        {
+            if (f.contains(kmers[i])) hits ++;
+            else misses ++;
+        }
+        if (hits < needed) continue;
+        if (nodes[index].left < 0) samples.push_back(nodes[index].name);
+        else
+        {
+            stack.push_back(nodes[index].right);
+            stack.push_back(nodes[index].left);
+        }
+    }
+    return samples;
+}
+
+size_t sequence_bloom_tree::loaded_nodes() const
+{
+    size_t count = 0;
+    for (size_t i = 0;i < filters.size();i ++) count += filters[i] ? 1 : 0;
+    return count;
+}
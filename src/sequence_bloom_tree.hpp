@@ -0,0 +1,113 @@
+/*
+    Sequence Bloom tree - an index over many samples that answers "which samples contain this read?"
+
+    Each sample is a bloom filter of its kmers (the leaves).  Each internal node holds the union of its two
+    children's filters, so if too few of a read's kmers hit a node none of the samples below it can match and
+    the whole subtree is skipped.  See Solomon & Kingsford, Fast search of thousands of short-read sequencing
+    experiments, Nature Biotechnology 34 (2016).
+
+    The tree lives in a single file:
+        "SBT1" version(u32) k(u32) m(u64) h(u32) node_count(u32) table_offset(u64)
+        each node's bit array, starting on a 4KB boundary and padded to sbt_node_bytes(m)
+        at table_offset, per node: bits_offset(u64) left(i32) right(i32), then per node the sample name as
+        length(u32) and bytes (empty for internal nodes)
+    The root is the last node.  Leaves have left = right = -1.
+
+    sequence_bloom_tree only maps a node's filter (see storage_options::file) when a query first reaches it,
+    and the mappings are file backed, so the index can be much bigger than RAM.
+*/
+#ifndef __SEQUENCE_BLOOM_TREE_HPP
+#define __SEQUENCE_BLOOM_TREE_HPP
+#include "bloomfilter_basic.hpp"
+#include "kmer.hpp"
+#include "kmer_hash.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+
+/* the filter used for every node.  The hash is part of the file format so it's fixed here */
+typedef bloomfilter_basic<kmer_t, uint64_t, kmer_fmix_hash<> > sbt_filter;
+
+const uint32_t SBT_VERSION = 1;
+
+/* the bytes each node takes up in the file - the filter's storage rounded up to 4KB */
+uint64_t sbt_node_bytes(uint64_t m);
+
+/* Writes a sequence Bloom tree.  Add every sample's filter with add_sample(), then call finish() to build the
+   internal nodes bottom up (each the merge() of its children, which are read back from the file) */
+class sequence_bloom_tree_builder
+{
+private:
+    struct node
+    {
+        uint64_t bits_offset;
+        int32_t left, right;
+        std::string name;
+    };
+
+    std::string path;
+    std::ofstream out;
+    int k;
+    uint64_t m;
+    int h;
+    std::vector<node> nodes;
+    bool finished;
+
+    /* appends the filter's bits to the file, returning where they start */
+    uint64_t write_bits(const sbt_filter & filter);
+public:
+    /* creates the file at path.  Every sample filter must have m bits and h hashes, built from kmers of
+       length k.  Throws std::runtime_error if the file can't be created */
+    sequence_bloom_tree_builder(const std::string & path, int k, uint64_t m, int h);
+
+    /* finishes the file if finish() wasn't called */
+    ~sequence_bloom_tree_builder();
+
+    /* adds a leaf.  Throws std::runtime_error if m or h don't match */
+    void add_sample(const std::string & name, const sbt_filter & filter);
+
+    /* pairs up nodes level by level until only the root is left, then writes the node table */
+    void finish();
+};
+
+class sequence_bloom_tree
+{
+private:
+    struct node
+    {
+        uint64_t bits_offset;
+        int32_t left, right;
+        std::string name;
+    };
+
+    std::string path;
+    kmer_ops ops;
+    int k;
+    uint64_t m;
+    int h;
+    std::vector<node> nodes;
+    /* the mapped filters, null until a query reaches the node */
+    std::vector<std::unique_ptr<sbt_filter> > filters;
+
+    const sbt_filter & filter(size_t index);
+public:
+    /* reads the header and node table of a file written by sequence_bloom_tree_builder.  No filters are
+       mapped yet.  Throws std::runtime_error if the file isn't valid */
+    sequence_bloom_tree(const std::string & path);
+
+    /* returns the names of the samples for which at least threshold (0 to 1) of the kmers of the
+       null-terminated sequence hit the filter, descending only into the subtrees whose union passes the same
+       test.  Not thread safe, because it maps nodes as it goes */
+    std::vector<std::string> query(const char * sequence, double threshold);
+
+    /* the number of node filters mapped so far */
+    size_t loaded_nodes() const;
+
+    size_t node_count() const { return nodes.size(); }
+    int getk() const { return k; }
+    uint64_t getm() const { return m; }
+    int geth() const { return h; }
+};
+
+#endif
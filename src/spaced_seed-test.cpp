@@ -0,0 +1,111 @@
+#include "unit_test.hpp"
+#include "spaced_seed.hpp"
+#include "kmer_scan.hpp"
+#include "bloomfilter_basic.hpp"
+#include "bloomfilter_perfectcheat.hpp"
+#include "kmer_hash.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+class test_spaced_seed_t : public unit_test
+{
+    void operator() ()
+    {
+        section("spaced seeds");
+        std::mt19937 rng(29);
+        std::string sequence(500, 'A');
+        for (size_t i = 0;i < sequence.size();i ++) sequence[i] = "ACGT"[rng() & 3];
+
+        const std::string pattern = "1101101101101101101101101";
+        spaced_seed_ops ops(pattern);
+        check(ops.getspan() == 25 && ops.getweight() == 17, "span and weight");
+
+        // brute force: the care bases of each window read as a kmer
+        kmer_ops care(ops.getweight());
+        const char * p = sequence.c_str();
+        kmer_t window;
+        ops.read_first(&window, &p);
+        size_t position = 0;
+        bool same = true, same_batch = true;
+        do {
+            std::string bases;
+            for (size_t i = 0;i < pattern.size();i ++) if (pattern[i] == '1') bases += sequence[position + i];
+            const char * q = bases.c_str();
+            kmer_t expected, key;
+            care.read_first(&expected, &q);
+            ops.keys(&window, 1, &key);
+            same &= ops.key(window) == expected;
+            same_batch &= key == expected;
+            position ++;
+        } while (ops.read_next(&window, &p));
+        check(same && position == sequence.size() - 24, "keys are the care bases in order");
+        check(same_batch, "batch keys match");
+
+        std::string mutated = sequence;
+        for (size_t i = 2;i < mutated.size();i += 3) mutated[i] = mutated[i] == 'A' ? 'C' : 'A';
+        bloomfilter_perfectcheat<kmer_t> exact(1 << 16, 1);
+        size_t keys = insert_spaced_seeds(exact, ops, sequence.c_str());
+        size_t total = 0, hits = count_spaced_seed_hits(exact, ops, sequence.c_str(), &total);
+        check(keys == total && hits == total, "filter finds every key");
+        // every third window lines the substitutions up with the 0s
+        size_t mutated_total, mutated_hits = count_spaced_seed_hits(exact, ops, mutated.c_str(), &mutated_total);
+        check(mutated_hits >= mutated_total / 3 - 1, "substitutions at don't care positions still hit");
+
+        bool threw = false;
+        try { spaced_seed_ops bad("1102"); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "bad pattern throws");
+        threw = false;
+        try { spaced_seed_ops bad("000"); } catch (std::runtime_error &) { threw = true; }
+        check(threw, "pattern without care positions throws");
+
+        std::string reads(1 << 22, 'A');
+        for (size_t i = 0;i < reads.size();i ++) reads[i] = "ACGT"[rng() & 3];
+        std::vector<kmer_t> windows;
+        p = reads.c_str();
+        ops.read_first(&window, &p);
+        do windows.push_back(window);
+        while (ops.read_next(&window, &p));
+        std::vector<kmer_t> out(windows.size());
+        kmer_ops contiguous(ops.getweight());
+        std::cout << "extract " << windows.size() << " keys, weight " << ops.getweight() << ":" << std::endl;
+        {
+            scoped_timer t("\tcontiguous kmers", windows.size());
+            p = reads.c_str();
+            size_t n = 0;
+            contiguous.read_first(&out[n], &p);
+            while (n + 1 < out.size() && contiguous.read_next(&(out[n + 1] = out[n]), &p)) n ++;
+        }
+        {
+            scoped_timer t("\tspaced seeds", windows.size());
+            p = reads.c_str();
+            size_t n = 0;
+            ops.read_first(&windows[n], &p);
+            while (n + 1 < windows.size() && ops.read_next(&(windows[n + 1] = windows[n]), &p)) n ++;
+            ops.keys(&windows[0], windows.size(), &out[0]);
+        }
+        {
+            scoped_timer t("\t(key gather, pext)", windows.size());
+            spaced_keys(&windows[0], windows.size(), ops.getmask(), &out[0]);
+        }
+        {
+            scoped_timer t("\t(key gather, scalar)", windows.size());
+            spaced_keys_scalar(&windows[0], windows.size(), ops.getmask(), &out[0]);
+        }
+        std::cout << std::endl;
+        bloomfilter_basic<kmer_t, uint64_t, kmer_fmix_hash<> > filter(1 << 26, 3);
+        std::cout << "insert into a filter:" << std::endl;
+        {
+            scoped_timer t("\tcontiguous kmers", windows.size());
+            insert_kmers_batch(filter, contiguous, reads.c_str());
+        }
+        {
+            scoped_timer t("\tspaced seeds", windows.size());
+            insert_spaced_seeds(filter, ops, reads.c_str());
+        }
+        std::cout << std::endl;
+        check(count_spaced_seed_hits(filter, ops, reads.c_str(), &total) == total, "filter of spaced seeds finds every key");
+    }
+} test_spaced_seed;
@@ -0,0 +1,18 @@
+#include "spaced_seed.hpp"
+#include <stdexcept>
+
+spaced_seed_ops::spaced_seed_ops(const std::string & pattern) 
+    : pattern(pattern), weight(0), mask(0), window_ops(pattern.size())
+{
+    for (size_t i = 0;i < pattern.size();i ++)
+    {
+        mask <<= 2;
+        if (pattern[i] == '1')
+        {
+            mask |= 3;
+            weight ++;
+        }
+        else if (pattern[i] != '0') throw std::runtime_error("Seed patterns can only have 0s and 1s");
+    }
+    if (!weight) throw std::runtime_error("Seed pattern has no care positions");
+}
@@ -0,0 +1,145 @@
+/*
+    Spaced seeds - kmers with "don't care" positions, for screening sequence that has diverged
+
+    A seed pattern like 1101101101 says which bases of a window count: the key is the bases at the 1s,
+    packed together in order, so a substitution at a 0 leaves the key unchanged.  spaced_seed_ops rolls the
+    whole window (the pattern's span) with kmer_ops and gathers the care positions out of it with a bit mask.
+
+    With BMI2 the gather is a single PEXT per window; without it the mask is walked a run of 1s at a time.
+    Keys are weight (the number of 1s) bases packed like a kmer_t of that length, so they go into and are
+    tested against any of the filters with kmer_t as index_t.  insert_spaced_seeds and count_spaced_seed_hits
+    extract keys a buffer at a time and pass them to set_batch / test_batch, so the hashing is batched too.
+*/
+#ifndef __SPACED_SEED_HPP
+#define __SPACED_SEED_HPP
+#include "kmer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <immintrin.h>
+
+/* gathers the bits of window under mask into the bottom of the result, in order - a software PEXT */
+inline uint64_t spaced_key_scalar(uint64_t window, uint64_t mask)
+{
+    uint64_t key = 0;
+    int filled = 0;
+    while (mask)
+    {
+        int low = __builtin_ctzll(mask);
+        uint64_t rest = ~(mask >> low);
+        int run = rest ? __builtin_ctzll(rest) : 64 - low;
+        uint64_t run_mask = run == 64 ? ~0ULL : (1ULL << run) - 1;
+        key |= ((window >> low) & run_mask) << filled;
+        filled += run;
+        mask &= ~(run_mask << low);
+    }
+    return key;
+}
+
+inline void spaced_keys_scalar(const uint64_t * windows, size_t count, uint64_t mask, uint64_t * keys)
+{
+    for (size_t i = 0;i < count;i ++) keys[i] = spaced_key_scalar(windows[i], mask);
+}
+
+__attribute__ ((target ("bmi2")))
+inline void spaced_keys_bmi2(const uint64_t * windows, size_t count, uint64_t mask, uint64_t * keys)
+{
+    for (size_t i = 0;i < count;i ++) keys[i] = _pext_u64(windows[i], mask);
+}
+
+typedef void (*spaced_keys_fn)(const uint64_t *, size_t, uint64_t, uint64_t *);
+
+/* keys[i] = the bits of windows[i] under mask, packed */
+inline void spaced_keys(const uint64_t * windows, size_t count, uint64_t mask, uint64_t * keys)
+{
+    static const spaced_keys_fn kernel = __builtin_cpu_supports("bmi2") ? spaced_keys_bmi2 : spaced_keys_scalar;
+    kernel(windows, count, mask, keys);
+}
+
+class spaced_seed_ops
+{
+private:
+    std::string pattern;
+    kmer_size_t weight;
+    /* the two bits of every care position in a window */
+    uint64_t mask;
+    kmer_ops window_ops;
+public:
+    /* the key type, as for kmer_ops */
+    typedef kmer_t kmer_type;
+
+    /* pattern is 1s (care) and 0s (don't care), the first character for the first base of the window.
+       Throws std::runtime_error if it has anything else, no 1s, or is longer than MAXKMERLENGTH */
+    spaced_seed_ops(const std::string & pattern);
+
+    /* reads the first window, advancing sequence past it.  Returns false if the sequence is shorter */
+    bool read_first(kmer_t * window, char const * * sequence) const { return window_ops.read_first(window, sequence); }
+
+    /* rolls the window on a base.  Returns false at the end of the sequence */
+    bool read_next(kmer_t * window, char const * * sequence) const { return window_ops.read_next(window, sequence); }
+
+    /* the key of one window */
+    kmer_t key(kmer_t window) const { return spaced_key_scalar(window, mask); }
+
+    /* the keys of count windows, with PEXT if the cpu has it */
+    void keys(const kmer_t * windows, size_t count, kmer_t * keys) const { spaced_keys(windows, count, mask, keys); }
+
+    const std::string & getpattern() const { return pattern; }
+    kmer_size_t getspan() const { return pattern.size(); }
+    kmer_size_t getweight() const { return weight; }
+    uint64_t getmask() const { return mask; }
+};
+
+/* the number of windows insert_spaced_seeds and count_spaced_seed_hits handle at a time */
+const size_t SPACED_SEED_BUFFER = 256;
+
+/* calls batch(keys, count) for the keys of the null-terminated sequence, a buffer at a time.  Returns the
+   number of keys */
+template<typename batch_t>
+size_t for_each_spaced_seed_batch(const spaced_seed_ops & ops, const char * sequence, batch_t batch)
+{
+    kmer_t windows[SPACED_SEED_BUFFER], keys[SPACED_SEED_BUFFER];
+    kmer_t window;
+    if (!ops.read_first(&window, &sequence)) return 0;
+    size_t buffered = 0, count = 0;
+    do {
+        windows[buffered ++] = window;
+        if (buffered == SPACED_SEED_BUFFER)
+        {
+            ops.keys(windows, buffered, keys);
+            batch(keys, buffered);
+            count += buffered;
+            buffered = 0;
+        }
+    } while (ops.read_next(&window, &sequence));
+    ops.keys(windows, buffered, keys);
+    batch(keys, buffered);
+    return count + buffered;
+}
+
+/* inserts the key of every window of the null-terminated sequence, returning the number of keys */
+template<typename filter_t>
+size_t insert_spaced_seeds(filter_t & filter, const spaced_seed_ops & ops, const char * sequence)
+{
+    return for_each_spaced_seed_batch(ops, sequence, [&filter](const kmer_t * keys, size_t count)
+    {
+        filter.set_batch(keys, count);
+    });
+}
+
+/* returns how many of the keys of the null-terminated sequence the filter contains, and sets total to the
+   number of keys */
+template<typename filter_t>
+size_t count_spaced_seed_hits(const filter_t & filter, const spaced_seed_ops & ops, const char * sequence, size_t * total)
+{
+    size_t hits = 0;
+    *total = for_each_spaced_seed_batch(ops, sequence, [&filter, &hits](const kmer_t * keys, size_t count)
+    {
+        bool results[SPACED_SEED_BUFFER];
+        filter.test_batch(keys, count, results);
+        for (size_t i = 0;i < count;i ++) hits += results[i];
+    });
+    return hits;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include "unit_test.hpp"
+#include "twobit.hpp"
+#include "kmer_scan.hpp"
+#include "bloomfilter_perfectcheat.hpp"
+#include "scoped_timer.hpp"
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <stdio.h>
+
+class test_twobit_t : public unit_test
+{
+    /* the kmers of the runs of ACGT in text, in order */
+    std::vector<kmer_t> text_kmers(const kmer_ops & ops, const std::string & text)
+    {
+        std::vector<kmer_t> kmers;
+        std::string upper(text);
+        for (size_t i = 0;i < upper.size();i ++) upper[i] = toupper(upper[i]);
+        size_t start = 0;
+        while (start < upper.size())
+        {
+            size_t end = upper.find('N', start);
+            if (end == std::string::npos) end = upper.size();
+            std::string run = upper.substr(start, end - start);
+            const char * p = run.c_str();
+            kmer_t kmer;
+            if (ops.read_first(&kmer, &p))
+                do kmers.push_back(kmer);
+                while (ops.read_next(&kmer, &p));
+            start = end + 1;
+        }
+        return kmers;
+    }
+
+    void operator() ()
+    {
+        section(".2bit files");
+        const char * fasta_path = "/tmp/bloom-twobit-test.fa";
+        const char * path = "/tmp/bloom-twobit-test.2bit";
+        const char * swapped_path = "/tmp/bloom-twobit-test-swapped.2bit";
+        std::mt19937 rng(50);
+        // runs of upper and lower case, Ns and the odd other letter, with lengths around the word boundaries
+        const size_t lengths[] = { 1000, 1, 31, 32, 33, 64, 2, 4097 };
+        std::vector<std::string> sequences;
+        std::ofstream fasta(fasta_path, std::ios::trunc);
+        for (size_t i = 0;i < sizeof(lengths) / sizeof(lengths[0]);i ++)
+        {
+            std::string sequence;
+            while (sequence.size() < lengths[i])
+            {
+                size_t run = std::min<size_t>(lengths[i] - sequence.size(), 1 + rng() % 200);
+                int kind = rng() % 8;
+                for (size_t j = 0;j < run;j ++)
+                    sequence += kind == 0 ? 'N' : kind == 1 ? "acgt"[rng() & 3] : kind == 2 ? 'R' : "ACGT"[rng() & 3];
+            }
+            sequences.push_back(sequence);
+            fasta << ">sequence_" << i << " description\n";
+            for (size_t j = 0;j < sequence.size();j += 60) fasta << sequence.substr(j, 60) << "\n";
+        }
+        fasta.close();
+
+        twobit_writer writer;
+        writer.add_fasta(fasta_path);
+        writer.write(path);
+        check(is_twobit_file(path) && !is_twobit_file(fasta_path), "signature");
+
+        twobit_reader reader(path);
+        check(reader.size() == sequences.size() && reader.name(7) == "sequence_7" && reader.find("sequence_3") == 3
+            && reader.find("sequence_8") == reader.size(), "names");
+        bool texts = true, kmers = true;
+        kmer_ops ops(21);
+        twobit_sequence sequence;
+        for (size_t i = 0;i < reader.size();i ++)
+        {
+            reader.read(i, sequence);
+            // other letters come back as N
+            std::string expected = sequences[i];
+            std::replace(expected.begin(), expected.end(), 'R', 'N');
+            texts &= sequence.length == lengths[i] && twobit_text(sequence) == expected;
+            std::vector<kmer_t> packed;
+            for_each_twobit_kmer(ops, sequence, [&packed](kmer_t kmer) { packed.push_back(kmer); });
+            kmers &= packed == text_kmers(ops, expected);
+        }
+        check(texts, "bases, N blocks and lowercase round trip through FASTA");
+        check(kmers, "kmers rolled from the packed words match kmers read from text, skipping Ns");
+
+        // byte-swapped, as a big endian machine would write it
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            twobit_reader original(path);
+            // every u32 outside the names and the packed bases, found by walking the records
+            std::vector<size_t> words;
+            for (size_t w = 0;w < 4;w ++) words.push_back(4 * w);
+            size_t offset = 16;
+            for (size_t i = 0;i < original.size();i ++)
+            {
+                offset += 1 + original.name(i).size();
+                words.push_back(offset);
+                offset += 4;
+            }
+            for (size_t i = 0;i < original.size();i ++)
+            {
+                uint32_t length, count;
+                memcpy(&length, &bytes[offset], 4);
+                size_t record_words = 1;
+                memcpy(&count, &bytes[offset + 4], 4);
+                record_words += 1 + 2 * count;
+                memcpy(&count, &bytes[offset + 4 * record_words], 4);
+                record_words += 1 + 2 * count + 1;
+                for (size_t w = 0;w < record_words;w ++) words.push_back(offset + 4 * w);
+                offset += 4 * record_words + (length + 3) / 4;
+            }
+            for (size_t w = 0;w < words.size();w ++) std::reverse(&bytes[words[w]], &bytes[words[w]] + 4);
+            // reader still has the original mapped
+            std::ofstream(swapped_path, std::ios::binary | std::ios::trunc) << bytes;
+            twobit_reader swapped(swapped_path);
+            bool same = swapped.size() == reader.size();
+            twobit_sequence other;
+            for (size_t i = 0;same && i < swapped.size();i ++)
+            {
+                swapped.read(i, other);
+                reader.read(i, sequence);
+                same &= other.words == sequence.words && twobit_text(other) == twobit_text(sequence);
+            }
+            check(same, "byte-swapped file reads the same");
+        }
+
+        std::ofstream(swapped_path, std::ios::binary | std::ios::trunc) << "not a 2bit file at all";
+        bool threw = false;
+        try { twobit_reader bad(swapped_path); }
+        catch (std::runtime_error &) { threw = true; }
+        check(threw, "not a .2bit file throws");
+
+        // one record claiming 2^32 - 1 N blocks in a file of a few bytes
+        const uint32_t corrupt[] = { TWOBIT_SIGNATURE, 0, 1, 0 };
+        const uint32_t record[] = { 22, 4, 0xffffffff };
+        std::ofstream(swapped_path, std::ios::binary | std::ios::trunc)
+            << std::string((const char *)corrupt, sizeof(corrupt)) << '\x01' << 'a'
+            << std::string((const char *)record, sizeof(record));
+        threw = false;
+        try { twobit_reader(swapped_path).read(0, sequence); }
+        catch (std::runtime_error &) { threw = true; }
+        check(threw, "block count past the end of the file throws before allocating");
+
+        // a chromosome, its kmers read from text and rolled from the packed words
+        std::string chromosome(1 << 25, 'A');
+        for (size_t j = 0;j < chromosome.size();j ++) chromosome[j] = "ACGT"[rng() & 3];
+        twobit_writer big;
+        big.add("chromosome", chromosome.c_str(), chromosome.size());
+        big.write(swapped_path);
+        kmer_ops ops31(31);
+        kmer_t text_sum = 0, packed_sum = 0;
+        size_t text_count = 0, packed_count;
+        std::cout << "kmers of a " << chromosome.size() << " base chromosome:" << std::endl;
+        {
+            scoped_timer t("	from text", chromosome.size());
+            const char * p = chromosome.c_str();
+            kmer_t kmer;
+            ops31.read_first(&kmer, &p);
+            do {
+                text_sum += kmer;
+                text_count ++;
+            } while (ops31.read_next(&kmer, &p));
+        }
+        {
+            scoped_timer t("	read .2bit and roll packed words", chromosome.size());
+            twobit_reader packed(swapped_path);
+            packed.read(0, sequence);
+            packed_count = for_each_twobit_kmer(ops31, sequence, [&packed_sum](kmer_t kmer) { packed_sum += kmer; });
+        }
+        std::cout << std::endl;
+        check(text_count == packed_count && text_sum == packed_sum, "same kmers both ways");
+
+        bloomfilter_perfectcheat<kmer_t> exact(1 << 16, 1);
+        reader.read(0, sequence);
+        size_t inserted = insert_twobit_kmers(exact, ops, sequence), total;
+        check(inserted == text_kmers(ops, twobit_text(sequence)).size()
+            && count_twobit_kmer_hits(exact, ops, sequence, &total) == total && total == inserted, "insert and count");
+        remove(fasta_path);
+        remove(swapped_path);
+        remove(path);
+    }
+} test_twobit;
@@ -0,0 +1,329 @@
+#include "twobit.hpp"
+#include "mapped_file.hpp"
+#include "compressed_input.hpp"
+#include "fasta_reader.hpp"
+#include <fstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <string.h>
+#include <ctype.h>
+
+namespace
+{
+    /* the file's base codes against kmer.hpp's, for a whole byte of four bases in either direction */
+    struct twobit_tables
+    {
+        uint8_t to_nucleotides[256];
+        uint8_t from_nucleotides[256];
+
+        twobit_tables()
+        {
+            // T C A G in the file
+            const uint8_t nucleotide[4] = { NUCLEOTIDE_T, NUCLEOTIDE_C, NUCLEOTIDE_A, NUCLEOTIDE_G };
+            uint8_t code[4];
+            for (int i = 0;i < 4;i ++) code[nucleotide[i]] = i;
+            for (int byte = 0;byte < 256;byte ++)
+            {
+                to_nucleotides[byte] = from_nucleotides[byte] = 0;
+                for (int shift = 0;shift < 8;shift += 2)
+                {
+                    to_nucleotides[byte] |= nucleotide[(byte >> shift) & 3] << shift;
+                    from_nucleotides[byte] |= code[(byte >> shift) & 3] << shift;
+                }
+            }
+        }
+    };
+
+    const twobit_tables tables;
+
+    void put_u32(std::ostream & out, uint32_t value)
+    {
+        char bytes[4] = { (char)value, (char)(value >> 8), (char)(value >> 16), (char)(value >> 24) };
+        out.write(bytes, 4);
+    }
+
+    void put_u64(std::ostream & out, uint64_t value)
+    {
+        put_u32(out, (uint32_t)value);
+        put_u32(out, (uint32_t)(value >> 32));
+    }
+
+    /* adds base i to the last block of blocks if it carries straight on from it, otherwise starts a new one */
+    void extend_blocks(std::vector<twobit_block> & blocks, uint32_t i)
+    {
+        if (!blocks.empty() && blocks.back().start + blocks.back().size == i) blocks.back().size ++;
+        else
+        {
+            twobit_block block = { i, 1 };
+            blocks.push_back(block);
+        }
+    }
+
+    /* the record as it is in the file, without the name */
+    uint64_t record_bytes(const twobit_sequence & sequence)
+    {
+        return 4 * (4 + 2 * (sequence.n_blocks.size() + sequence.mask_blocks.size())) + (sequence.length + 3) / 4;
+    }
+}
+
+struct twobit_reader::privates
+{
+    mapped_file file;
+    bool swapped;
+    uint32_t version;
+    std::vector<std::string> names;
+    std::vector<uint64_t> offsets;
+    std::unordered_map<std::string, size_t> lookup;
+
+    privates(const std::string & path) : file(path) {}
+
+    /* the bytes at offset, throwing if they run past the end of the file */
+    const uint8_t * at(uint64_t offset, uint64_t bytes) const
+    {
+        if (offset > file.size() || bytes > file.size() - offset) throw std::runtime_error("Truncated .2bit file");
+        return (const uint8_t *)file.data() + offset;
+    }
+
+    uint32_t get_u32(uint64_t offset) const
+    {
+        uint32_t value;
+        memcpy(&value, at(offset, 4), 4);
+        return swapped ? __builtin_bswap32(value) : value;
+    }
+
+    /* count starts then count sizes at offset */
+    void get_blocks(uint64_t offset, uint32_t count, std::vector<twobit_block> & blocks) const
+    {
+        // before allocating, so a corrupt count throws rather than asking for up to 32GB
+        at(offset, 8ULL * count);
+        blocks.resize(count);
+        for (uint32_t i = 0;i < count;i ++)
+        {
+            blocks[i].start = get_u32(offset + 4 * i);
+            blocks[i].size = get_u32(offset + 4 * (count + i));
+        }
+        std::sort(blocks.begin(), blocks.end(), [](const twobit_block & a, const twobit_block & b)
+        {
+            return a.start < b.start;
+        });
+    }
+
+    /* throws unless every block is within the sequence */
+    void check_blocks(const twobit_sequence & sequence, const std::vector<twobit_block> & blocks) const
+    {
+        for (size_t i = 0;i < blocks.size();i ++)
+            if ((uint64_t)blocks[i].start + blocks[i].size > sequence.length)
+                throw std::runtime_error("Block past the end of .2bit record " + sequence.name);
+    }
+};
+
+twobit_reader::twobit_reader(const std::string & path)
+{
+    m = new privates(path);
+    try
+    {
+        uint32_t signature;
+        memcpy(&signature, m->at(0, 16), 4);
+        if (signature != TWOBIT_SIGNATURE && signature != __builtin_bswap32(TWOBIT_SIGNATURE))
+            throw std::runtime_error("Not a .2bit file: " + path);
+        m->swapped = signature != TWOBIT_SIGNATURE;
+        m->version = m->get_u32(4);
+        if (m->version > 1) throw std::runtime_error("Unsupported .2bit version in " + path);
+        uint32_t count = m->get_u32(8);
+        uint64_t offset = 16;
+        for (uint32_t i = 0;i < count;i ++)
+        {
+            size_t name_length = *m->at(offset, 1);
+            m->names.push_back(std::string((const char *)m->at(offset + 1, name_length), name_length));
+            offset += 1 + name_length;
+            uint64_t record = m->get_u32(offset);
+            if (m->version == 1)
+            {
+                uint64_t high = m->get_u32(offset + 4);
+                record = m->swapped ? (record << 32) | high : (high << 32) | record;
+            }
+            m->offsets.push_back(record);
+            offset += m->version == 1 ? 8 : 4;
+            m->lookup.insert(std::make_pair(m->names.back(), i));
+        }
+    }
+    catch (...)
+    {
+        delete m;
+        throw;
+    }
+}
+
+twobit_reader::~twobit_reader()
+{
+    delete m;
+}
+
+size_t twobit_reader::size() const
+{
+    return m->names.size();
+}
+
+const std::string & twobit_reader::name(size_t record) const
+{
+    if (record >= m->names.size()) throw std::runtime_error(".2bit record out of range");
+    return m->names[record];
+}
+
+size_t twobit_reader::find(const std::string & name) const
+{
+    auto found = m->lookup.find(name);
+    return found == m->lookup.end() ? m->names.size() : found->second;
+}
+
+void twobit_reader::read(size_t record, twobit_sequence & sequence) const
+{
+    sequence.name = name(record);
+    uint64_t offset = m->offsets[record];
+    sequence.length = m->get_u32(offset);
+    uint32_t n_count = m->get_u32(offset + 4);
+    m->get_blocks(offset + 8, n_count, sequence.n_blocks);
+    offset += 8 + 8ULL * n_count;
+    uint32_t mask_count = m->get_u32(offset);
+    m->get_blocks(offset + 4, mask_count, sequence.mask_blocks);
+    // past the reserved word
+    offset += 8 + 8ULL * mask_count;
+    m->check_blocks(sequence, sequence.n_blocks);
+    m->check_blocks(sequence, sequence.mask_blocks);
+    const uint64_t bytes = (sequence.length + 3) / 4;
+    const uint8_t * packed = m->at(offset, bytes);
+
+    // eight bytes of four bases to a word, translated a byte at a time
+    sequence.words.resize((sequence.length + 31) / 32);
+    const uint8_t * table = tables.to_nucleotides;
+    const uint64_t whole = bytes / 8;
+    for (uint64_t w = 0;w < whole;w ++)
+    {
+        const uint8_t * in = packed + 8 * w;
+        sequence.words[w] = (uint64_t)table[in[0]] << 56 | (uint64_t)table[in[1]] << 48 | (uint64_t)table[in[2]] << 40
+            | (uint64_t)table[in[3]] << 32 | (uint64_t)table[in[4]] << 24 | (uint64_t)table[in[5]] << 16
+            | (uint64_t)table[in[6]] << 8 | table[in[7]];
+    }
+    if (whole < sequence.words.size())
+    {
+        uint64_t word = 0;
+        for (uint64_t i = 8 * whole;i < 8 * whole + 8;i ++) word = word << 8 | (i < bytes ? table[packed[i]] : 0);
+        sequence.words[whole] = word;
+    }
+}
+
+bool is_twobit_file(const std::string & path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    uint32_t signature = 0;
+    in.read((char *)&signature, 4);
+    return in && (signature == TWOBIT_SIGNATURE || signature == __builtin_bswap32(TWOBIT_SIGNATURE));
+}
+
+void twobit_writer::add(const std::string & name, const char * sequence, size_t length)
+{
+    if (name.size() > 255) throw std::runtime_error(".2bit names can't be longer than 255: " + name);
+    if (length > UINT32_MAX) throw std::runtime_error(".2bit sequences can't be 4G bases or longer: " + name);
+    sequences.push_back(twobit_sequence());
+    twobit_sequence & packed = sequences.back();
+    packed.name = name;
+    packed.length = length;
+    packed.words.assign((length + 31) / 32, 0);
+    for (size_t i = 0;i < length;i ++)
+    {
+        char base = sequence[i];
+        if (islower((unsigned char)base)) extend_blocks(packed.mask_blocks, i);
+        kmer_t bits = (unsigned char)base < 128 ? text_mapping.asciiToBits[(unsigned char)base] : KMER_INVALID;
+        if (bits == KMER_INVALID)
+        {
+            // stored as T, which is 0 in the file
+            extend_blocks(packed.n_blocks, i);
+            bits = NUCLEOTIDE_T;
+        }
+        packed.words[i / 32] |= bits << (62 - 2 * (i % 32));
+    }
+}
+
+void twobit_writer::add_fasta(const std::string & path)
+{
+    compressed_input in(path);
+    fasta_reader reader(&in);
+    while (reader.next())
+    {
+        // the name is the header up to the first whitespace, as with faToTwoBit
+        const char * header = reader.get_header();
+        size_t name_length = 0;
+        while (header[name_length] && !isspace((unsigned char)header[name_length])) name_length ++;
+        const char * sequence = reader.get_sequence();
+        add(std::string(header, name_length), sequence, strlen(sequence));
+    }
+}
+
+void twobit_writer::write(const std::string & path) const
+{
+    // 64 bit offsets only if 32 bit ones can't reach the last record
+    uint64_t last = 16;
+    for (size_t i = 0;i < sequences.size();i ++) last += 1 + sequences[i].name.size() + 4;
+    for (size_t i = 0;i + 1 < sequences.size();i ++) last += record_bytes(sequences[i]);
+    const uint32_t version = last > UINT32_MAX ? 1 : 0;
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Could not create " + path);
+    put_u32(out, TWOBIT_SIGNATURE);
+    put_u32(out, version);
+    put_u32(out, sequences.size());
+    put_u32(out, 0);
+    uint64_t offset = 16;
+    for (size_t i = 0;i < sequences.size();i ++) offset += 1 + sequences[i].name.size() + (version ? 8 : 4);
+    for (size_t i = 0;i < sequences.size();i ++)
+    {
+        out.put((char)sequences[i].name.size());
+        out.write(sequences[i].name.data(), sequences[i].name.size());
+        if (version) put_u64(out, offset);
+        else put_u32(out, offset);
+        offset += record_bytes(sequences[i]);
+    }
+
+    std::vector<uint8_t> packed;
+    for (size_t i = 0;i < sequences.size();i ++)
+    {
+        const twobit_sequence & sequence = sequences[i];
+        put_u32(out, sequence.length);
+        const std::vector<twobit_block> * blocks[2] = { &sequence.n_blocks, &sequence.mask_blocks };
+        for (int b = 0;b < 2;b ++)
+        {
+            put_u32(out, blocks[b]->size());
+            for (size_t j = 0;j < blocks[b]->size();j ++) put_u32(out, (*blocks[b])[j].start);
+            for (size_t j = 0;j < blocks[b]->size();j ++) put_u32(out, (*blocks[b])[j].size);
+        }
+        put_u32(out, 0);
+        packed.resize((sequence.length + 3) / 4);
+        for (size_t j = 0;j < packed.size();j ++)
+            packed[j] = tables.from_nucleotides[(sequence.words[j / 8] >> (56 - 8 * (j % 8))) & 0xff];
+        out.write((const char *)packed.data(), packed.size());
+    }
+    if (!out) throw std::runtime_error("Could not write " + path);
+}
+
+std::string twobit_text(const twobit_sequence & sequence, bool soft_mask)
+{
+    std::string text;
+    text.reserve(sequence.length);
+    append_twobit_bases(sequence, 0, sequence.length, text);
+    for (size_t i = 0;i < sequence.n_blocks.size();i ++)
+        text.replace(sequence.n_blocks[i].start, sequence.n_blocks[i].size, sequence.n_blocks[i].size, 'N');
+    if (soft_mask)
+        for (size_t i = 0;i < sequence.mask_blocks.size();i ++)
+        {
+            const twobit_block & block = sequence.mask_blocks[i];
+            for (uint64_t j = block.start;j < (uint64_t)block.start + block.size;j ++) text[j] = tolower(text[j]);
+        }
+    return text;
+}
+
+void append_twobit_bases(const twobit_sequence & sequence, uint64_t begin, uint64_t end, std::string & text)
+{
+    size_t first = text.size();
+    text.resize(first + (end - begin));
+    for (uint64_t i = begin;i < end;i ++) text[first + (i - begin)] = text_mapping.bitsToAscii[sequence.base(i)];
+}
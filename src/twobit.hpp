@@ -0,0 +1,211 @@
+/*
+    UCSC .2bit references: bases packed four to a byte, with the runs of N and of lowercase kept separately
+
+    A .2bit file is a quarter the size of the FASTA, so loading a reference reads a quarter of the bytes.
+    twobit_reader maps one and unpacks a record into a twobit_sequence: the bases in the NUCLEOTIDE_ codes of
+    kmer.hpp, 32 to a 64 bit word with the first base in the top bits, and the N blocks.  The file's own codes
+    (T C A G = 0 1 2 3) are translated a byte - four bases - at a time through a table.  for_each_twobit_kmer()
+    then rolls kmers straight off the words, two bits per base, with no ASCII to decode, skipping every kmer
+    that overlaps an N block (which the file stores as Ts).
+
+    twobit_writer packs FASTA sequences into the same format, as faToTwoBit does: anything other than ACGT
+    becomes N, and lowercase runs become mask blocks.  The offsets are 32 bit (version 0) unless the file is
+    4GB or more, when it writes version 1 with 64 bit offsets; the reader takes either, in either byte order.
+
+    Layout (integers in the writer's byte order):
+        signature 0x1A412743, version, record count, reserved (u32 each)
+        per record: name length (u8), name, offset of the record (u32, or u64 in version 1)
+        each record: base count, N block count, N block starts, N block sizes, mask block count, mask block
+            starts, mask block sizes, reserved (u32 each), then the bases, four to a byte, first in the top bits
+*/
+#ifndef __TWOBIT_HPP
+#define __TWOBIT_HPP
+#include "kmer.hpp"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+
+const uint32_t TWOBIT_SIGNATURE = 0x1A412743;
+
+/* a run of bases [start, start + size) */
+struct twobit_block
+{
+    uint32_t start;
+    uint32_t size;
+};
+
+struct twobit_sequence
+{
+    std::string name;
+    uint64_t length;
+    /* the bases as NUCLEOTIDE_ codes, base i in bits 63 - 2 (i % 32) down of words[i / 32] */
+    std::vector<uint64_t> words;
+    /* in order of start */
+    std::vector<twobit_block> n_blocks;
+    std::vector<twobit_block> mask_blocks;
+
+    /* the NUCLEOTIDE_ code of base i */
+    unsigned int base(uint64_t i) const { return (words[i / 32] >> (62 - 2 * (i % 32))) & 3; }
+};
+
+class twobit_reader
+{
+private:
+    /* pImpl pattern allows private members to be defined in cpp file */
+    struct privates;
+    privates * m;
+public:
+    /* maps the file at path and reads its index.  Throws std::runtime_error if it isn't a .2bit file */
+    twobit_reader(const std::string & path);
+    twobit_reader(const twobit_reader &) = delete;
+    twobit_reader & operator=(const twobit_reader &) = delete;
+
+    virtual ~twobit_reader();
+
+    /* the number of records */
+    size_t size() const;
+
+    const std::string & name(size_t record) const;
+
+    /* the record with the name, or size() if there isn't one */
+    size_t find(const std::string & name) const;
+
+    /* unpacks the record into sequence, reusing its buffers.  Only reads the mapping, so threads can read
+       records at once.  Throws std::runtime_error if the record runs past the end of the file */
+    void read(size_t record, twobit_sequence & sequence) const;
+};
+
+/* is the file at path a .2bit file, going by its signature */
+bool is_twobit_file(const std::string & path);
+
+class twobit_writer
+{
+private:
+    std::vector<twobit_sequence> sequences;
+public:
+    /* packs a sequence (letters, as from fasta_reader) in memory */
+    void add(const std::string & name, const char * sequence, size_t length);
+
+    /* adds every record of a FASTA file, which may be compressed (see compressed_input.hpp) */
+    void add_fasta(const std::string & path);
+
+    /* writes the records added so far.  Throws std::runtime_error if the file can't be written */
+    void write(const std::string & path) const;
+};
+
+/* the sequence as text, with Ns for the N blocks and (if soft_mask) lowercase for the mask blocks */
+std::string twobit_text(const twobit_sequence & sequence, bool soft_mask = true);
+
+/* appends bases [begin, end) as uppercase ACGT - the caller keeps clear of the N blocks */
+void append_twobit_bases(const twobit_sequence & sequence, uint64_t begin, uint64_t end, std::string & text);
+
+/* calls run(begin, end) for each run of bases between the N blocks */
+template<typename run_t>
+void for_each_twobit_run(const twobit_sequence & sequence, run_t run)
+{
+    uint64_t start = 0;
+    for (size_t i = 0;i < sequence.n_blocks.size();i ++)
+    {
+        const twobit_block & block = sequence.n_blocks[i];
+        if (block.start > start) run(start, (uint64_t)block.start);
+        start = std::max(start, (uint64_t)block.start + block.size);
+    }
+    if (start < sequence.length) run(start, sequence.length);
+}
+
+/* calls visit(kmer) for every kmer of the sequence clear of the N blocks, in order, rolling each run a word
+   of 32 bases at a time.  ops is kmer_ops or any other ops with 64 bit kmers (k up to 32).  Returns the
+   number of kmers */
+template<typename ops_t, typename visit_t>
+size_t for_each_twobit_kmer(const ops_t & ops, const twobit_sequence & sequence, visit_t visit)
+{
+    static_assert(sizeof(typename ops_t::kmer_type) == sizeof(uint64_t), "kmers must be one word");
+    const size_t k = ops.getlength();
+    const kmer_t mask = ~(kmer_t)0 >> (64 - 2 * k);
+    size_t count = 0;
+    for_each_twobit_run(sequence, [&](uint64_t begin, uint64_t end)
+    {
+        if (end - begin < k) return;
+        kmer_t kmer = 0;
+        size_t filled = 0;
+        uint64_t i = begin;
+        while (i < end)
+        {
+            uint64_t word = sequence.words[i / 32] << (2 * (i % 32));
+            uint64_t stop = std::min(end, (i | 31) + 1);
+            for (;i < stop;i ++)
+            {
+                kmer = ((kmer << 2) | (word >> 62)) & mask;
+                word <<= 2;
+                if (++ filled >= k)
+                {
+                    visit(kmer);
+                    count ++;
+                }
+            }
+        }
+    });
+    return count;
+}
+
+/* inserts every kmer of the sequence clear of the N blocks, returning the number of kmers */
+template<typename filter_t, typename ops_t>
+size_t insert_twobit_kmers(filter_t & filter, const ops_t & ops, const twobit_sequence & sequence)
+{
+    return for_each_twobit_kmer(ops, sequence, [&filter](uint64_t kmer) { filter.add(kmer); });
+}
+
+/* returns how many of the kmers of the sequence clear of the N blocks the filter contains, and sets total to
+   the number of them */
+template<typename filter_t, typename ops_t>
+size_t count_twobit_kmer_hits(const filter_t & filter, const ops_t & ops, const twobit_sequence & sequence,
+    size_t * total)
+{
+    size_t hits = 0;
+    *total = for_each_twobit_kmer(ops, sequence, [&filter, &hits](uint64_t kmer) { hits += filter.contains(kmer); });
+    return hits;
+}
+
+/* unpacks the records of the file on threads threads (0 for one per core), each taking the next record, and
+   calls work(worker, sequence) for each, with worker the thread's number from 0.  Rethrows the first
+   exception from work once every thread has stopped */
+template<typename work_t>
+void parse_twobit_records(const twobit_reader & reader, unsigned int threads, work_t work)
+{
+    if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_lock;
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0;t < threads;t ++)
+    {
+        workers.push_back(std::thread([&, t]()
+        {
+            twobit_sequence sequence;
+            try
+            {
+                for (size_t record = next ++;record < reader.size();record = next ++)
+                {
+                    reader.read(record, sequence);
+                    work(t, (const twobit_sequence &)sequence);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_lock);
+                if (!error) error = std::current_exception();
+                next = reader.size();
+            }
+        }));
+    }
+    for (auto w = workers.begin();w != workers.end();w ++) w->join();
+    if (error) std::rethrow_exception(error);
+}
+
+#endif